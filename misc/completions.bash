@@ -138,6 +138,7 @@ _clifm ()
         --si
         --smenutab
         --sort-reverse
+        --startup-profile
         --stat
         --stat-full
         --stdtab
@@ -149,6 +149,7 @@
 #define LOPT_STAT                   271
 #define LOPT_STAT_FULL              272
 #define LOPT_READONLY               273
+#define LOPT_STARTUP_PROFILE        274
 
 /* Link long (--option) and short options (-o) for the getopt_long function. */
 static const struct option longopts[] = {
@@ -258,6 +259,7 @@ static const struct option longopts[] = {
 	{"shotgun-file", required_argument, 0, LOPT_SHOTGUN_FILE},
 	{"si", no_argument, 0, LOPT_SI},
 	{"smenutab", no_argument, 0, LOPT_SMENUTAB},
+	{"startup-profile", no_argument, 0, LOPT_STARTUP_PROFILE},
 	{"stat", required_argument, 0, LOPT_STAT},
 	{"stat-full", required_argument, 0, LOPT_STAT_FULL},
 	{"stdtab", no_argument, 0, LOPT_STDTAB},
@@ -1596,6 +1598,7 @@ parse_cmdline_args(const int argc, char **argv)
 		case LOPT_PRINT_SEL:
 			xargs.printsel = conf.print_selfiles = 1; break;
 		case LOPT_READONLY: xargs.readonly = conf.readonly = 1; break;
+		case LOPT_STARTUP_PROFILE: xargs.startup_profile = 1; break;
 		case LOPT_RL_VI_MODE:
 			xargs.rl_vi_mode = 1; break;
 		case LOPT_SECURE_CMDS:
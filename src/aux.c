@@ -39,10 +39,23 @@
 #include <limits.h>
 #include <readline/readline.h>
 
+#if defined(LINUX_GETDENTS) || defined(USE_XDU)
+# include <pthread.h>
+#endif /* LINUX_GETDENTS || USE_XDU */
+#if defined(LINUX_GETDENTS)
+# include <sys/syscall.h>
+#endif /* LINUX_GETDENTS */
+#if defined(USE_XDU)
+# include <fcntl.h>
+# include <stdint.h>
+#endif /* USE_XDU */
+
 #include "aux.h"
 #include "exec.h"
 #include "misc.h"
 #include "checks.h"
+#include "dircache.h"
+#include "prefetch.h"
 #ifndef _NO_HIGHLIGHT
 # include "highlight.h"
 #endif /* !_NO_HIGHLIGHT */
@@ -66,33 +79,6 @@ xregerror(const char *cmd_name, const char *pattern, const int errcode,
 	free(buf);
 }
 
-#ifndef _NO_ICONS
-/* Generate a hash of the string STR (case sensitively if CASE_SENTITIVE is
- * set to 1).
- * Based on the sdbm algorithm (see http://www.cse.yorku.ca/~oz/hash.html),
- * released under the public-domain. */
-size_t
-hashme(const char *str, const int case_sensitive) {
-	size_t hash = 0;
-
-	/* Two while loops, so that we don't need to check CASE_SENSITIVE for
-	 * each character in STR */
-	if (case_sensitive == 1) {
-		while (*str) {
-			hash = (size_t)*str	+ (hash << 6) + (hash << 16) - hash;
-			str++;
-		}
-	} else {
-		while (*str) {
-			hash = (size_t)TOUPPER(*str) + (hash << 6) + (hash << 16) - hash;
-			str++;
-		}
-	}
-
-	return hash;
-}
-#endif /* !_NO_ICONS */
-
 void
 gen_time_str(char *buf, const size_t size, const time_t _time)
 {
@@ -764,6 +750,94 @@ hex2rgb(char *hex)
 	return tmp_color;
 }
 
+#if defined(LINUX_GETDENTS)
+/* Read as many entries from the directory FD as fit in BUF (SIZE bytes).
+ * Returns the amount of bytes read, zero at the end of the directory, or
+ * -1 in case of error. */
+static ssize_t
+xgetdents(const int fd, char *buf, const size_t size)
+{
+	return (ssize_t)syscall(SYS_getdents64, fd, buf, size);
+}
+
+static pthread_key_t count_buf_key;
+static pthread_once_t count_buf_once = PTHREAD_ONCE_INIT;
+static int count_buf_ok = 0;
+
+static void
+init_count_buf_key(void)
+{
+	count_buf_ok = (pthread_key_create(&count_buf_key, free) == 0);
+}
+
+/* Return the buffer used by count_dir() to read directory entries.
+ * count_dir() might be called from several threads at once (see
+ * prefetch.c), so that each thread gets its own buffer, which is
+ * freed when the thread exits. Returns NULL in case of error. */
+static char *
+get_count_buf(void)
+{
+	pthread_once(&count_buf_once, init_count_buf_key);
+	if (count_buf_ok == 0)
+		return (char *)NULL;
+
+	char *buf = pthread_getspecific(count_buf_key);
+	if (buf)
+		return buf;
+
+	buf = (char *)xnmalloc(GETDENTS_BUF_SIZE, sizeof(char));
+	if (pthread_setspecific(count_buf_key, buf) != 0) {
+		free(buf);
+		return (char *)NULL;
+	}
+
+	return buf;
+}
+
+/* Same as count_dir(), but reading entries in batches via getdents64(2).
+ * Returns -2 if the buffer could not be set up, in which case the caller
+ * should fall back to readdir(3). */
+static filesn_t
+count_dir_getdents(const char *dir, const int pop)
+{
+	char *buf = get_count_buf();
+	if (!buf)
+		return (-2);
+
+	const int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) {
+		if (errno == ENOMEM)
+			exit(ENOMEM);
+		return (-1);
+	}
+
+	filesn_t c = 0;
+	ssize_t len;
+
+	while ((len = xgetdents(fd, buf, GETDENTS_BUF_SIZE)) > 0) {
+		size_t pos = 0;
+		while (pos < (size_t)len) {
+			const xdirent_t *ent = (xdirent_t *)(void *)(buf + pos);
+			pos += ent->d_reclen;
+			/* Deleted entry: readdir(3) skips these as well */
+			if (ent->d_ino == 0)
+				continue;
+
+			if (c > FILESN_MAX - 1)
+				goto END;
+
+			c++;
+			if (pop && c > 2)
+				goto END;
+		}
+	}
+
+END:
+	close(fd);
+	return c;
+}
+#endif /* LINUX_GETDENTS */
+
 /* Count files in the directory DIR, including self and parent. If POP is set
  * to 1, the function will just check if the directory is populated (it has at
  * least 3 files, including self and parent).
@@ -774,6 +848,12 @@ count_dir(const char *dir, const int pop)
 	if (!dir)
 		return (-1);
 
+#if defined(LINUX_GETDENTS)
+	const filesn_t ret = count_dir_getdents(dir, pop);
+	if (ret != -2)
+		return ret;
+#endif /* LINUX_GETDENTS */
+
 	DIR *p;
 
 	if ((p = opendir(dir)) == NULL) {
@@ -809,6 +889,57 @@ count_dir(const char *dir, const int pop)
 	return c;
 }
 
+/* Prepare the directory stream DIR to be read via read_dirbuf(). DIR must
+ * not be read via readdir(3) afterwards. Once done, call free_dirbuf(). */
+void
+init_dirbuf(struct dirbuf_t *d, DIR *dir)
+{
+	d->dir = dir;
+	d->len = d->pos = 0;
+#if defined(LINUX_GETDENTS)
+	d->buf = (char *)xnmalloc(GETDENTS_BUF_SIZE, sizeof(char));
+#else
+	d->buf = (char *)NULL;
+#endif /* LINUX_GETDENTS */
+}
+
+/* Return the next entry in the directory stream D, or NULL at the end of
+ * the directory (or in case of error). On Linux, entries are read in
+ * batches of GETDENTS_BUF_SIZE bytes via getdents64(2), reducing the amount
+ * of system calls needed to read big directories. Elsewhere, this is just
+ * a wrapper around readdir(3). */
+xdirent_t *
+read_dirbuf(struct dirbuf_t *d)
+{
+#if defined(LINUX_GETDENTS)
+	while (1) {
+		if (d->pos >= d->len) {
+			const ssize_t ret =
+				xgetdents(dirfd(d->dir), d->buf, GETDENTS_BUF_SIZE);
+			if (ret <= 0)
+				return (xdirent_t *)NULL;
+			d->len = (size_t)ret;
+			d->pos = 0;
+		}
+
+		xdirent_t *ent = (xdirent_t *)(void *)(d->buf + d->pos);
+		d->pos += ent->d_reclen;
+		if (ent->d_ino != 0)
+			return ent;
+	}
+#else
+	return readdir(d->dir);
+#endif /* LINUX_GETDENTS */
+}
+
+void
+free_dirbuf(struct dirbuf_t *d)
+{
+	free(d->buf);
+	d->buf = (char *)NULL;
+	d->len = d->pos = 0;
+}
+
 /* Get the path of a the command CMD inspecting all paths in the PATH
  * environment variable (it basically does the same as which(1)).
  * Returns the appropriate path or NULL in case of error (in which case
@@ -927,48 +1058,212 @@ construct_human_size(const off_t size)
 }
 
 #ifdef USE_XDU
+/* Files with more than one hard link found by dir_size() are tracked in
+ * XDU_HL_SHARDS independent sets, each protected by its own mutex, so that
+ * dir_size() workers rarely have to wait for each other.
+ *
+ * Each set is an open addressing hash table (linear probing) of (dev, ino)
+ * pairs, so that checking a file takes constant time no matter how many
+ * hard links were already found (build trees and ccache directories easily
+ * contain millions of them). Tables are allocated from an arena (when a
+ * table grows, the old one is just abandoned), so that everything is
+ * released at once by free_xdu_hardlinks(). */
+#define XDU_HL_SHARDS_BITS 6
+#define XDU_HL_SHARDS (1 << XDU_HL_SHARDS_BITS)
+/* Initial amount of slots of each table (must be a power of two) */
+#define XDU_HL_INIT_SLOTS 64
+/* Size of each arena block (bigger tables get a block of their own) */
+#define XDU_HL_BLOCK_SIZE (256 * 1024)
+
+/* A zeroed entry (ino == 0) marks an empty slot */
 struct hlink_t {
 	dev_t dev;
 	ino_t ino;
 };
 
-static struct hlink_t *xdu_hardlinks = {0};
-static size_t xdu_hardlink_n = 0;
+struct hlink_shard_t {
+	pthread_mutex_t mutex;
+	struct hlink_t *slots;
+	size_t mask; /* Amount of slots - 1 */
+	size_t n;
+};
 
-static inline int
-check_xdu_hardlinks(const dev_t dev, const ino_t ino)
+struct hlink_block_t {
+	struct hlink_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+static struct hlink_shard_t xdu_hardlinks[XDU_HL_SHARDS];
+static pthread_once_t xdu_hardlinks_once = PTHREAD_ONCE_INIT;
+static struct hlink_block_t *xdu_hl_arena = (struct hlink_block_t *)NULL;
+static pthread_mutex_t xdu_hl_arena_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+init_xdu_hardlinks(void)
 {
-	if (!xdu_hardlinks || xdu_hardlink_n == 0)
-		return 0;
+	size_t i;
+	for (i = 0; i < XDU_HL_SHARDS; i++)
+		pthread_mutex_init(&xdu_hardlinks[i].mutex, NULL);
+}
+
+/* Return a zeroed table of N slots taken from the arena */
+static struct hlink_t *
+alloc_hlink_slots(const size_t n)
+{
+	const size_t size = n * sizeof(struct hlink_t);
+
+	pthread_mutex_lock(&xdu_hl_arena_mutex);
+
+	struct hlink_block_t *b = xdu_hl_arena;
+	if (!b || b->size - b->used < size) {
+		const size_t bsize = size > XDU_HL_BLOCK_SIZE ? size : XDU_HL_BLOCK_SIZE;
+		b = (struct hlink_block_t *)xnmalloc(1,
+			sizeof(struct hlink_block_t) + bsize);
+		b->size = bsize;
+		b->used = 0;
+		/* Keep the block with more room left at the head of the list */
+		if (xdu_hl_arena && bsize - size
+		< xdu_hl_arena->size - xdu_hl_arena->used) {
+			b->next = xdu_hl_arena->next;
+			xdu_hl_arena->next = b;
+		} else {
+			b->next = xdu_hl_arena;
+			xdu_hl_arena = b;
+		}
+	}
+
+	struct hlink_t *slots = (struct hlink_t *)(void *)(b->data + b->used);
+	b->used += size;
+
+	pthread_mutex_unlock(&xdu_hl_arena_mutex);
+
+	memset(slots, 0, size);
+	return slots;
+}
+
+static inline size_t
+hlink_slot(const struct hlink_t *slots, const size_t mask, const uint64_t h,
+	const dev_t dev, const ino_t ino)
+{
+	size_t i = (size_t)(h ^ (h >> 32)) & mask;
+	while (slots[i].ino != 0 && (slots[i].ino != ino || slots[i].dev != dev))
+		i = (i + 1) & mask;
+
+	return i;
+}
+
+static inline uint64_t
+hlink_hash(const dev_t dev, const ino_t ino)
+{
+	return ((uint64_t)ino ^ ((uint64_t)dev << 32 | (uint64_t)dev))
+		* 0x9E3779B97F4A7C15ULL;
+}
+
+/* Double the size of the table of the shard S */
+static void
+grow_hlink_shard(struct hlink_shard_t *s)
+{
+	const size_t new_mask = s->slots ? s->mask * 2 + 1
+		: XDU_HL_INIT_SLOTS - 1;
+	struct hlink_t *slots = alloc_hlink_slots(new_mask + 1);
 
 	size_t i;
-	for (i = 0; i < xdu_hardlink_n; i++) {
-		if (dev == xdu_hardlinks[i].dev && ino == xdu_hardlinks[i].ino)
-			return 1;
+	for (i = 0; s->slots && i <= s->mask; i++) {
+		const struct hlink_t *l = &s->slots[i];
+		if (l->ino != 0)
+			slots[hlink_slot(slots, new_mask, hlink_hash(l->dev, l->ino),
+				l->dev, l->ino)] = *l;
 	}
 
-	return 0;
+	s->slots = slots;
+	s->mask = new_mask;
 }
 
-static inline void
-add_xdu_hardlink(const dev_t dev, const ino_t ino)
+/* Return 1 if the file identified by DEV and INO was already accounted for.
+ * Otherwise, register it and return 0. */
+static int
+xdu_hardlink_seen(const dev_t dev, const ino_t ino)
 {
-	xdu_hardlinks = (struct hlink_t *)xrealloc(xdu_hardlinks,
-		(xdu_hardlink_n + 1) * sizeof(struct hlink_t));
+	if (ino == 0) /* Not a valid inode number: we cannot track it */
+		return 0;
+
+	const uint64_t h = hlink_hash(dev, ino);
+	struct hlink_shard_t *s = &xdu_hardlinks[h >> (64 - XDU_HL_SHARDS_BITS)];
+
+	pthread_mutex_lock(&s->mutex);
+
+	/* Keep the load factor below 0.75 */
+	if (!s->slots || (s->n + 1) * 4 > (s->mask + 1) * 3)
+		grow_hlink_shard(s);
 
-	xdu_hardlinks[xdu_hardlink_n].dev = dev;
-	xdu_hardlinks[xdu_hardlink_n].ino = ino;
-	xdu_hardlink_n++;
+	const size_t i = hlink_slot(s->slots, s->mask, h, dev, ino);
+	const int found = s->slots[i].ino != 0;
+	if (found == 0) {
+		s->slots[i].dev = dev;
+		s->slots[i].ino = ino;
+		s->n++;
+	}
+
+	pthread_mutex_unlock(&s->mutex);
+	return found;
 }
 
-static inline void
+static void
 free_xdu_hardlinks(void)
 {
-	free(xdu_hardlinks);
-	xdu_hardlinks = (struct hlink_t *)NULL;
-	xdu_hardlink_n = 0;
+	size_t i;
+	for (i = 0; i < XDU_HL_SHARDS; i++) {
+		xdu_hardlinks[i].slots = (struct hlink_t *)NULL;
+		xdu_hardlinks[i].mask = xdu_hardlinks[i].n = 0;
+	}
+
+	while (xdu_hl_arena) {
+		struct hlink_block_t *next = xdu_hl_arena->next;
+		free(xdu_hl_arena);
+		xdu_hl_arena = next;
+	}
 }
 
+#ifdef XDU_SPEED_TEST
+/* Print the average time taken by xdu_hardlink_seen() for sets of
+ * increasing size: each file is checked twice (first as a new file, then
+ * as an already seen one). Run by the first dir_size() call. */
+static void
+xdu_hardlinks_speed_test(void)
+{
+	static const size_t sizes[] = {1000, 10000, 100000, 1000000, 4000000};
+	size_t i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		struct timespec start, end;
+		size_t j, seen = 0;
+		int pass;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (pass = 0; pass < 2; pass++) {
+			/* Odd multiplier: unique and scattered inode numbers */
+			for (j = 1; j <= sizes[i]; j++)
+				seen += (size_t)xdu_hardlink_seen((dev_t)1,
+					(ino_t)(j * 0x9E3779B1UL));
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		const double ns = (double)(end.tv_sec - start.tv_sec) * 1e9
+			+ (double)(end.tv_nsec - start.tv_nsec);
+
+		free_xdu_hardlinks();
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		const double free_ns = (double)(start.tv_sec - end.tv_sec) * 1e9
+			+ (double)(start.tv_nsec - end.tv_nsec);
+
+		fprintf(stderr, "xdu hard links: %zu links: %.1f ns per check "
+			"(%zu duplicates), free: %f\n", sizes[i],
+			ns / (double)(sizes[i] * 2), seen, free_ns / 1e9);
+	}
+}
+#endif /* XDU_SPEED_TEST */
+
 /* The st_size member of a stat struct is meaningful only:
  * 1. When computing disk usage (not apparent sizes).
  * 2. If apparent sizes, only for symlinks and regular files.
@@ -982,10 +1277,336 @@ usable_st_size(struct stat const *s)
 		|| S_ISREG(s->st_mode) || S_TYPEISSHM(s) || S_TYPEISTMO(s));
 }
 
-/* Read no more than this many directory entries at a time. Without this
- * limit, processing a directory with 4,000,000 entries requires ~1GiB of
- * memory, and handling 64M entries would require 16GiB of memory. */
-//#define MAX_READDIR_ENTRIES 100000
+/* Do not start worker threads until this many directories are waiting
+ * to be read: most directories are small, and the cost of starting threads
+ * would be higher than the time saved. */
+#define XDU_PARALLEL_MIN 32
+
+/* A directory to be read by dir_size() */
+struct xdu_task_t {
+	char *path;
+	struct stat attr;
+};
+
+struct xdu_job_t;
+
+/* Each worker owns a deque of tasks: it takes the newest task from its
+ * own deque (depth first, as a recursive traversal would do), while idle
+ * workers steal the oldest one (usually the largest pending subtree)
+ * from the other deques. */
+struct xdu_worker_t {
+	struct xdu_job_t *job;
+	pthread_mutex_t mutex; /* Protects the deque */
+	struct xdu_task_t *tasks;
+	size_t head;
+	size_t tail;
+	size_t cap;
+	/* Subdirectories found in the directory being read */
+	struct xdu_task_t *subdirs;
+	size_t subdirs_n;
+	size_t subdirs_cap;
+	off_t size;
+	int id;
+	int status;
+};
+
+struct xdu_job_t {
+	struct xdu_worker_t *workers;
+	pthread_mutex_t mutex; /* Protects the fields below */
+	pthread_cond_t cond;
+	size_t pending; /* Tasks either queued or being processed */
+	size_t queued;
+	int idle;
+	int workers_n; /* Set before starting any thread: never modified */
+	int started; /* Threads actually started (main thread only) */
+	int use_cache;
+	pthread_t tids[PF_MAX_THREADS];
+};
+
+/* Account for a file with more than one hard link, making sure it is
+ * counted only once */
+static inline off_t
+xdu_hardlink_size(const dev_t dev, const ino_t ino, const off_t size)
+{
+	return xdu_hardlink_seen(dev, ino) == 1 ? 0 : size;
+}
+
+/* Account for the subdirectory NAME, whose attributes are A, of the
+ * directory PARENT: the size of the directory itself is added now (if not
+ * computing apparent sizes), and its contents are queued to be read. */
+static void
+xdu_add_subdir(struct xdu_worker_t *w, const char *parent, const char *name,
+	const struct stat *a)
+{
+	/* Even if a subdirectory is unreadable or we can't chdir into
+	 * it, do let its size contribute to the total (provided we're
+	 * not computing apparent sizes). */
+	if (conf.apparent_size != 1)
+		w->size += (a->st_blocks * S_BLKSIZE);
+
+	if (user.uid != 0
+	&& check_file_access(a->st_mode, a->st_uid, a->st_gid) == 0) {
+		w->status = EACCES;
+		return;
+	}
+
+	if (w->subdirs_n == w->subdirs_cap) {
+		w->subdirs_cap = w->subdirs_cap > 0 ? w->subdirs_cap * 2 : 64;
+		w->subdirs = (struct xdu_task_t *)xrealloc(w->subdirs,
+			w->subdirs_cap * sizeof(struct xdu_task_t));
+	}
+
+	const size_t plen = strlen(parent);
+	const size_t nlen = strlen(name);
+	struct xdu_task_t *t = &w->subdirs[w->subdirs_n];
+	t->path = (char *)xnmalloc(plen + nlen + 2, sizeof(char));
+	memcpy(t->path, parent, plen);
+	t->path[plen] = '/';
+	memcpy(t->path + plen + 1, name, nlen + 1);
+	t->attr = *a;
+	w->subdirs_n++;
+}
+
+/* Compute the size of the directory T, whose file descriptor is FD, using
+ * the cache entry E (see dircache.c): only subdirectories need to be
+ * checked. */
+static void
+xdu_cached_dir(struct xdu_worker_t *w, const int fd,
+	const struct xdu_task_t *t, const struct dsc_entry_t *e)
+{
+	w->size += conf.apparent_size == 1 ? e->apparent : e->blocks;
+
+	size_t i;
+	for (i = 0; i < e->links_n; i++) {
+		const struct dsc_link_t *l = &e->links[i];
+		if (conf.apparent_size == 1 && l->usable == 0)
+			continue;
+
+		w->size += xdu_hardlink_size(l->dev, l->ino,
+			conf.apparent_size == 1 ? l->apparent : l->blocks);
+	}
+
+	const char *name = e->names;
+	for (i = 0; i < e->children_n; i++) {
+		struct stat a;
+		const int ret = fstatat(fd, name, &a, AT_SYMLINK_NOFOLLOW);
+
+		if (ret == -1)
+			w->status = errno;
+		/* Replacing a directory by something else changes the
+		 * modification time of the parent: it should not happen */
+		else if (S_ISDIR(a.st_mode))
+			xdu_add_subdir(w, t->path, name, &a);
+
+		name += strlen(name) + 1;
+	}
+}
+
+/* Add up the sizes of the files contained in the directory T (the size of
+ * the directory itself is not included), queueing its subdirectories.
+ * Returns -1 if the directory cannot be opened, or 0 otherwise. */
+static int
+xdu_read_dir(struct xdu_worker_t *w, const struct xdu_task_t *t)
+{
+	const int fd = open(t->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1) {
+		w->status = errno;
+		return (-1);
+	}
+
+	if (w->job->use_cache == 1) {
+		const struct dsc_entry_t *e = dsc_lookup(&t->attr);
+		if (e) {
+			xdu_cached_dir(w, fd, t, e);
+			close(fd);
+			return 0;
+		}
+	}
+
+	DIR *p;
+	if ((p = fdopendir(fd)) == NULL) {
+		w->status = errno;
+		close(fd);
+		return (-1);
+	}
+
+	struct dsc_scan_t scan = {0};
+	int scan_ok = 1;
+	struct stat a;
+	struct dirent *ent;
+
+	while ((ent = readdir(p)) != NULL) {
+		if (SELFORPARENT(ent->d_name))
+			continue;
+
+		if (fstatat(fd, ent->d_name, &a, AT_SYMLINK_NOFOLLOW) == -1) {
+			w->status = errno;
+			scan_ok = 0;
+			continue;
+		}
+
+		if (S_ISDIR(a.st_mode)) {
+			if (w->job->use_cache == 1)
+				dsc_scan_dir(&scan, ent->d_name);
+			xdu_add_subdir(w, t->path, ent->d_name, &a);
+			continue;
+		}
+
+		if (w->job->use_cache == 1)
+			dsc_scan_file(&scan, &a);
+
+		if (usable_st_size(&a) == 0)
+			continue;
+
+		const off_t s = conf.apparent_size == 1 ? a.st_size
+			: (a.st_blocks * S_BLKSIZE);
+		w->size += a.st_nlink > 1 ? xdu_hardlink_size(a.st_dev, a.st_ino, s) : s;
+	}
+
+	closedir(p);
+
+	if (w->job->use_cache == 1) {
+		/* Do not cache partial results */
+		if (scan_ok == 1)
+			dsc_store(&t->attr, &scan);
+		else
+			dsc_free_scan(&scan);
+	}
+
+	return 0;
+}
+
+/* Move the subdirectories found by the worker W into its deque, and mark
+ * the current task as done. Returns the amount of queued tasks. */
+static size_t
+xdu_finish_task(struct xdu_worker_t *w)
+{
+	struct xdu_job_t *job = w->job;
+	const size_t n = w->subdirs_n;
+
+	if (n > 0) {
+		pthread_mutex_lock(&w->mutex);
+		if (w->tail + n > w->cap) {
+			w->cap = (w->tail + n) * 2;
+			w->tasks = (struct xdu_task_t *)xrealloc(w->tasks,
+				w->cap * sizeof(struct xdu_task_t));
+		}
+		memcpy(w->tasks + w->tail, w->subdirs, n * sizeof(struct xdu_task_t));
+		w->tail += n;
+		pthread_mutex_unlock(&w->mutex);
+		w->subdirs_n = 0;
+	}
+
+	pthread_mutex_lock(&job->mutex);
+	job->pending += n;
+	job->pending--;
+	job->queued += n;
+	if (job->pending == 0 || (n > 1 && job->idle > 1))
+		pthread_cond_broadcast(&job->cond);
+	else if (n > 0 && job->idle > 0)
+		pthread_cond_signal(&job->cond);
+	const size_t queued = job->queued;
+	pthread_mutex_unlock(&job->mutex);
+
+	return queued;
+}
+
+/* Take the next task for the worker W, either from its own deque or from
+ * some other worker. Returns 0 if there is nothing else to do. */
+static int
+xdu_get_task(struct xdu_worker_t *w, struct xdu_task_t *t)
+{
+	struct xdu_job_t *job = w->job;
+
+	while (1) {
+		int i;
+		for (i = 0; i < job->workers_n; i++) {
+			struct xdu_worker_t *v = &job->workers[(w->id + i) % job->workers_n];
+			pthread_mutex_lock(&v->mutex);
+			if (v->head == v->tail) {
+				pthread_mutex_unlock(&v->mutex);
+				continue;
+			}
+
+			*t = i == 0 ? v->tasks[--v->tail] : v->tasks[v->head++];
+			if (v->head == v->tail)
+				v->head = v->tail = 0;
+			pthread_mutex_unlock(&v->mutex);
+
+			pthread_mutex_lock(&job->mutex);
+			job->queued--;
+			pthread_mutex_unlock(&job->mutex);
+			return 1;
+		}
+
+		pthread_mutex_lock(&job->mutex);
+		if (job->pending == 0) {
+			pthread_mutex_unlock(&job->mutex);
+			return 0;
+		}
+
+		if (job->queued == 0) {
+			job->idle++;
+			pthread_cond_wait(&job->cond, &job->mutex);
+			job->idle--;
+		}
+		pthread_mutex_unlock(&job->mutex);
+	}
+}
+
+static void *
+xdu_worker(void *arg)
+{
+	struct xdu_worker_t *w = (struct xdu_worker_t *)arg;
+	struct xdu_task_t t;
+
+	while (xdu_get_task(w, &t) == 1) {
+		xdu_read_dir(w, &t);
+		free(t.path);
+		xdu_finish_task(w);
+	}
+
+	return NULL;
+}
+
+/* Run the first worker in the calling thread. Once there are enough
+ * directories waiting to be read, start the remaining workers.
+ * Returns -1 if the base directory cannot be opened, or 0 otherwise. */
+static int
+xdu_run_job(struct xdu_job_t *job)
+{
+	struct xdu_worker_t *w = &job->workers[0];
+	struct xdu_task_t t;
+	int ret = 0, first = 1, spawn_done = 0;
+
+	while (xdu_get_task(w, &t) == 1) {
+		const int r = xdu_read_dir(w, &t);
+		if (first == 1) {
+			ret = r;
+			first = 0;
+		}
+		free(t.path);
+
+		if (xdu_finish_task(w) < XDU_PARALLEL_MIN || spawn_done == 1)
+			continue;
+
+		/* Run with what we have if a thread cannot be started: the
+		 * deques of workers not started will remain empty. job->workers_n
+		 * is read by running workers without locking: never modify it. */
+		while (job->started < job->workers_n - 1
+		&& pthread_create(&job->tids[job->started], NULL, xdu_worker,
+		&job->workers[job->started + 1]) == 0)
+			job->started++;
+
+		spawn_done = 1; /* Do not try again */
+	}
+
+	int i;
+	for (i = 0; i < job->started; i++)
+		pthread_join(job->tids[i], NULL);
+
+	return ret;
+}
 
 /* Hand-made implementation of du(1) providing only those features required
  * by clifm.
@@ -997,8 +1618,13 @@ usable_st_size(struct stat const *s)
  * a positive integer representing the size of the entries that have been
  * actually processed.
  *
- * FIRST_LEVEL must be always 1 when calling this function (this value will
- * be zero whenever the function calls itself recursively).
+ * If FIRST_LEVEL is 1, hard links are forgotten once done. Otherwise, files
+ * with several hard links already accounted for by a previous call are not
+ * counted again.
+ *
+ * The tree is traversed by up to ListingThreads workers (see xdu_run_job()),
+ * and, if DirSizeCache is enabled, sizes of unchanged directories are taken
+ * from the directory size cache (see dircache.c).
  *
  * NOTE: Old versions of du (at least up to 8.30) count the size of directories
  * themselves when computing apparent sizes. At least since 9.3, this is not
@@ -1016,74 +1642,80 @@ dir_size(char *dir, const int first_level, int *status)
 	}
 
 	struct stat a;
-//	const dev_t base_dev = lstat(dir, &a) != -1 ? a.st_dev : 0;
-	off_t size = 0;
-	DIR *p;
-
-	if ((p = opendir(dir)) == NULL) {
+	if (stat(dir, &a) == -1) {
 		*status = errno;
 		return 0;
 	}
 
-	/* Compute the size of the base directory itself */
-	if (conf.apparent_size != 1 && first_level == 1
-	&& stat(dir, &a) != -1)
-		size += (a.st_blocks * S_BLKSIZE);
-
-	struct dirent *ent;
-
-	while ((ent = readdir(p)) != NULL) {
-		if (SELFORPARENT(ent->d_name))
-			continue;
-
-		char buf[PATH_MAX + 1];
-		snprintf(buf, sizeof(buf), "%s/%s", dir, ent->d_name);
-
-		if (lstat(buf, &a) == -1) {
-			*status = errno;
-			continue;
-		}
-
-/*		if (base_dev > 0 && base_dev != a.st_dev) {
-			*status = EXDEV; // File is on a different file system.
-			continue;
-		} */
+	pthread_once(&xdu_hardlinks_once, init_xdu_hardlinks);
 
-		if (S_ISDIR(a.st_mode)) {
-			/* Even if a subdirectory is unreadable or we can't chdir into
-			 * it, do let its size contribute to the total (provided we're
-			 * not computing apparent sizes). */
-			if (conf.apparent_size != 1)
-				size += (a.st_blocks * S_BLKSIZE);
-
-			if (user.uid != 0
-			&& check_file_access(a.st_mode, a.st_uid, a.st_gid) == 0)
-				*status = EACCES;
-			else
-				size += dir_size(buf, 0, status);
+#ifdef XDU_SPEED_TEST
+	static int hl_speed_test = 0;
+	if (hl_speed_test == 0) {
+		hl_speed_test = 1;
+		xdu_hardlinks_speed_test();
+	}
 
-			continue;
-		}
+	struct timespec xdu_start;
+	clock_gettime(CLOCK_MONOTONIC, &xdu_start);
+#endif /* XDU_SPEED_TEST */
+
+	struct xdu_job_t job = {0};
+	job.workers_n = get_listing_threads();
+	job.use_cache = conf.dir_size_cache == 1;
+	job.workers = (struct xdu_worker_t *)xcalloc((size_t)job.workers_n,
+		sizeof(struct xdu_worker_t));
+	pthread_mutex_init(&job.mutex, NULL);
+	pthread_cond_init(&job.cond, NULL);
+
+	int i;
+	for (i = 0; i < job.workers_n; i++) {
+		job.workers[i].job = &job;
+		job.workers[i].id = i;
+		pthread_mutex_init(&job.workers[i].mutex, NULL);
+	}
 
-		if (usable_st_size(&a) == 0)
-			continue;
+	/* The base directory is the first task */
+	struct xdu_worker_t *w = &job.workers[0];
+	w->tasks = (struct xdu_task_t *)xnmalloc(1, sizeof(struct xdu_task_t));
+	w->cap = w->tail = 1;
+	w->tasks[0].path = savestring(dir, strlen(dir));
+	w->tasks[0].attr = a;
+	job.pending = job.queued = 1;
 
-		if (a.st_nlink > 1) {
-			if (check_xdu_hardlinks(a.st_dev, a.st_ino) == 1)
-				continue;
-			else
-				add_xdu_hardlink(a.st_dev, a.st_ino);
-		}
+	const int ret = xdu_run_job(&job);
+	/* Workers are done with the cache entries they looked up */
+	if (job.use_cache == 1)
+		dsc_free_retired();
 
-		size += conf.apparent_size == 1 ? a.st_size
-			: (a.st_blocks * S_BLKSIZE);
+	/* Compute the size of the base directory itself */
+	off_t size = (conf.apparent_size != 1 && first_level == 1 && ret == 0)
+		? (a.st_blocks * S_BLKSIZE) : 0;
+
+	for (i = 0; i < job.workers_n; i++) {
+		size += job.workers[i].size;
+		if (job.workers[i].status != 0)
+			*status = job.workers[i].status;
+		free(job.workers[i].tasks);
+		free(job.workers[i].subdirs);
+		pthread_mutex_destroy(&job.workers[i].mutex);
 	}
 
-	closedir(p);
+	free(job.workers);
+	pthread_mutex_destroy(&job.mutex);
+	pthread_cond_destroy(&job.cond);
 
 	if (first_level == 1)
 		free_xdu_hardlinks();
 
+#ifdef XDU_SPEED_TEST
+	struct timespec xdu_end;
+	clock_gettime(CLOCK_MONOTONIC, &xdu_end);
+	fprintf(stderr, "dir_size time: %f (%s)\n",
+		(double)(xdu_end.tv_sec - xdu_start.tv_sec)
+		+ (double)(xdu_end.tv_nsec - xdu_start.tv_nsec) / 1e9, dir);
+#endif /* XDU_SPEED_TEST */
+
 	return size;
 }
 #else
@@ -36,6 +36,29 @@
 /* Max size type length for the value returned by get_size_type() */
 #define MAX_UNIT_SIZE 10 /* "1023.99YB\0" */
 
+#if defined(LINUX_GETDENTS)
+# include <stdint.h>
+/* A directory entry, as returned by getdents64(2) */
+struct dirent64_t {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+typedef struct dirent64_t xdirent_t;
+#else
+typedef struct dirent xdirent_t;
+#endif /* LINUX_GETDENTS */
+
+/* A directory stream read via read_dirbuf() */
+struct dirbuf_t {
+	DIR *dir;
+	char *buf;  /* getdents64(2) buffer (Linux only) */
+	size_t len; /* Amount of valid bytes in BUF */
+	size_t pos; /* Offset of the next entry in BUF */
+};
+
 __BEGIN_DECLS
 
 char *abbreviate_file_name(char *);
@@ -44,6 +67,7 @@ char *get_cwd(char *, const size_t, const int);
 filesn_t count_dir(const char *, const int);
 off_t dir_size(char *, const int, int *);
 char from_hex(char);
+void free_dirbuf(struct dirbuf_t *);
 char *gen_date_suffix(const struct tm);
 void gen_time_str(char *, const size_t, const time_t);
 char *get_cmd_path(const char *);
@@ -52,9 +76,11 @@ void clear_term_img(void);
 mode_t get_dt(const mode_t);
 int  get_link_ref(const char *);
 char *hex2rgb(char *);
+void init_dirbuf(struct dirbuf_t *, DIR *);
 char *normalize_path(char *, const size_t);
 FILE *open_fread(char *, int *);
 FILE *open_fwrite(char *, int *);
+xdirent_t *read_dirbuf(struct dirbuf_t *);
 int  read_octal(char *);
 void rl_ring_bell(void);
 void set_fzf_preview_border_type(void);
@@ -68,10 +94,6 @@ char xgetchar(void);
 int  xmkdir(char *, const mode_t);
 void xregerror(const char *, const char *, const int, const regex_t, const int);
 
-#ifndef _NO_ICONS
-size_t hashme(const char *, const int);
-#endif /* !_NO_ICONS */
-
 /* Some memory wrapper functions */
 void *xrealloc(void *, const size_t);
 void *xcalloc(const size_t, const size_t);
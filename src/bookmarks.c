@@ -35,6 +35,7 @@
 #include "checks.h" /* is_number() */
 #include "exec.h" /* launch_execv() */
 #include "file_operations.h" /* open_function() */
+#include "frame.h" /* frame_invalidate() (CLEAR) */
 #include "init.h" /* load_bookmarks() */
 #include "readline.h" /* rl_no_hist() */
 #include "messages.h" /* STEALTH_DISABLED */
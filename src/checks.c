@@ -38,6 +38,7 @@
 #endif /* HAVE_FILE_ATTRS */
 
 #include "aux.h"
+#include "init.h" /* get_bin_cmds_range() */
 #include "misc.h"
 #include "term_info.h"
 
@@ -781,20 +782,16 @@ is_bin_cmd(char *str)
 		index++;
 	}
 
-	size_t i;
-	for (i = 0; bin_commands[i]; i++) {
-		if (*q == *bin_commands[i] && q[1] == bin_commands[i][1]
-		&& strcmp(q, bin_commands[i]) == 0) {
-			if (space_index != -1)
-				q[space_index] = ' ';
-			return 1;
-		}
-	}
+	/* The shortest match sorts first */
+	size_t start = 0;
+	const size_t len = strlen(q);
+	const int found = (get_bin_cmds_range(q, len, &start) > 0
+		&& !bin_commands[bin_commands_idx[start]][len]);
 
 	if (space_index != -1)
 		q[space_index] = ' ';
 
-	return 0;
+	return found;
 }
 
 int
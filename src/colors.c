@@ -42,6 +42,10 @@
 # include <readline/readline.h>
 #endif /* __OpenBSD__ */
 
+#if defined(EXT_COLORS_SPEED_TEST)
+# include <time.h>
+#endif /* EXT_COLORS_SPEED_TEST */
+
 #include "aux.h"
 #include "checks.h"
 #include "colors.h"
@@ -50,6 +54,7 @@
 #include "messages.h"
 #include "file_operations.h"
 #include "exec.h"
+#include "frame.h"
 #include "config.h" /* set_div_line() */
 #include "sanitize.h"
 
@@ -701,112 +706,188 @@ END:
 }
 #endif /* !CLIFM_SUCKLESS */
 
-/* Look for the hash HASH in the hash table.
- * Return a pointer to the corresponding color if found or NULL.
- *
- * NOTE: We check all available hashes to avoid conflicts.
- * The hash table is built on user supplied data (color scheme file)
- * so that we cannot assume in advance that there will be no conflicts.
- * However, at least with the color schemes provided by default, we do know
- * there are no conflicts. In this latter case we can return the first matching
- * entry, which is a performace improvement. But we cannot assume the user
- * is using one of the provided themes and that it hasn't been modified. */
-/*
-static char *
-check_ext_hash(const size_t hash, size_t *count)
+/* Open addressing (linear probing) hash table for extension colors,
+ * built by build_ext_table() whenever extension colors are loaded. Slots
+ * hold indices into the ext_colors array plus one (zero means empty).
+ * The table is at most half full, so that probe sequences stay short. */
+static size_t *ext_table = (size_t *)NULL;
+static size_t ext_table_mask = 0;
+
+/* Return the hash of the string EXT (lowercased if LOWER is set to 1),
+ * storing its length in LEN (FNV-1a) */
+static inline size_t
+ext_hash(const char *ext, size_t *len, const int lower)
 {
-	char *p = (char *)NULL;
-	size_t i;
-	for (i = 0; i < ext_colors_n; i++) {
-		if (!ext_colors[i].name || !ext_colors[i].value
-		|| hash != ext_colors[i].hash)
-			continue;
+	size_t hash = (size_t)2166136261U;
+	const char *p = ext;
 
-//		(*count)++;
-//		return ext_colors[i].value; // No conflicts check: faster, but might fail
-
-		p = ext_colors[i].value;
-		(*count)++;
+	while (*p) {
+		const unsigned char c = (unsigned char)(lower == 1
+			? TOLOWER(*p) : *p);
+		hash = (hash ^ c) * (size_t)16777619U;
+		p++;
 	}
 
-	return p;
-} */
+	*len = (size_t)(p - ext);
+	return hash;
+}
 
+static void
+free_ext_table(void)
+{
+	free(ext_table);
+	ext_table = (size_t *)NULL;
+	ext_table_mask = 0;
+}
 
-/* Return the color code associated to the file extension EXT, updating
- * VAL_LEN, if not NULL, to the length of this color code. */
-static char *
-check_ext_string(const char *ext, size_t *val_len)
+/* Index all entries in the ext_colors array. In case of duplicates, the
+ * last one wins */
+static void
+build_ext_table(void)
 {
-	/* Hold extension names. NAME_MAX should be enough: no file name should
-	 * go beyond NAME_MAX, so it's pretty safe to assume that no file extension
-	 * will be larger. */
-	static char tmp_ext[NAME_MAX];
-	char *ptr = tmp_ext;
-
-	int i;
-	for (i = 0; ext[i] && i < NAME_MAX; i++) {
-		if (ext[i] >= 'A' && ext[i] <= 'Z')
-			tmp_ext[i] = ext[i] + ' '; /* Tolower */
-		else
-			tmp_ext[i] = ext[i];
-	}
-	tmp_ext[i] = '\0';
+	free_ext_table();
 
-	size_t len = (size_t)i;
+	if (ext_colors_n == 0)
+		return;
 
-	i = (int)ext_colors_n;
-	while (--i >= 0) {
-		if (!ext_colors[i].name || !*ext_colors[i].name
-		|| ext_colors[i].len != len || *ptr != *ext_colors[i].name)
+	size_t size = 16;
+	while (size < ext_colors_n * 2)
+		size <<= 1;
+
+	ext_table = xcalloc(size, sizeof(size_t));
+	ext_table_mask = size - 1;
+
+	size_t i;
+	for (i = 0; i < ext_colors_n; i++) {
+		struct ext_t *e = &ext_colors[i];
+		if (!e->name || !*e->name)
 			continue;
 
-		char *p = ptr + 1, *q = ext_colors[i].name + 1;
+		size_t len = 0;
+		e->hash = ext_hash(e->name, &len, 0);
 
-		size_t match = 1;
-		while (*p) {
-			if (*p != *q) {
-				match = 0;
+		size_t slot = e->hash & ext_table_mask;
+		while (ext_table[slot] != 0) {
+			const struct ext_t *f = &ext_colors[ext_table[slot] - 1];
+			if (f->hash == e->hash && strcmp(f->name, e->name) == 0)
 				break;
-			}
-			p++;
-			q++;
+			slot = (slot + 1) & ext_table_mask;
 		}
 
-		if (match == 0 || *q != '\0')
-			continue;
-
-		if (val_len)
-			*val_len = ext_colors[i].value_len;
-
-		return ext_colors[i].value;
+		ext_table[slot] = i + 1;
 	}
-
-	return (char *)NULL;
 }
 
 /* Returns a pointer to the corresponding color code for the file
  * extension EXT (updating VAL_LEN to the length of this code).
- * The hash table is checked first, and, in case of a conflict, a regular
- * string comparison is performed to resolve it. */
+ * The extension is matched case insensitively against extension names
+ * (which are expected to be in lowercase). */
 char *
 get_ext_color(const char *ext, size_t *val_len)
 {
-	if (!ext || !*ext || !*(++ext) || ext_colors_n == 0)
+	if (!ext || !*ext || !*(++ext) || !ext_table)
 		return (char *)NULL;
 
-/*	size_t count = 0;
-	char *ret = check_ext_hash(hashme(ext, 0), &count);
-	if (count == 0)
-		return (char *)NULL;
+	size_t len = 0;
+	const size_t hash = ext_hash(ext, &len, 1);
+	size_t slot = hash & ext_table_mask;
+
+	while (ext_table[slot] != 0) {
+		const struct ext_t *e = &ext_colors[ext_table[slot] - 1];
+
+		if (e->hash == hash && e->len == len) {
+			size_t i = 0;
+			while (i < len && (char)TOLOWER(ext[i]) == e->name[i])
+				i++;
+			if (i == len) {
+				if (val_len)
+					*val_len = e->value_len;
+				return e->value;
+			}
+		}
+
+		slot = (slot + 1) & ext_table_mask;
+	}
+
+	return (char *)NULL;
+}
+
+#ifdef EXT_COLORS_SPEED_TEST
+/* Reference implementation: lowercase EXT and scan the whole ext_colors
+ * array, as get_ext_color() did before the hash table */
+static char *
+get_ext_color_linear(const char *ext)
+{
+	char buf[NAME_MAX + 1];
+	size_t len = 0;
+
+	for (ext++; ext[len] && len < NAME_MAX; len++)
+		buf[len] = (char)TOLOWER(ext[len]);
+	buf[len] = '\0';
+
+	size_t i = ext_colors_n;
+	while (i-- > 0) {
+		if (ext_colors[i].name && ext_colors[i].len == len
+		&& strcmp(ext_colors[i].name, buf) == 0)
+			return ext_colors[i].value;
+	}
+
+	return (char *)NULL;
+}
+
+/* Print the average time taken by get_ext_color() (and by a linear scan,
+ * for comparison) for a mix of hits, uppercase hits, and misses over the
+ * extension colors just loaded */
+static void
+ext_colors_speed_test(void)
+{
+	if (ext_colors_n == 0)
+		return;
+
+	const size_t n = ext_colors_n * 3;
+	char **exts = (char **)xnmalloc(n, sizeof(char *));
+	size_t i, j;
+
+	for (i = 0; i < ext_colors_n; i++) {
+		const char *name = ext_colors[i].name ? ext_colors[i].name : "";
+		const size_t len = strlen(name) + 8;
+		for (j = 0; j < 3; j++)
+			exts[i * 3 + j] = (char *)xnmalloc(len, sizeof(char));
+
+		snprintf(exts[i * 3], len, ".%s", name);
+		snprintf(exts[i * 3 + 1], len, ".%s", name);
+		for (j = 1; exts[i * 3 + 1][j]; j++)
+			exts[i * 3 + 1][j] = (char)TOUPPER(exts[i * 3 + 1][j]);
+		snprintf(exts[i * 3 + 2], len, ".%sqz%zu", name, i % 10);
+	}
+
+	const size_t lookups = 1000000;
+	size_t hits[2] = {0, 0};
+	double ns[2];
+	int k;
+
+	for (k = 0; k < 2; k++) {
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < lookups; i++) {
+			const char *e = exts[i % n];
+			if ((k == 0 ? get_ext_color(e, NULL) : get_ext_color_linear(e)))
+				hits[k]++;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ns[k] = ((double)(end.tv_sec - start.tv_sec) * 1e9
+			+ (double)(end.tv_nsec - start.tv_nsec)) / (double)lookups;
+	}
 
-	if (ret && count == 1)
-		return ret; */
+	fprintf(stderr, "ext colors: %zu extensions: hash table: %.1f ns, "
+		"linear scan: %.1f ns per lookup (%zu/%zu hits)\n", ext_colors_n,
+		ns[0], ns[1], hits[0], hits[1]);
 
-	/* We have a conflict: a single hash is used for two or more extensions.
-	 * Let's try to match the extension name itself. */
-	return check_ext_string(ext, val_len);
+	for (i = 0; i < n; i++)
+		free(exts[i]);
+	free(exts);
 }
+#endif /* EXT_COLORS_SPEED_TEST */
 
 #ifndef CLIFM_SUCKLESS
 /* Strip color lines from the config file (FiletypeColors, if mode is
@@ -1562,7 +1643,7 @@ store_extension_line(const char *line)
 	ext_colors[ext_colors_n].value = (char *)xnmalloc(elen, sizeof(char));
 	snprintf(ext_colors[ext_colors_n].value, elen, "0;%s", code);
 	ext_colors[ext_colors_n].value_len = elen - 1;
-//	ext_color[ext_colors_n].hash = hashme(line, 0);
+	ext_colors[ext_colors_n].hash = 0;
 
 	if (xargs.no_bold == 1)
 		remove_bold_attr(ext_colors[ext_colors_n].value);
@@ -1573,9 +1654,11 @@ store_extension_line(const char *line)
 	return EXIT_SUCCESS;
 }
 
-static void
+void
 free_extension_colors(void)
 {
+	free_ext_table();
+
 	int i = (int)ext_colors_n;
 	while (--i >= 0) {
 		free(ext_colors[i].name);
@@ -1637,7 +1720,14 @@ split_extension_colors(char *extcolors)
 		ext_colors[ext_colors_n].value = (char *)NULL;
 		ext_colors[ext_colors_n].len = 0;
 		ext_colors[ext_colors_n].value_len = 0;
+		ext_colors[ext_colors_n].hash = 0;
 	}
+
+	build_ext_table();
+
+#ifdef EXT_COLORS_SPEED_TEST
+	ext_colors_speed_test();
+#endif /* EXT_COLORS_SPEED_TEST */
 }
 
 static void
@@ -2508,6 +2598,9 @@ set_colors(const char *colorscheme, const int check_env)
 	date_shades.type = SHADE_TYPE_UNSET;
 	size_shades.type = SHADE_TYPE_UNSET;
 
+	/* Cached files lists hold colors of the previous color scheme */
+	purge_listing_cache();
+
 #ifndef _NO_ICONS
 	*dir_ico_c = '\0';
 #endif /* !_NO_ICONS */
@@ -2699,7 +2792,7 @@ colors_list(char *ent, const int eln, const int pad, const int new_line)
 	char *name = wname ? wname : ent;
 	char *tmp = (flags & IN_SELBOX_SCREEN) ? abbreviate_file_name(name) : name;
 
-	printf("%s%s%s%s%s%s%s%-*s", eln_color, index, df_c, color,
+	frame_printf("%s%s%s%s%s%s%s%-*s", eln_color, index, df_c, color,
 		tmp + tab_offset, df_c, new_line ? "\n" : "", pad, "");
 	free(wname);
 
@@ -33,6 +33,7 @@ int  cschemes_function(char **);
 #ifndef CLIFM_SUCKLESS
 size_t get_colorschemes(void);
 #endif /* CLIFM_SUCKLESS */
+void free_extension_colors(void);
 char *get_dir_color(const char *, const mode_t, const nlink_t, const filesn_t);
 char *get_ext_color(const char *, size_t *);
 char *get_file_color(const char *, const struct stat *);
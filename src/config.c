@@ -44,6 +44,7 @@
 #include "navigation.h"
 #include "file_operations.h"
 #include "autocmds.h"
+#include "startup.h" /* defer_startup_task() */
 
 /* Only for old log file split. Remove when needed */
 #ifndef _NO_SPLIT_LOG
@@ -278,6 +279,10 @@ dump_config(void)
 	n = DEF_DIRHIST_MAP;
 	print_config_value("DirhistMap", &conf.dirhist_map, &n, DUMP_CONFIG_BOOL);
 
+	n = DEF_DIR_SIZE_CACHE;
+	print_config_value("DirSizeCache", &conf.dir_size_cache, &n,
+		DUMP_CONFIG_BOOL);
+
 	n = DEF_DISK_USAGE;
 	print_config_value("DiskUsage", &conf.disk_usage, &n, DUMP_CONFIG_BOOL);
 
@@ -289,6 +294,10 @@ dump_config(void)
 	print_config_value("FilesCounter", &conf.files_counter, &n,
 		DUMP_CONFIG_BOOL);
 
+	n = DEF_FILES_COUNTER_TIMEOUT;
+	print_config_value("FilesCounterTimeout", &conf.files_counter_timeout,
+		&n, DUMP_CONFIG_INT);
+
 	s = "";
 	print_config_value("Filter", filter.str, s, DUMP_CONFIG_STR);
 
@@ -317,6 +326,10 @@ dump_config(void)
 	print_config_value("Icons", &conf.icons, &n, DUMP_CONFIG_BOOL);
 #endif /* !_NO_ICONS */
 
+	n = DEF_LAZY_STAT_TIMEOUT;
+	print_config_value("LazyStatTimeout", &conf.lazy_stat_timeout, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_LIGHT_MODE;
 	print_config_value("LightMode", &conf.light_mode, &n, DUMP_CONFIG_BOOL);
 
@@ -324,9 +337,21 @@ dump_config(void)
 	print_config_value("ListDirsFirst", &conf.list_dirs_first, &n,
 		DUMP_CONFIG_BOOL);
 
+	n = DEF_LISTING_CACHE;
+	print_config_value("ListingCache", &conf.listing_cache, &n,
+		DUMP_CONFIG_INT);
+
+	n = DEF_LISTING_CACHE_SIZE;
+	print_config_value("ListingCacheSize", &conf.listing_cache_size, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_LISTING_MODE;
 	print_config_value("ListingMode", &conf.listing_mode, &n, DUMP_CONFIG_INT);
 
+	n = DEF_LISTING_THREADS;
+	print_config_value("ListingThreads", &conf.listing_threads, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_LOG_CMDS;
 	print_config_value("LogCmds", &conf.log_cmds, &n, DUMP_CONFIG_BOOL);
 
@@ -360,6 +385,10 @@ dump_config(void)
 	print_config_value("MaxPrintSelfiles", &conf.max_printselfiles, &n,
 		DUMP_CONFIG_INT);
 
+	n = DEF_MAX_REFRESH_LATENCY;
+	print_config_value("MaxRefreshLatency", &conf.max_refresh_latency, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_MIN_NAME_TRIM;
 	print_config_value("MinFilenameTrim", &conf.min_name_trim, &n,
 		DUMP_CONFIG_INT);
@@ -367,6 +396,10 @@ dump_config(void)
 	n = DEF_MIN_JUMP_RANK;
 	print_config_value("MinJumpRank", &conf.min_jump_rank, &n, DUMP_CONFIG_INT);
 
+	n = DEF_MIN_REFRESH_INTERVAL;
+	print_config_value("MinRefreshInterval", &conf.min_refresh_interval, &n,
+		DUMP_CONFIG_INT);
+
 	n = DEF_MV_CMD;
 	print_config_value("mvCmd", &conf.mv_cmd, &n, DUMP_CONFIG_INT);
 
@@ -377,6 +410,10 @@ dump_config(void)
 	print_config_value("Pager", &conf.pager, &n, conf.pager > 1
 		? DUMP_CONFIG_INT : DUMP_CONFIG_BOOL);
 
+	n = DEF_PAGER_WINDOW;
+	print_config_value("PagerWindow", &conf.pager_window, &n,
+		DUMP_CONFIG_BOOL);
+
 	n = DEF_PRINTSEL;
 	print_config_value("PrintSelfiles", &conf.print_selfiles, &n,
 		DUMP_CONFIG_BOOL);
@@ -446,6 +483,10 @@ dump_config(void)
 	print_config_value("SuggestionStrategy", conf.suggestion_strategy,
 		s, DUMP_CONFIG_STR);
 #endif /* !_NO_SUGGESTIONS */
+	n = DEF_SYNC_UPDATES;
+	print_config_value("SyncUpdates", &conf.sync_updates, &n,
+		DUMP_CONFIG_BOOL);
+
 #ifndef _NO_HIGHLIGHT
 	n = DEF_HIGHLIGHT;
 	print_config_value("SyntaxHighlighting", &conf.highlight, &n,
@@ -1527,12 +1568,49 @@ create_main_config_file(char *file)
 # command while in the program itself.\n\
 ;FilesCounter=%s\n\n"
 
+		"# Milliseconds to wait for the files counter in each directory before\n\
+# listing files.\n\
+# Directories taking longer than this (say, a stale network mount point)\n\
+# are marked with '?', and counted in the background. The files list is\n\
+# refreshed once counts are available. 0 = always wait.\n\
+;FilesCounterTimeout=%d\n\n"
+
 		"# How to list files: 0 = vertically (like ls(1) would), 1 = horizontally\n\
 ;ListingMode=%d\n\n"
 
+		"# Amount of threads used to gather information about listed files\n\
+# (only for large directories). Mostly useful for network file systems.\n\
+# Also used to compute full directory sizes (if compiled with USE_XDU).\n\
+# 0 = auto (as many as online CPUs), 1 = disable threads.\n\
+;ListingThreads=%d\n\n"
+
+		"# Milliseconds to wait for files information (stat data) before listing\n\
+# files. If not available in time (say, on a slow network mount point),\n\
+# files are listed using only their names and types, and the files list\n\
+# is refreshed once the information is available. Not used in long view\n\
+# nor when sorting by size, time, owner, or group. 0 = always wait.\n\
+;LazyStatTimeout=%d\n\n"
+
+		"# Amount of recently visited directories whose files list is kept in\n\
+# memory, so that going back to them does not read them again. Lists are\n\
+# read again if the directory changed, and files changed in place are\n\
+# checked and read again one by one. 0 = disabled.\n\
+# ListingCacheSize is the max memory (MiB) taken by lists (0 = no limit).\n\
+;ListingCache=%d\n\
+;ListingCacheSize=%d\n\n"
+
 		"# List files automatically after changing current directory\n\
 ;AutoLs=%s\n\n"
 
+		"# When files in the current directory change (say, while extracting an\n\
+# archive), the files list is refreshed automatically, even while waiting\n\
+# for input. Changes are coalesced: the list is refreshed once no change\n\
+# arrived for MinRefreshInterval milliseconds (and never more often than\n\
+# that), but no later than MaxRefreshLatency milliseconds after the first\n\
+# pending change. MinRefreshInterval=0 refreshes immediately.\n\
+;MinRefreshInterval=%d\n\
+;MaxRefreshLatency=%d\n\n"
+
 		"# Send errors, warnings, and notices to the notification daemon?\n\
 ;DesktopNotifications=%s\n\n"
 
@@ -1567,8 +1645,15 @@ create_main_config_file(char *file)
 	    COLORS_REPO,
 		DEF_COLOR_SCHEME,
 		DEF_FILES_COUNTER == 1 ? "true" : "false",
+		DEF_FILES_COUNTER_TIMEOUT,
 		DEF_LISTING_MODE,
+		DEF_LISTING_THREADS,
+		DEF_LAZY_STAT_TIMEOUT,
+		DEF_LISTING_CACHE,
+		DEF_LISTING_CACHE_SIZE,
 		DEF_AUTOLS == 1 ? "true" : "false",
+		DEF_MIN_REFRESH_INTERVAL,
+		DEF_MAX_REFRESH_LATENCY,
 		DEF_DESKTOP_NOTIFICATIONS == 1 ? "true" : "false",
 		DEF_DIRHIST_MAP == 1 ? "true" : "false",
 		DEF_CP_CMD,
@@ -1621,7 +1706,9 @@ create_main_config_file(char *file)
 # Print files apparent size instead of actual device usage (Linux only)\n\
 ;ApparentSize=%s\n\
 # If running in long view, print directories full size (including contents)\n\
-;FullDirSize=%s\n\n\
+;FullDirSize=%s\n\
+# Cache directory sizes computed for FullDirSize and the 'p' command\n\
+;DirSizeCache=%s\n\n\
 # Log errors and warnings\n\
 ;LogMsgs=%s\n\
 # Log commands entered in the command line\n\
@@ -1667,6 +1754,7 @@ create_main_config_file(char *file)
 		DEF_PROP_FIELDS,
 		DEF_APPARENT_SIZE == 1 ? "true" : "false",
 		DEF_FULL_DIR_SIZE == 1 ? "true" : "false",
+		DEF_DIR_SIZE_CACHE == 1 ? "true" : "false",
 		DEF_LOG_MSGS == 1 ? "true" : "false",
 		DEF_LOG_CMDS == 1 ? "true" : "false",
 		DEF_MIN_NAME_TRIM,
@@ -1800,7 +1888,11 @@ create_main_config_file(char *file)
 # 1/true: Run the pager whenever the list of files does not fit on the screen\n\
 # >1: Run the pager whenever the amount of files in the current directory is\n\
 # greater than or equal to this value (say, 1000)\n\
-;Pager=%s\n\n"
+;Pager=%s\n\n\
+# If set to true, the pager prints one screen of files at a time, replacing\n\
+# the previous one, instead of appending lines below. Only the files on the\n\
+# screen are printed, no matter how many files the directory has.\n\
+;PagerWindow=%s\n\n"
 
 	"# Maximum file name length for listed files. If TrimNames is set to\n\
 # true, names larger than MAXFILENAMELEN will be truncated at MAXFILENAMELEN\n\
@@ -1828,6 +1920,7 @@ create_main_config_file(char *file)
 		DEF_CASE_SENS_SEARCH == 1 ? "true" : "false",
 		DEF_UNICODE == 1 ? "true" : "false",
 		DEF_PAGER == 1 ? "true" : "false",
+		DEF_PAGER_WINDOW == 1 ? "true" : "false",
 		DEF_MAX_NAME_LEN,
 		DEF_TRIM_NAMES == 1 ? "true" : "false"
 		);
@@ -1851,6 +1944,11 @@ create_main_config_file(char *file)
 	    "# If set to true, clear the screen before listing files\n\
 ;ClearScreen=%s\n\n"
 
+	    "# If set to true, enclose the files list in synchronized update\n\
+# sequences, so that the terminal draws the whole list at once (less\n\
+# flickering). Terminals not supporting them just ignore these sequences.\n\
+;SyncUpdates=%s\n\n"
+
 	    "# If not specified, StartingPath defaults to the current working\n\
 # directory. If set, it overrides RestoreLastPath\n\
 ;StartingPath=\n\n"
@@ -1875,6 +1973,7 @@ create_main_config_file(char *file)
 		DEF_PRINTSEL == 1 ? "true" : "false",
 		DEF_MAX_PRINTSEL,
 		DEF_CLEAR_SCREEN == 1 ? "true" : "false",
+		DEF_SYNC_UPDATES == 1 ? "true" : "false",
 		DEF_RESTORE_LAST_PATH == 1 ? "true" : "false",
 		DEF_TRASRM == 1 ? "true" : "false",
 		DEF_RL_EDIT_MODE
@@ -2907,6 +3006,10 @@ read_config(void)
 			set_config_bool_value(line + 11, &conf.dirhist_map);
 		}
 
+		else if (*line == 'D' && strncmp(line, "DirSizeCache=", 13) == 0) {
+			set_config_bool_value(line + 13, &conf.dir_size_cache);
+		}
+
 		else if (*line == 'D' && strncmp(line, "DirhistIgnore=", 14) == 0) {
 			set_dirhistignore_pattern(line + 14);
 		}
@@ -2930,6 +3033,15 @@ read_config(void)
 			set_config_bool_value(line + 13, &conf.files_counter);
 		}
 
+		else if (*line == 'F'
+		&& strncmp(line, "FilesCounterTimeout=", 20) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 20, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.files_counter_timeout = opt_num;
+		}
+
 		else if (!filter.str && *line == 'F'
 		&& strncmp(line, "Filter=", 7) == 0) {
 			if (set_files_filter(line) == -1)
@@ -2972,6 +3084,14 @@ read_config(void)
 		}
 #endif /* !_NO_ICONS */
 
+		else if (*line == 'L' && strncmp(line, "LazyStatTimeout=", 16) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 16, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.lazy_stat_timeout = opt_num;
+		}
+
 		else if (xargs.light == UNSET && *line == 'L'
 		&& strncmp(line, "LightMode=", 10) == 0) {
 			set_config_bool_value(line + 10, &conf.light_mode);
@@ -2987,6 +3107,31 @@ read_config(void)
 			set_listing_mode(line);
 		}
 
+		else if (*line == 'L' && strncmp(line, "ListingCache=", 13) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 13, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.listing_cache = opt_num;
+		}
+
+		else if (*line == 'L'
+		&& strncmp(line, "ListingCacheSize=", 17) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 17, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.listing_cache_size = opt_num;
+		}
+
+		else if (*line == 'L' && strncmp(line, "ListingThreads=", 15) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 15, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.listing_threads = opt_num;
+		}
+
 		else if (xargs.longview == UNSET && *line == 'L'
 		&& strncmp(line, "LongViewMode=", 13) == 0) {
 			set_config_bool_value(line + 13, &conf.long_view);
@@ -3064,6 +3209,14 @@ read_config(void)
 			conf.max_printselfiles = opt_num;
 		}
 
+		else if (*line == 'M' && strncmp(line, "MaxRefreshLatency=", 18) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 18, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.max_refresh_latency = opt_num;
+		}
+
 		else if (*line == 'M' && strncmp(line, "MinFilenameTrim=", 16) == 0) {
 			int opt_num = 0;
 			ret = sscanf(line + 16, "%d\n", &opt_num);
@@ -3083,6 +3236,15 @@ read_config(void)
 			conf.min_jump_rank = opt_num;
 		}
 
+		else if (*line == 'M'
+		&& strncmp(line, "MinRefreshInterval=", 19) == 0) {
+			int opt_num = 0;
+			ret = sscanf(line + 19, "%d\n", &opt_num);
+			if (ret == -1 || opt_num < 0)
+				continue;
+			conf.min_refresh_interval = opt_num;
+		}
+
 		else if (*line == 'm' && strncmp(line, "mvCmd=", 6) == 0) {
 			int opt_num = 0;
 			ret = sscanf(line + 6, "%d\n", &opt_num);
@@ -3108,6 +3270,10 @@ read_config(void)
 			set_pager_value(line + 6, &conf.pager);
 		}
 
+		else if (*line == 'P' && strncmp(line, "PagerWindow=", 12) == 0) {
+			set_config_bool_value(line + 12, &conf.pager_window);
+		}
+
 		else if (xargs.printsel == UNSET && *line == 'P'
 		&& strncmp(line, "PrintSelfiles=", 14) == 0) {
 			set_config_bool_value(line + 14, &conf.print_selfiles);
@@ -3220,6 +3386,10 @@ read_config(void)
 		}
 #endif /* !_NO_SUGGESTIONS */
 
+		else if (*line == 'S' && strncmp(line, "SyncUpdates=", 12) == 0) {
+			set_config_bool_value(line + 12, &conf.sync_updates);
+		}
+
 #ifndef _NO_HIGHLIGHT
 		else if (xargs.highlight == UNSET && *line == 'S'
 		&& strncmp(line, "SyntaxHighlighting=", 19) == 0) {
@@ -3457,7 +3627,8 @@ init_config(void)
 #endif /* _NO_TRASH */
 
 #ifdef LINUX_FSINFO
-	get_ext_mountpoints();
+	/* Only needed by get_ext_fs_type() (fsinfo.c) */
+	defer_startup_task(STARTUP_EXT_MOUNTPOINTS);
 #endif /* LINUX_FSINFO */
 
 	if (xargs.stealth_mode == 1) {
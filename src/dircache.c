@@ -0,0 +1,639 @@
+/* dircache.c -- a persistent cache for directory sizes */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* Cache used by dir_size() (xdu, see aux.c) to avoid reading directories
+ * whose contents did not change since the last time they were read.
+ *
+ * Each directory is keyed by device and inode number, and validated by its
+ * modification and change times. For each directory we store the sizes of
+ * the files it directly contains (both apparent sizes and disk usage),
+ * files with more than one hard link (de-duplicated at lookup time), and
+ * the names of its subdirectories. Since creating, removing, or renaming
+ * a file updates the modification time of its parent directory, a cached
+ * directory can be accounted for with a single stat(2) call: its
+ * subdirectories are then checked one by one (each of them might have
+ * changed independently), but files are never read again.
+ *
+ * Caveat: modifying a file in place (say, appending data to it) does not
+ * update the modification time of its parent directory, so that the size
+ * change will not be noticed until the directory itself changes (or the
+ * cache is purged: 'fz cache purge').
+ *
+ * The cache is loaded the first time it is needed, and saved at exit
+ * into DSC_FILE, in the profile directory (native byte order: the file is
+ * discarded if the sizes of the basic types do not match). */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "dircache.h"
+#include "messages.h"
+#include "misc.h"
+
+#ifdef USE_XDU
+
+# if defined(CLIFM_LEGACY)
+#  define DSC_MTIME_NS(s) 0L
+#  define DSC_CTIME_NS(s) 0L
+# elif defined(__NetBSD__) || defined(__APPLE__)
+#  define DSC_MTIME_NS(s) ((long)(s)->st_mtimespec.tv_nsec)
+#  define DSC_CTIME_NS(s) ((long)(s)->st_ctimespec.tv_nsec)
+# else
+#  define DSC_MTIME_NS(s) ((long)(s)->st_mtim.tv_nsec)
+#  define DSC_CTIME_NS(s) ((long)(s)->st_ctim.tv_nsec)
+# endif /* CLIFM_LEGACY */
+
+# define DSC_MAGIC "CLFMDSC1"
+/* Sanity limits for records read from the cache file */
+# define DSC_MAX_LINKS (1 << 24)
+# define DSC_MAX_NAMES (1 << 30)
+
+struct dsc_header_t {
+	char magic[8];
+	uint32_t dev_size;
+	uint32_t ino_size;
+	uint32_t off_size;
+	uint32_t time_size;
+	uint64_t entries;
+};
+
+struct dsc_rec_t {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	time_t ctime;
+	time_t last_used;
+	int64_t mtime_ns;
+	int64_t ctime_ns;
+	off_t apparent;
+	off_t blocks;
+	uint64_t links_n;
+	uint64_t children_n;
+	uint64_t names_len;
+};
+
+/* Open addressing hash table (linear probing) of pointers to entries:
+ * entries never move, so that pointers returned by dsc_lookup() remain
+ * valid while new entries are added. Replaced entries are not freed right
+ * away, but retired (see insert_entry()). */
+static struct dsc_entry_t **dsc_table = (struct dsc_entry_t **)NULL;
+static size_t dsc_cap = 0;
+static size_t dsc_n = 0;
+static size_t dsc_hits = 0;
+static size_t dsc_misses = 0;
+static int dsc_loaded = 0;
+/* Entries replaced while dir_size() workers might still be using them */
+static struct dsc_entry_t **dsc_retired = (struct dsc_entry_t **)NULL;
+static size_t dsc_retired_n = 0;
+static int dsc_dirty = 0;
+/* dsc_lookup() and dsc_store() are called by dir_size() workers */
+static pthread_mutex_t dsc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+dsc_hash(const dev_t dev, const ino_t ino)
+{
+	uint64_t h = (uint64_t)ino * 0x9E3779B97F4A7C15ULL;
+	h ^= (uint64_t)dev + 0x7F4A7C15ULL + (h << 6) + (h >> 2);
+	return (size_t)(h ^ (h >> 31));
+}
+
+static size_t
+find_slot(struct dsc_entry_t **table, const size_t cap, const dev_t dev,
+	const ino_t ino)
+{
+	size_t i = dsc_hash(dev, ino) & (cap - 1);
+	while (table[i] && (table[i]->dev != dev || table[i]->ino != ino))
+		i = (i + 1) & (cap - 1);
+
+	return i;
+}
+
+static void
+free_entry(struct dsc_entry_t *e)
+{
+	free(e->links);
+	free(e->names);
+	free(e);
+}
+
+/* Keep the load factor below 0.7 */
+static void
+grow_table(void)
+{
+	if (dsc_cap > 0 && (dsc_n + 1) * 10 < dsc_cap * 7)
+		return;
+
+	const size_t new_cap = dsc_cap > 0 ? dsc_cap * 2 : 1024;
+	struct dsc_entry_t **t = (struct dsc_entry_t **)xcalloc(new_cap,
+		sizeof(struct dsc_entry_t *));
+
+	size_t i;
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_table[i])
+			t[find_slot(t, new_cap, dsc_table[i]->dev,
+				dsc_table[i]->ino)] = dsc_table[i];
+	}
+
+	free(dsc_table);
+	dsc_table = t;
+	dsc_cap = new_cap;
+}
+
+/* Add the entry E to the table, replacing the entry for the same directory,
+ * if any. The replaced entry might have been handed over to a worker by
+ * dsc_lookup() before the directory changed (the same directory can be
+ * reached twice in a single traversal, say, via bind mounts), so that it
+ * is only freed by dsc_free_retired(), once the workers are done. */
+static void
+insert_entry(struct dsc_entry_t *e)
+{
+	grow_table();
+	const size_t i = find_slot(dsc_table, dsc_cap, e->dev, e->ino);
+	if (dsc_table[i]) {
+		dsc_retired = (struct dsc_entry_t **)xrealloc(dsc_retired,
+			(dsc_retired_n + 1) * sizeof(struct dsc_entry_t *));
+		dsc_retired[dsc_retired_n++] = dsc_table[i];
+	} else {
+		dsc_n++;
+	}
+
+	dsc_table[i] = e;
+}
+
+/* Free the entries replaced by insert_entry(). Called by dir_size() once
+ * no worker is running, i.e. when no pointer returned by dsc_lookup() is
+ * in use anymore. */
+void
+dsc_free_retired(void)
+{
+	pthread_mutex_lock(&dsc_mutex);
+
+	while (dsc_retired_n > 0)
+		free_entry(dsc_retired[--dsc_retired_n]);
+	free(dsc_retired);
+	dsc_retired = (struct dsc_entry_t **)NULL;
+
+	pthread_mutex_unlock(&dsc_mutex);
+}
+
+static void
+free_dsc_table(void)
+{
+	size_t i;
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_table[i])
+			free_entry(dsc_table[i]);
+	}
+
+	free(dsc_table);
+	dsc_table = (struct dsc_entry_t **)NULL;
+	dsc_cap = dsc_n = 0;
+
+	dsc_free_retired();
+}
+
+/* Write the path to the cache file into BUF, of size SIZE. Returns 0 on
+ * success or -1 if the cache is not to be stored on disk. */
+static int
+get_dsc_file(char *buf, const size_t size)
+{
+	if (xargs.stealth_mode == 1 || config_ok == 0 || !config_dir
+	|| !*config_dir)
+		return (-1);
+
+	snprintf(buf, size, "%s/%s", config_dir, DSC_FILE);
+	return 0;
+}
+
+/* Names must be NUL terminated, and there must be exactly CHILDREN_N of
+ * them */
+static int
+valid_names(const char *names, const size_t len, const size_t children_n)
+{
+	if (len == 0)
+		return (children_n == 0);
+
+	if (names[len - 1] != '\0')
+		return 0;
+
+	size_t i, c = 0;
+	for (i = 0; i < len; i++) {
+		if (names[i] == '\0')
+			c++;
+	}
+
+	return (c == children_n);
+}
+
+static struct dsc_entry_t *
+read_entry(FILE *fp)
+{
+	struct dsc_rec_t r;
+	if (fread(&r, sizeof(r), 1, fp) != 1 || r.links_n > DSC_MAX_LINKS
+	|| r.names_len > DSC_MAX_NAMES)
+		return (struct dsc_entry_t *)NULL;
+
+	struct dsc_entry_t *e =
+		(struct dsc_entry_t *)xcalloc(1, sizeof(struct dsc_entry_t));
+	e->dev = r.dev;
+	e->ino = r.ino;
+	e->mtime = r.mtime;
+	e->ctime = r.ctime;
+	e->last_used = r.last_used;
+	e->mtime_ns = (long)r.mtime_ns;
+	e->ctime_ns = (long)r.ctime_ns;
+	e->apparent = r.apparent;
+	e->blocks = r.blocks;
+	e->links_n = (size_t)r.links_n;
+	e->children_n = (size_t)r.children_n;
+	e->names_len = (size_t)r.names_len;
+
+	if (e->links_n > 0) {
+		e->links = (struct dsc_link_t *)xnmalloc(e->links_n,
+			sizeof(struct dsc_link_t));
+		if (fread(e->links, sizeof(struct dsc_link_t), e->links_n, fp)
+		!= e->links_n)
+			goto ERROR;
+	}
+
+	if (e->names_len > 0) {
+		e->names = (char *)xnmalloc(e->names_len, sizeof(char));
+		if (fread(e->names, sizeof(char), e->names_len, fp) != e->names_len)
+			goto ERROR;
+	}
+
+	if (valid_names(e->names, e->names_len, e->children_n) == 0)
+		goto ERROR;
+
+	return e;
+
+ERROR:
+	free_entry(e);
+	return (struct dsc_entry_t *)NULL;
+}
+
+static void
+load_dir_size_cache(void)
+{
+	dsc_loaded = 1;
+
+	char file[PATH_MAX + 1];
+	if (get_dsc_file(file, sizeof(file)) == -1)
+		return;
+
+	int fd;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return;
+
+	struct dsc_header_t h;
+	if (fread(&h, sizeof(h), 1, fp) != 1
+	|| memcmp(h.magic, DSC_MAGIC, sizeof(h.magic)) != 0
+	|| h.dev_size != sizeof(dev_t) || h.ino_size != sizeof(ino_t)
+	|| h.off_size != sizeof(off_t) || h.time_size != sizeof(time_t))
+		goto END;
+
+	const time_t now = time(NULL);
+	uint64_t i;
+	for (i = 0; i < h.entries; i++) {
+		struct dsc_entry_t *e = read_entry(fp);
+		if (!e) { /* Corrupted file: rewrite it at exit */
+			dsc_dirty = 1;
+			break;
+		}
+
+		if (now - e->last_used > DSC_MAX_AGE) {
+			free_entry(e);
+			dsc_dirty = 1;
+			continue;
+		}
+
+		insert_entry(e);
+	}
+
+END:
+	fclose(fp);
+}
+
+static int
+write_entry(FILE *fp, const struct dsc_entry_t *e)
+{
+	struct dsc_rec_t r;
+	memset(&r, 0, sizeof(r));
+	r.dev = e->dev;
+	r.ino = e->ino;
+	r.mtime = e->mtime;
+	r.ctime = e->ctime;
+	r.last_used = e->last_used;
+	r.mtime_ns = (int64_t)e->mtime_ns;
+	r.ctime_ns = (int64_t)e->ctime_ns;
+	r.apparent = e->apparent;
+	r.blocks = e->blocks;
+	r.links_n = (uint64_t)e->links_n;
+	r.children_n = (uint64_t)e->children_n;
+	r.names_len = (uint64_t)e->names_len;
+
+	if (fwrite(&r, sizeof(r), 1, fp) != 1)
+		return (-1);
+	if (e->links_n > 0 && fwrite(e->links, sizeof(struct dsc_link_t),
+	e->links_n, fp) != e->links_n)
+		return (-1);
+	if (e->names_len > 0 && fwrite(e->names, sizeof(char), e->names_len,
+	fp) != e->names_len)
+		return (-1);
+
+	return 0;
+}
+
+/* Write the cache into the cache file (only if modified). Entries are
+ * written into a temporary file, which then replaces the cache file. */
+void
+save_dir_size_cache(void)
+{
+	if (dsc_dirty == 0 || conf.dir_size_cache != 1)
+		return;
+
+	char file[PATH_MAX + 1];
+	if (get_dsc_file(file, sizeof(file)) == -1)
+		return;
+
+	char tmp_file[PATH_MAX + 5];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", file);
+
+	int fd;
+	FILE *fp = open_fwrite(tmp_file, &fd);
+	if (!fp)
+		return;
+
+	const time_t now = time(NULL);
+	struct dsc_header_t h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, DSC_MAGIC, sizeof(h.magic));
+	h.dev_size = (uint32_t)sizeof(dev_t);
+	h.ino_size = (uint32_t)sizeof(ino_t);
+	h.off_size = (uint32_t)sizeof(off_t);
+	h.time_size = (uint32_t)sizeof(time_t);
+
+	size_t i;
+	for (i = 0; i < dsc_cap; i++) {
+		if (dsc_table[i] && now - dsc_table[i]->last_used <= DSC_MAX_AGE)
+			h.entries++;
+	}
+
+	int ret = (fwrite(&h, sizeof(h), 1, fp) == 1) ? 0 : -1;
+	for (i = 0; ret == 0 && i < dsc_cap; i++) {
+		if (dsc_table[i] && now - dsc_table[i]->last_used <= DSC_MAX_AGE)
+			ret = write_entry(fp, dsc_table[i]);
+	}
+
+	if (fclose(fp) != 0 || ret == -1 || rename(tmp_file, file) == -1) {
+		unlink(tmp_file);
+		return;
+	}
+
+	dsc_dirty = 0;
+}
+
+/* Return the entry for the directory whose attributes are A, provided it
+ * is up to date, or NULL otherwise */
+static struct dsc_entry_t *
+get_entry(const struct stat *a)
+{
+	struct dsc_entry_t *e = dsc_cap > 0
+		? dsc_table[find_slot(dsc_table, dsc_cap, a->st_dev, a->st_ino)]
+		: (struct dsc_entry_t *)NULL;
+
+	if (!e || e->mtime != a->st_mtime || e->ctime != a->st_ctime
+	|| e->mtime_ns != DSC_MTIME_NS(a) || e->ctime_ns != DSC_CTIME_NS(a))
+		return (struct dsc_entry_t *)NULL;
+
+	return e;
+}
+
+/* Return the cached entry for the directory whose attributes are A, or
+ * NULL if not cached or if the directory changed since it was cached.
+ * The entry might be replaced by dsc_store() at any moment (if the
+ * directory changes), but it is not freed until the current dir_size()
+ * call is done (see insert_entry()), so that the returned pointer remains
+ * valid meanwhile. */
+const struct dsc_entry_t *
+dsc_lookup(const struct stat *a)
+{
+	pthread_mutex_lock(&dsc_mutex);
+
+	if (dsc_loaded == 0)
+		load_dir_size_cache();
+
+	struct dsc_entry_t *e = get_entry(a);
+	if (!e) {
+		dsc_misses++;
+		pthread_mutex_unlock(&dsc_mutex);
+		return (const struct dsc_entry_t *)NULL;
+	}
+
+	dsc_hits++;
+	/* Do not rewrite the cache file just to update this timestamp,
+	 * unless it is more than a day old */
+	const time_t now = time(NULL);
+	if (now - e->last_used > 24 * 60 * 60)
+		dsc_dirty = 1;
+	e->last_used = now;
+
+	pthread_mutex_unlock(&dsc_mutex);
+	return e;
+}
+
+/* Register the subdirectory NAME in SCAN */
+void
+dsc_scan_dir(struct dsc_scan_t *scan, const char *name)
+{
+	const size_t len = strlen(name) + 1;
+	if (scan->names_len + len > scan->names_cap) {
+		scan->names_cap = (scan->names_len + len) * 2;
+		scan->names = (char *)xrealloc(scan->names,
+			scan->names_cap * sizeof(char));
+	}
+
+	memcpy(scan->names + scan->names_len, name, len);
+	scan->names_len += len;
+	scan->children_n++;
+}
+
+/* Register the file (not directory) whose attributes are A in SCAN */
+void
+dsc_scan_file(struct dsc_scan_t *scan, const struct stat *a)
+{
+	/* Same check made by usable_st_size() (aux.c) for apparent sizes */
+	const int usable = (S_ISLNK(a->st_mode) || S_ISREG(a->st_mode)
+		|| S_TYPEISSHM(a) || S_TYPEISTMO(a));
+	const off_t blocks = a->st_blocks * S_BLKSIZE;
+
+	if (a->st_nlink <= 1) {
+		if (usable == 1)
+			scan->apparent += a->st_size;
+		scan->blocks += blocks;
+		return;
+	}
+
+	if (scan->links_n == scan->links_cap) {
+		scan->links_cap = scan->links_cap > 0 ? scan->links_cap * 2 : 16;
+		scan->links = (struct dsc_link_t *)xrealloc(scan->links,
+			scan->links_cap * sizeof(struct dsc_link_t));
+	}
+
+	struct dsc_link_t *l = &scan->links[scan->links_n];
+	l->dev = a->st_dev;
+	l->ino = a->st_ino;
+	l->apparent = a->st_size;
+	l->blocks = blocks;
+	l->usable = usable;
+	l->pad0 = 0;
+	scan->links_n++;
+}
+
+/* Store SCAN as the cache entry for the directory whose attributes are A.
+ * The buffers in SCAN are taken by the cache. */
+void
+dsc_store(const struct stat *a, struct dsc_scan_t *scan)
+{
+	pthread_mutex_lock(&dsc_mutex);
+
+	if (dsc_loaded == 0)
+		load_dir_size_cache();
+
+	/* Already stored by another worker (the same directory can be reached
+	 * twice, say, via bind mounts): keep the current entry */
+	if (get_entry(a)) {
+		pthread_mutex_unlock(&dsc_mutex);
+		dsc_free_scan(scan);
+		return;
+	}
+
+	struct dsc_entry_t *e =
+		(struct dsc_entry_t *)xnmalloc(1, sizeof(struct dsc_entry_t));
+	e->dev = a->st_dev;
+	e->ino = a->st_ino;
+	e->mtime = a->st_mtime;
+	e->ctime = a->st_ctime;
+	e->mtime_ns = DSC_MTIME_NS(a);
+	e->ctime_ns = DSC_CTIME_NS(a);
+	e->last_used = time(NULL);
+	e->apparent = scan->apparent;
+	e->blocks = scan->blocks;
+	e->links = scan->links;
+	e->links_n = scan->links_n;
+	e->names = scan->names;
+	e->names_len = scan->names_len;
+	e->children_n = scan->children_n;
+
+	insert_entry(e);
+	dsc_dirty = 1;
+
+	pthread_mutex_unlock(&dsc_mutex);
+	memset(scan, 0, sizeof(struct dsc_scan_t));
+}
+
+void
+dsc_free_scan(struct dsc_scan_t *scan)
+{
+	free(scan->links);
+	free(scan->names);
+	memset(scan, 0, sizeof(struct dsc_scan_t));
+}
+
+static int
+purge_dir_size_cache(void)
+{
+	const size_t n = dsc_n;
+	free_dsc_table();
+	dsc_hits = dsc_misses = 0;
+	dsc_dirty = 0;
+	dsc_loaded = 1;
+
+	char file[PATH_MAX + 1];
+	if (get_dsc_file(file, sizeof(file)) == 0 && unlink(file) == -1
+	&& errno != ENOENT) {
+		xerror("fz: %s: %s\n", file, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	printf(_("fz: Directory size cache purged (%zu entries)\n"), n);
+	return EXIT_SUCCESS;
+}
+
+static int
+print_dir_size_cache_stats(void)
+{
+	if (dsc_loaded == 0 && conf.dir_size_cache == 1)
+		load_dir_size_cache();
+
+	char file[PATH_MAX + 1];
+	const int file_ok = (get_dsc_file(file, sizeof(file)) == 0);
+	struct stat a;
+
+	printf(_("Directory size cache: %s\n"), conf.dir_size_cache == 1
+		? _("enabled") : _("disabled (set DirSizeCache to true to enable)"));
+	if (file_ok == 1 && stat(file, &a) != -1)
+		printf(_("File:    %s (%s)\n"), file, construct_human_size(a.st_size));
+	else
+		printf(_("File:    %s\n"), file_ok == 1 ? file : "-");
+	printf(_("Entries: %zu\n"), dsc_n);
+
+	const size_t total = dsc_hits + dsc_misses;
+	printf(_("Lookups: %zu (%zu hits, %zu misses, hit rate: %.1f%%)\n"),
+		total, dsc_hits, dsc_misses, total > 0
+		? (double)dsc_hits * 100.0 / (double)total : 0.0);
+
+	return EXIT_SUCCESS;
+}
+#endif /* USE_XDU */
+
+/* Print information about the directory size cache, or purge it
+ * if ARG is "purge" ('fz cache [purge]'). */
+int
+dir_size_cache_function(char *arg)
+{
+#ifndef USE_XDU
+	UNUSED(arg);
+	xerror("fz: cache: %s\n", _(NOT_AVAILABLE));
+	return EXIT_FAILURE;
+#else
+	if (!arg || !*arg)
+		return print_dir_size_cache_stats();
+
+	if (*arg == 'p' && strcmp(arg, "purge") == 0)
+		return purge_dir_size_cache();
+
+	xerror(_("fz: cache: %s: Invalid argument. Try 'fz -h'\n"), arg);
+	return EXIT_FAILURE;
+#endif /* !USE_XDU */
+}
@@ -0,0 +1,94 @@
+/* dircache.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <sys/stat.h>
+
+#define DSC_FILE "dirsize.cache"
+/* Forget directories not used for this many seconds (30 days) */
+#define DSC_MAX_AGE (30 * 24 * 60 * 60)
+
+#ifdef USE_XDU
+/* A file with more than one hard link, stored apart for de-duplication */
+struct dsc_link_t {
+	dev_t dev;
+	ino_t ino;
+	off_t apparent;
+	off_t blocks;
+	int usable; /* Contributes to apparent sizes (see usable_st_size()) */
+	int pad0;
+};
+
+/* A cached directory: sizes of the files directly contained in it, and
+ * names of its subdirectories (NUL separated) */
+struct dsc_entry_t {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	time_t ctime;
+	time_t last_used;
+	long mtime_ns;
+	long ctime_ns;
+	off_t apparent;
+	off_t blocks;
+	struct dsc_link_t *links;
+	char *names;
+	size_t links_n;
+	size_t children_n;
+	size_t names_len;
+};
+
+/* Information collected while reading a directory, to be stored in the
+ * cache via dsc_store() */
+struct dsc_scan_t {
+	off_t apparent;
+	off_t blocks;
+	struct dsc_link_t *links;
+	char *names;
+	size_t links_n;
+	size_t links_cap;
+	size_t children_n;
+	size_t names_len;
+	size_t names_cap;
+};
+#endif /* USE_XDU */
+
+__BEGIN_DECLS
+
+int  dir_size_cache_function(char *);
+#ifdef USE_XDU
+const struct dsc_entry_t *dsc_lookup(const struct stat *);
+void dsc_scan_dir(struct dsc_scan_t *, const char *);
+void dsc_scan_file(struct dsc_scan_t *, const struct stat *);
+void dsc_store(const struct stat *, struct dsc_scan_t *);
+void dsc_free_retired(void);
+void dsc_free_scan(struct dsc_scan_t *);
+void save_dir_size_cache(void);
+#endif /* USE_XDU */
+
+__END_DECLS
+
+#endif /* DIRCACHE_H */
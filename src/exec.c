@@ -52,8 +52,10 @@ typedef char *rl_cpvfunc_t;
 #include "checks.h"
 #include "colors.h"
 #include "config.h"
+#include "dircache.h"
 #include "exec.h"
 #include "file_operations.h"
+#include "frame.h"
 #include "history.h"
 #include "init.h"
 #include "jump.h"
@@ -72,6 +74,7 @@ typedef char *rl_cpvfunc_t;
 #include "search.h"
 #include "selection.h"
 #include "sort.h"
+#include "startup.h" /* run_startup_tasks() */
 #ifndef _NO_TRASH
 # include "trash.h"
 #endif /* !_NO_TRASH */
@@ -144,6 +147,7 @@ xsystem(const char *cmd)
 	}
 
 	int status = 0;
+	frame_invalidate();
 	pid_t pid = fork();
 
 	if (pid < 0) {
@@ -179,6 +183,7 @@ launch_execl(const char *cmd)
 	if (!cmd || !*cmd)
 		return EXEC_NULLPARAM;
 
+	flush_sel_journal();
 	int status = xsystem(cmd);
 
 	int exit_status = get_exit_code(status, EXEC_FG_PROC);
@@ -203,7 +208,9 @@ launch_execv(char **cmd, const int bg, const int xflags)
 	if (!cmd)
 		return EXEC_NULLPARAM;
 
+	flush_sel_journal();
 	int status = 0;
+	frame_invalidate();
 	pid_t pid = fork();
 	if (pid < 0) {
 		xerror("%s: fork: %s\n", PROGRAM_NAME, strerror(errno));
@@ -1587,6 +1594,10 @@ Unstatable files:            %zu\n\
 # endif /* S_IFWHT */
 #endif /* _BE_POSIX */
 
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+	print_fs_events_stats();
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
 	return EXIT_SUCCESS;
 }
 
@@ -1609,6 +1620,9 @@ trash_func(char **args, int *_cont)
 		sel_n = 0;
 		if (save_sel() != 0)
 			exit_status = EXIT_FAILURE;
+	} else if (sel_n > 0 && exit_status == EXIT_SUCCESS) {
+		/* Some trashed file might be selected */
+		get_sel_files();
 	}
 
 	return exit_status;
@@ -1646,13 +1660,17 @@ untrash_func(char **args, int *_cont)
 }
 
 static int
-toggle_full_dir_size(const char *arg)
+toggle_full_dir_size(char **args)
 {
+	char *arg = args[0];
 	if (!arg || !*arg || IS_HELP(arg)) {
 		puts(_(FZ_USAGE));
 		return EXIT_SUCCESS;
 	}
 
+	if (*arg == 'c' && strcmp(arg, "cache") == 0)
+		return dir_size_cache_function(args[1]);
+
 	if (*arg != 'o') {
 		xerror(_("%s: %s: Invalid argument. Try 'fz -h'\n"), PROGRAM_NAME, arg);
 		return EXIT_FAILURE;
@@ -1893,10 +1911,8 @@ preview_function(char **args)
 	tabmode = tabmode_bk;
 	conf.fzf_preview = fzf_preview_bk;
 
-	if (sel_n > seln_bk) {
-		save_sel();
-		get_sel_files();
-	}
+	if (sel_n > seln_bk)
+		append_sel_files(sel_n - seln_bk);
 
 	if (conf.autols == 1) {
 		putchar('\n');
@@ -2196,6 +2212,21 @@ is_write_cmd(const char *cmd)
  * This will be the value returned by this function. Used by the \z
  * escape code in the prompt to print the exit status of the last
  * executed command */
+/* Return 1 if COMM is a selection command printing nothing but the new
+ * files list, or 0 otherwise */
+static int
+is_sel_cmd(char **comm)
+{
+	if (!comm[1] || IS_HELP(comm[1]))
+		return 0;
+
+	if (*comm[0] == 's')
+		return (!comm[0][1] || strcmp(comm[0], "sel") == 0);
+
+	return (*comm[0] == 'd'
+		&& (strcmp(comm[0], "ds") == 0 || strcmp(comm[0], "desel") == 0));
+}
+
 int
 exec_cmd(char **comm)
 {
@@ -2203,6 +2234,15 @@ exec_cmd(char **comm)
 		check_zombies();
 	fputs(df_c, stdout);
 
+	/* The command might need data loaded by deferred startup tasks (say,
+	 * when running the profile file before the first key press) */
+	run_startup_tasks();
+
+	/* We cannot know what the command prints: the next files list will be
+	 * written as a whole (see frame.c) */
+	if (is_sel_cmd(comm) == 0)
+		frame_invalidate();
+
 	if (conf.readonly == 1 && is_write_cmd(
 	((*comm[0] == 's' && strcmp(comm[0] + 1, "udo") == 0)
 	|| (*comm[0] == 'd' && strcmp(comm[0] + 1, "oas") == 0))
@@ -2391,7 +2431,10 @@ exec_cmd(char **comm)
 
 	/*     ############### SELECTION ##################     */
 	else if (*comm[0] == 's' && (!comm[0][1] || strcmp(comm[0], "sel") == 0)) {
-		return (exit_code = sel_function(comm));
+		frame_hold();
+		exit_code = sel_function(comm);
+		frame_release();
+		return exit_code;
 	}
 
 	else if (*comm[0] == 's' && (strcmp(comm[0], "sb") == 0
@@ -2400,8 +2443,12 @@ exec_cmd(char **comm)
 	}
 
 	else if (*comm[0] == 'd' && (strcmp(comm[0], "ds") == 0
-	|| strcmp(comm[0], "desel") == 0))
-		return (exit_code = desel_function(comm));
+	|| strcmp(comm[0], "desel") == 0)) {
+		frame_hold();
+		exit_code = desel_function(comm);
+		frame_release();
+		return exit_code;
+	}
 
 	else if (*comm[0] == 'l' && !comm[0][1]) {
 		exit_code = symlink_file(comm + 1);
@@ -2538,7 +2585,7 @@ exec_cmd(char **comm)
 		return (exit_code = filter_function(comm[1]));
 
 	else if (*comm[0] == 'f' && comm[0][1] == 'z' && !comm[0][2])
-		return (exit_code = toggle_full_dir_size(comm[1]));
+		return (exit_code = toggle_full_dir_size(comm + 1));
 
 	else if (*comm[0] == 'c' && ((comm[0][1] == 'l' && !comm[0][2])
 	|| strcmp(comm[0], "columns") == 0))
@@ -0,0 +1,636 @@
+/* fcounter.c -- count files in directories in the background */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* count_dir() might block for a long time (or forever) on a slow or stale
+ * mount point (say, NFS or SSHFS). To prevent a single directory from
+ * blocking the whole files list, list_dir() hands the files counter over
+ * to count_dirs_async(), which runs count_dir() in a pool of background
+ * threads, and waits for them to finish.
+ *
+ * Each directory gets conf.files_counter_timeout milliseconds, starting
+ * when a thread begins counting it. Once every directory is either counted
+ * or past its own deadline, we stop waiting: the remaining directories are
+ * marked as FC_PENDING (printed as '?'), and the list is printed. Counting
+ * goes on in the background. Once a count is available, the background
+ * thread writes to a pipe, which is watched by my_rl_getc() (readline.c)
+ * via fc_notify_fd(): the files list is then refreshed by fc_refresh(),
+ * reusing the counts already available.
+ *
+ * Since a blocked thread cannot be cancelled, a directory still being
+ * counted is never queued again: the new list just attaches to the job
+ * already running. Threads running past their deadline are flagged as
+ * stuck, and are not taken into account by FC_MAX_THREADS: new threads are
+ * spawned to replace them, so that a few stale mount points cannot take
+ * over the pool (at most FC_MAX_STUCK_THREADS are left behind, though).
+ * Once a stuck thread is done, it goes back to the pool, and surplus idle
+ * threads exit. */
+
+#include "helpers.h"
+
+#include <limits.h> /* SSIZE_MAX (FC_PENDING) */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "fcounter.h"
+#include "listing.h"
+
+#define FC_QUEUED  0
+#define FC_RUNNING 1
+#define FC_DONE    2
+
+struct fc_job_t {
+	char *path;
+	filesn_t filesn; /* count_dir() - 2 */
+	size_t index;    /* Index of this entry in the pf_list_t struct */
+	struct timespec start; /* When the job started running */
+	int status;
+	int orphan;      /* No longer needed: freed by the worker once done */
+	int stuck;       /* Still running past its deadline */
+};
+
+struct fc_state_t {
+	char *dir;       /* Directory whose subdirectories are being counted */
+	struct fc_job_t **jobs;
+	size_t jobs_n;
+	size_t next;     /* Index of the next job to be checked for FC_QUEUED */
+	size_t pending;  /* Jobs not yet done */
+	size_t queued;   /* Jobs not yet started */
+	struct fc_job_t **running; /* Jobs being run (including orphans) */
+	size_t running_n;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int threads;
+	int idle;
+	int stuck;       /* Threads running a job past its deadline */
+	int waiting;     /* count_dirs_async() is waiting for results */
+	int notified;    /* Results were notified via the pipe */
+	int reuse;       /* Reuse available results (see fc_refresh()) */
+	int pipe[2];
+};
+
+static struct fc_state_t fc = {
+	NULL, NULL, 0, 0, 0, 0, NULL, 0, PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	0, 0, 0, 0, 0, 0, {-1, -1}
+};
+
+/* Must be called with the mutex locked */
+static struct fc_job_t *
+get_queued_job(void)
+{
+	while (fc.next < fc.jobs_n) {
+		struct fc_job_t *job = fc.jobs[fc.next++];
+		if (job->status == FC_QUEUED)
+			return job;
+	}
+
+	return (struct fc_job_t *)NULL;
+}
+
+/* Remove JOB from the list of running jobs.
+ * Must be called with the mutex locked. */
+static void
+remove_running_job(const struct fc_job_t *job)
+{
+	size_t i;
+	for (i = 0; i < fc.running_n; i++) {
+		if (fc.running[i] == job) {
+			fc.running[i] = fc.running[--fc.running_n];
+			return;
+		}
+	}
+}
+
+static void *
+fc_worker(void *arg)
+{
+	UNUSED(arg);
+	pthread_mutex_lock(&fc.mutex);
+
+	while (1) {
+		struct fc_job_t *job = get_queued_job();
+		if (!job) {
+			/* Stuck threads were replaced: once back, the surplus exits */
+			if (fc.threads - fc.stuck > FC_MAX_THREADS) {
+				fc.threads--;
+				break;
+			}
+
+			fc.idle++;
+			pthread_cond_wait(&fc.work_cond, &fc.mutex);
+			fc.idle--;
+			continue;
+		}
+
+		job->status = FC_RUNNING;
+		clock_gettime(CLOCK_REALTIME, &job->start);
+		fc.queued--;
+		/* running has room for every thread (see spawn_fc_workers()) */
+		fc.running[fc.running_n++] = job;
+		pthread_mutex_unlock(&fc.mutex);
+
+		const filesn_t n = count_dir(job->path, NO_CPOP) - 2;
+
+		pthread_mutex_lock(&fc.mutex);
+		remove_running_job(job);
+		if (job->stuck == 1)
+			fc.stuck--;
+
+		if (job->orphan == 1) {
+			free(job->path);
+			free(job);
+			continue;
+		}
+
+		job->filesn = n;
+		job->status = FC_DONE;
+		fc.pending--;
+
+		if (fc.waiting == 1) {
+			pthread_cond_signal(&fc.done_cond);
+		} else if (fc.notified == 0 && fc.pipe[1] != -1) {
+			fc.notified = 1;
+			const char c = 1;
+			if (write(fc.pipe[1], &c, 1) == -1)
+				fc.notified = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&fc.mutex);
+	return (void *)NULL;
+}
+
+/* Create the pipe used to notify results to the main thread. Both ends
+ * are non-blocking: we never want to wait for it. */
+static int
+init_fc_pipe(void)
+{
+	if (fc.pipe[0] != -1)
+		return 0;
+
+	if (pipe(fc.pipe) == -1) {
+		fc.pipe[0] = fc.pipe[1] = -1;
+		return (-1);
+	}
+
+	int i;
+	for (i = 0; i < 2; i++) {
+		fcntl(fc.pipe[i], F_SETFD, FD_CLOEXEC);
+		const int fl = fcntl(fc.pipe[i], F_GETFL);
+		if (fl != -1)
+			fcntl(fc.pipe[i], F_SETFL, fl | O_NONBLOCK);
+	}
+
+	return 0;
+}
+
+static void
+drain_fc_pipe(void)
+{
+	char buf[64];
+	if (fc.pipe[0] != -1)
+		while (read(fc.pipe[0], buf, sizeof(buf)) > 0);
+}
+
+/* Return 1 if a new worker thread can be spawned, or 0 otherwise.
+ * Stuck threads are not taken into account by FC_MAX_THREADS. */
+static int
+can_spawn_fc_worker(void)
+{
+	return (fc.threads - fc.stuck < FC_MAX_THREADS
+		&& fc.stuck <= FC_MAX_STUCK_THREADS);
+}
+
+/* Make sure there are enough threads to run WANTED jobs at once.
+ * Must be called with the mutex locked. Worker threads block all signals:
+ * these should be handled by the main thread only. */
+static void
+spawn_fc_workers(const size_t wanted)
+{
+	if ((size_t)fc.idle >= wanted || can_spawn_fc_worker() == 0)
+		return;
+
+	if (!fc.running) {
+		/* Never more than this many threads at once (see
+		 * can_spawn_fc_worker()): each one runs one job at most */
+		fc.running = (struct fc_job_t **)xnmalloc(FC_MAX_THREADS
+			+ FC_MAX_STUCK_THREADS + 1, sizeof(struct fc_job_t *));
+	}
+
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) != 0)
+		return;
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	size_t n = wanted - (size_t)fc.idle;
+	while (n > 0 && can_spawn_fc_worker() == 1) {
+		pthread_t tid;
+		if (pthread_create(&tid, &attr, fc_worker, NULL) != 0)
+			break;
+		fc.threads++;
+		n--;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+}
+
+/* Look for a job for PATH among the OLD_N jobs in OLD, starting at index
+ * *CUR (entries are usually read in the same order as in the previous
+ * list). The job taken is removed from OLD. */
+static struct fc_job_t *
+take_old_job(struct fc_job_t **old, const size_t old_n, size_t *cur,
+	const char *path)
+{
+	size_t i, j = *cur;
+	for (i = 0; i < old_n; i++, j++) {
+		if (j >= old_n)
+			j = 0;
+
+		struct fc_job_t *job = old[j];
+		if (!job)
+			continue;
+
+		if (strcmp(job->path, path) == 0) {
+			old[j] = (struct fc_job_t *)NULL;
+			*cur = j + 1;
+			return job;
+		}
+	}
+
+	return (struct fc_job_t *)NULL;
+}
+
+static int
+is_countable_dir(const struct pf_entry_t *e)
+{
+	if (e->stat_ok == 0)
+		return 0;
+
+	return (S_ISDIR(e->attr.st_mode) || (S_ISLNK(e->attr.st_mode)
+		&& e->lattr && S_ISDIR(e->lattr->st_mode)));
+}
+
+/* Store in DEADLINE the time START plus conf.files_counter_timeout */
+static void
+get_fc_deadline(const struct timespec *start, struct timespec *deadline)
+{
+	deadline->tv_sec = start->tv_sec + conf.files_counter_timeout / 1000;
+	deadline->tv_nsec = start->tv_nsec
+		+ (long)(conf.files_counter_timeout % 1000) * 1000000L;
+	if (deadline->tv_nsec >= 1000000000L) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+static int
+timespec_before(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec < b->tv_sec
+		|| (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec));
+}
+
+static size_t
+count_countable_dirs(const struct pf_list_t *list)
+{
+	size_t i, n = 0;
+	for (i = 0; i < list->n; i++)
+		if (is_countable_dir(&list->ent[i]))
+			n++;
+
+	return n;
+}
+
+/* Return the path to the file NAME in the directory DIR */
+static char *
+make_fc_path(const char *dir, const char *name)
+{
+	const int is_root = (*dir == '/' && !dir[1]);
+	const size_t len = strlen(dir) + strlen(name) + 2;
+	char *path = (char *)xnmalloc(len, sizeof(char));
+	snprintf(path, len, "%s/%s", is_root == 1 ? "" : dir, name);
+	return path;
+}
+
+static struct fc_job_t *
+new_fc_job(char *path)
+{
+	struct fc_job_t *job =
+		(struct fc_job_t *)xnmalloc(1, sizeof(struct fc_job_t));
+	job->path = path;
+	job->filesn = 1;
+	job->status = FC_QUEUED;
+	job->orphan = 0;
+	job->stuck = 0;
+	return job;
+}
+
+/* Wait for the pending jobs to finish. Each job is waited for at most
+ * conf.files_counter_timeout milliseconds since it started running. Jobs
+ * past their deadline are flagged as stuck, and replaced by new threads, so
+ * that queued jobs can still run. Queued jobs are given up only if no
+ * thread is available to run them.
+ * Must be called with the mutex locked. */
+static void
+wait_fc_jobs(void)
+{
+	fc.waiting = 1;
+
+	while (fc.pending > 0) {
+		struct timespec now, wake;
+		clock_gettime(CLOCK_REALTIME, &now);
+		get_fc_deadline(&now, &wake);
+
+		size_t i, live = 0;
+		for (i = 0; i < fc.running_n; i++) {
+			struct fc_job_t *job = fc.running[i];
+			struct timespec deadline;
+			get_fc_deadline(&job->start, &deadline);
+
+			if (timespec_before(&now, &deadline) == 0) {
+				if (job->stuck == 0) {
+					job->stuck = 1;
+					fc.stuck++;
+				}
+				continue;
+			}
+
+			if (job->orphan == 1)
+				continue;
+
+			live++;
+			if (timespec_before(&deadline, &wake) == 1)
+				wake = deadline;
+		}
+
+		if (fc.queued > 0)
+			spawn_fc_workers(fc.queued);
+
+		/* Only stuck jobs left, or queued jobs no thread can run */
+		if (live == 0 && (fc.queued == 0 || fc.threads == fc.stuck))
+			break;
+
+		pthread_cond_broadcast(&fc.work_cond);
+		pthread_cond_timedwait(&fc.done_cond, &fc.mutex, &wake);
+	}
+
+	fc.waiting = 0;
+}
+
+/* Start the queued jobs, wait for them (see wait_fc_jobs()), and store the
+ * result of the N jobs in JOBS in the corresponding entry of LIST.
+ * Must be called with the mutex locked. */
+static void
+run_fc_jobs(struct pf_list_t *list, struct fc_job_t **jobs, const size_t n)
+{
+	if (fc.queued > 0) {
+		spawn_fc_workers(fc.queued);
+		pthread_cond_broadcast(&fc.work_cond);
+	}
+
+	if (fc.pending > 0)
+		wait_fc_jobs();
+
+	size_t i;
+	for (i = 0; i < n; i++) {
+		list->ent[jobs[i]->index].filesn = jobs[i]->status == FC_DONE
+			? jobs[i]->filesn : FC_PENDING;
+	}
+}
+
+/* Count files in all directories (and symlinks to directories) in LIST,
+ * whose entries are located in the directory DIR, storing the result in
+ * the filesn field of each entry. Entries not counted in time are set to
+ * FC_PENDING. See the comment at the top of this file. */
+void
+count_dirs_async(struct pf_list_t *list, const char *dir)
+{
+	if (!list || !dir || init_fc_pipe() == -1)
+		return;
+
+	pthread_mutex_lock(&fc.mutex);
+
+	drain_fc_pipe();
+	fc.notified = 0;
+
+	const int reuse = (fc.reuse == 1 && fc.dir && strcmp(fc.dir, dir) == 0);
+	struct fc_job_t **old = fc.jobs;
+	size_t i, old_n = 0;
+
+	/* Jobs still running are taken by the new list. Finished jobs only
+	 * if reusing results. Dismiss the remaining ones right away */
+	for (i = 0; i < fc.jobs_n; i++) {
+		if (old[i]->status == FC_RUNNING
+		|| (reuse == 1 && old[i]->status == FC_DONE)) {
+			old[old_n++] = old[i];
+		} else {
+			free(old[i]->path);
+			free(old[i]);
+		}
+	}
+
+	const size_t dirs_n = count_countable_dirs(list);
+	struct fc_job_t **jobs = dirs_n > 0
+		? (struct fc_job_t **)xnmalloc(dirs_n, sizeof(struct fc_job_t *))
+		: (struct fc_job_t **)NULL;
+
+	size_t n = 0, cur = 0, queued = 0, pending = 0;
+
+	for (i = 0; i < list->n; i++) {
+		if (!is_countable_dir(&list->ent[i]))
+			continue;
+
+		char *path = make_fc_path(dir, list->ent[i].name);
+
+		struct fc_job_t *job = take_old_job(old, old_n, &cur, path);
+		if (job) {
+			free(path);
+		} else {
+			job = new_fc_job(path);
+			queued++;
+		}
+
+		if (job->status != FC_DONE)
+			pending++;
+		job->index = i;
+		jobs[n++] = job;
+	}
+
+	/* Dismiss jobs of the previous list not taken by the current one */
+	for (i = 0; i < old_n; i++) {
+		if (!old[i])
+			continue;
+		if (old[i]->status == FC_RUNNING) {
+			old[i]->orphan = 1;
+		} else {
+			free(old[i]->path);
+			free(old[i]);
+		}
+	}
+	free(old);
+
+	free(fc.dir);
+	fc.dir = savestring(dir, strlen(dir));
+	fc.jobs = jobs;
+	fc.jobs_n = n;
+	fc.next = 0;
+	fc.pending = pending;
+	fc.queued = queued;
+
+	run_fc_jobs(list, jobs, n);
+
+	pthread_mutex_unlock(&fc.mutex);
+}
+
+/* Same as count_dirs_async(), but for entries just added to the current
+ * list of DIR (see update_dirlist() in listing.c): jobs for the remaining
+ * entries are kept, and only the entries in LIST are waited for (along
+ * with jobs still running within their deadline). */
+void
+count_new_dirs_async(struct pf_list_t *list, const char *dir)
+{
+	if (!list || !dir || init_fc_pipe() == -1)
+		return;
+
+	pthread_mutex_lock(&fc.mutex);
+
+	if (!fc.dir || strcmp(fc.dir, dir) != 0) {
+		/* No jobs for this directory to keep */
+		pthread_mutex_unlock(&fc.mutex);
+		count_dirs_async(list, dir);
+		return;
+	}
+
+	drain_fc_pipe();
+	fc.notified = 0;
+
+	const size_t dirs_n = count_countable_dirs(list);
+	if (dirs_n == 0) {
+		pthread_mutex_unlock(&fc.mutex);
+		return;
+	}
+
+	struct fc_job_t **mine =
+		(struct fc_job_t **)xnmalloc(dirs_n, sizeof(struct fc_job_t *));
+	fc.jobs = (struct fc_job_t **)xrealloc(fc.jobs,
+		(fc.jobs_n + dirs_n) * sizeof(struct fc_job_t *));
+
+	size_t i, j, n = 0, queued = 0;
+	const size_t old_n = fc.jobs_n;
+
+	for (i = 0; i < list->n; i++) {
+		if (!is_countable_dir(&list->ent[i]))
+			continue;
+
+		char *path = make_fc_path(dir, list->ent[i].name);
+
+		struct fc_job_t *job = (struct fc_job_t *)NULL;
+		for (j = 0; j < old_n; j++) {
+			if (strcmp(fc.jobs[j]->path, path) == 0) {
+				job = fc.jobs[j];
+				break;
+			}
+		}
+
+		if (!job) {
+			job = new_fc_job(path);
+			fc.jobs[fc.jobs_n++] = job;
+			fc.pending++;
+			queued++;
+		} else {
+			free(path);
+			/* The directory changed: a finished count is outdated. A running
+			 * one is just waited for (it cannot be cancelled) */
+			if (job->status == FC_DONE) {
+				job->status = FC_QUEUED;
+				fc.pending++;
+				queued++;
+				if (j < fc.next)
+					fc.next = j;
+			}
+		}
+
+		job->index = i;
+		mine[n++] = job;
+	}
+
+	fc.queued += queued;
+	run_fc_jobs(list, mine, n);
+	free(mine);
+
+	pthread_mutex_unlock(&fc.mutex);
+}
+
+/* Return the file descriptor written to whenever new files counter results
+ * are available (call fc_refresh() then), or -1 if there is none. */
+int
+fc_notify_fd(void)
+{
+	return fc.pipe[0];
+}
+
+/* Refresh the files list to print the files counter results available
+ * since the last list. Returns 1 if the list was refreshed, or 0 otherwise. */
+int
+fc_refresh(void)
+{
+	pthread_mutex_lock(&fc.mutex);
+	drain_fc_pipe();
+	fc.notified = 0;
+	const int same_dir = (fc.dir && workspaces && workspaces[cur_ws].path
+		&& strcmp(fc.dir, workspaces[cur_ws].path) == 0);
+	pthread_mutex_unlock(&fc.mutex);
+
+	if (same_dir == 0 || conf.autols == 0 || conf.files_counter == 0
+	|| rl_nohist == 1 || kbind_busy == 1)
+		return 0;
+
+	if (conf.clear_screen == 0)
+		putchar('\n');
+
+	fc.reuse = 1;
+	reload_dirlist();
+	fc.reuse = 0;
+
+	return 1;
+}
+
+/* Return 1 if the files list is being refreshed by fc_refresh(), or 0
+ * otherwise */
+int
+fc_reusing(void)
+{
+	return fc.reuse;
+}
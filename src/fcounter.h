@@ -0,0 +1,47 @@
+/* fcounter.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef FCOUNTER_H
+#define FCOUNTER_H
+
+#include "prefetch.h"
+
+/* Max amount of background threads used to count files */
+#define FC_MAX_THREADS 16
+/* Max amount of threads left behind counting files in directories past
+ * their deadline (say, stale mount points). These are not taken into
+ * account by FC_MAX_THREADS. */
+#define FC_MAX_STUCK_THREADS 64
+
+__BEGIN_DECLS
+
+void count_dirs_async(struct pf_list_t *, const char *);
+void count_new_dirs_async(struct pf_list_t *, const char *);
+int  fc_refresh(void);
+int  fc_notify_fd(void);
+int  fc_reusing(void);
+
+__END_DECLS
+
+#endif /* FCOUNTER_H */
@@ -40,7 +40,6 @@
 #include "exec.h"
 #include "file_operations.h"
 #include "history.h"
-#include "init.h" /* get_sel_files() */
 #include "listing.h"
 #include "mime.h"
 #include "misc.h"
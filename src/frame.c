@@ -0,0 +1,654 @@
+/* frame.c -- print the files list with a single write(2) call */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+
+/* The files list is printed by lots of small printf(3)/fputs(3) calls
+ * (several per entry). Since stdout is line buffered when attached to a
+ * terminal, this means at least one write(2) call per line: slow, and
+ * quite noticeable (flickering) over slow connections, say, SSH.
+ *
+ * The code printing the files list writes instead via the frame_*
+ * functions below. Between frame_begin() and frame_end(), output is
+ * stored in a growable buffer, which is then written all at once by
+ * frame_end(). If SyncUpdates is enabled, the whole frame is enclosed
+ * by the synchronized update sequences (DEC private mode 2026), so that
+ * terminals supporting them draw the new list in one go.
+ * Outside a frame, these functions just write to stdout.
+ *
+ * Differential redraw
+ * If a frame starts by clearing the screen and fits in it, its lines are
+ * kept in memory. The next frame of this kind is compared line by line
+ * against the kept one, and only changed lines are written (via cursor
+ * addressing), followed by an erase below the last line. This is exactly
+ * what the full frame would have drawn, but the amount of bytes written
+ * is proportional to the change, not to the size of the files list.
+ * Since clifm cannot know what the terminal currently shows, the kept
+ * frame is dropped (frame_invalidate()) whenever something else could
+ * have scrolled or cleared the screen: commands (except selection
+ * commands), external programs, error messages, the completions list,
+ * terminal resizing, and Ctrl-l. Lines using anything else than colors,
+ * forward cursor motion, and erase-line sequences, as well as lines
+ * wider than the terminal, disable the differential redraw for the
+ * current frame. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <signal.h> /* sig_atomic_t */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h> /* atoi() */
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+#include <readline/readline.h> /* rl_prompt */
+
+#include "aux.h" /* xrealloc() */
+#include "frame.h"
+
+/* Initial size of the frame buffer. Grown as needed */
+#define FRAME_INIT_SIZE (64 * 1024)
+
+#define BSU "\x1b[?2026h" /* Begin synchronized update */
+#define ESU "\x1b[?2026l" /* End synchronized update */
+#define BSU_LEN (sizeof(BSU) - 1)
+#define ESU_LEN (sizeof(ESU) - 1)
+
+/* Screen lines (besides the prompt lines) which must be left free below a
+ * frame for it to be kept: messages printed after the files list (see
+ * print_reload_msg()), the input line, and the new line ending it. */
+#define FRAME_RESERVED_LINES 4
+
+/* Max length of the SGR (colors) sequences in effect at the beginning of
+ * a line */
+#define FRAME_SGR_MAX 256
+
+#define FRAME_CLEAR_SB_LEN (sizeof(FRAME_CLEAR_SB) - 1)
+#define FRAME_CLEAR_NSB_LEN (sizeof(FRAME_CLEAR_NSB) - 1)
+
+static char *frame_buf = (char *)NULL;
+static size_t frame_len = 0;
+static size_t frame_size = 0;
+/* Nesting level: only the outermost frame_end() writes the buffer */
+static int frame_depth = 0;
+/* Part of the current frame was already written by frame_flush() */
+static int frame_partial = 0;
+
+/* A line as printed in a frame: SGR_LEN bytes of colors in effect when the
+ * line starts, followed by LEN bytes of the line itself (without the
+ * new line char), starting at OFF in the buffer of the screen */
+struct scr_line_t {
+	size_t off;
+	size_t sgr_len;
+	size_t len;
+};
+
+/* The lines of a frame */
+struct scr_t {
+	char *buf;
+	struct scr_line_t *lines;
+	size_t buf_len;
+	size_t buf_size;
+	size_t n;
+	size_t lines_size;
+	unsigned short cols;
+	unsigned short rows;
+	int pad0; /* Keep the struct alignment */
+};
+
+/* SCR_A and SCR_B are swapped: SCR_PREV holds the last frame written,
+ * and SCR_NEXT the one to be written */
+static struct scr_t scr_a = {0}, scr_b = {0};
+static struct scr_t *scr_prev = &scr_a, *scr_next = &scr_b;
+/* Whether the screen still shows SCR_PREV: 0 (no), 1 (yes), or 2 (yes,
+ * but only until frame_release() is called: see frame_hold()). Modified by
+ * a signal handler */
+static volatile sig_atomic_t scr_valid = 0;
+
+/* Differential output is built here */
+static char *diff_buf = (char *)NULL;
+static size_t diff_len = 0;
+static size_t diff_size = 0;
+/* Last cursor visibility sequence found before the first line of the
+ * frame being written */
+static const char *frame_cursor = (const char *)NULL;
+
+/* Make room for at least NEED more bytes in *BUF, a buffer of *SIZE bytes
+ * of which LEN bytes are in use */
+static void
+buf_grow(char **buf, size_t *size, const size_t len, const size_t need)
+{
+	size_t s = *size > 0 ? *size : FRAME_INIT_SIZE;
+	while (s - len < need)
+		s *= 2;
+
+	if (s != *size) {
+		*buf = (char *)xrealloc(*buf, s * sizeof(char));
+		*size = s;
+	}
+}
+
+static void
+frame_grow(const size_t need)
+{
+	buf_grow(&frame_buf, &frame_size, frame_len, need);
+}
+
+static void
+frame_append(const char *s, const size_t len)
+{
+	if (len == 0)
+		return;
+
+	if (frame_size - frame_len < len)
+		frame_grow(len);
+
+	memcpy(frame_buf + frame_len, s, len);
+	frame_len += len;
+}
+
+static void
+diff_append(const char *s, const size_t len)
+{
+	if (diff_size - diff_len < len)
+		buf_grow(&diff_buf, &diff_size, diff_len, len);
+
+	memcpy(diff_buf + diff_len, s, len);
+	diff_len += len;
+}
+
+/* Append a new line to SCR: the SGR_LEN bytes in SGR, followed by the LEN
+ * bytes in LINE */
+static void
+scr_add_line(struct scr_t *scr, const char *sgr, const size_t sgr_len,
+	const char *line, const size_t len)
+{
+	if (scr->n == scr->lines_size) {
+		scr->lines_size = scr->lines_size > 0 ? scr->lines_size * 2 : 64;
+		scr->lines = (struct scr_line_t *)xrealloc(scr->lines,
+			scr->lines_size * sizeof(struct scr_line_t));
+	}
+
+	if (scr->buf_size - scr->buf_len < sgr_len + len)
+		buf_grow(&scr->buf, &scr->buf_size, scr->buf_len, sgr_len + len);
+
+	struct scr_line_t *l = &scr->lines[scr->n++];
+	l->off = scr->buf_len;
+	l->sgr_len = sgr_len;
+	l->len = len;
+
+	memcpy(scr->buf + scr->buf_len, sgr, sgr_len);
+	memcpy(scr->buf + scr->buf_len + sgr_len, line, len);
+	scr->buf_len += sgr_len + len;
+}
+
+/* Return the length of the clear screen sequence (see FRAME_CLEAR) at S,
+ * or zero if S does not start with one */
+static size_t
+clear_seq_len(const char *s, const size_t len)
+{
+	if (len >= FRAME_CLEAR_SB_LEN
+	&& memcmp(s, FRAME_CLEAR_SB, FRAME_CLEAR_SB_LEN) == 0)
+		return FRAME_CLEAR_SB_LEN;
+
+	if (len >= FRAME_CLEAR_NSB_LEN
+	&& memcmp(s, FRAME_CLEAR_NSB, FRAME_CLEAR_NSB_LEN) == 0)
+		return FRAME_CLEAR_NSB_LEN;
+
+	return 0;
+}
+
+/* Check the escape sequence at S (LEN bytes available) in a frame line.
+ * Add the amount of columns it moves the cursor forward to *WIDTH, and
+ * update SGR (colors in effect, SGR_LEN bytes long) if it is a SGR
+ * sequence.
+ * Returns the length of the sequence, or zero if it is not allowed (it
+ * moves the cursor to another line, or it is not recognized), or if SGR
+ * overflows. */
+static size_t
+check_esc_seq(const char *s, const size_t len, size_t *width,
+	char *sgr, size_t *sgr_len)
+{
+	if (len < 3)
+		return 0;
+
+	size_t i;
+
+	if (s[1] == '(') /* Designate G0 charset (ESC ( C) */
+		return 3;
+
+	if (s[1] == ']') { /* OSC (e.g. hyperlinks): ended by BEL or ESC \ */
+		for (i = 2; i < len; i++) {
+			if (s[i] == '\a')
+				return i + 1;
+			if (s[i] == 0x1b && i + 1 < len && s[i + 1] == '\\')
+				return i + 2;
+		}
+		return 0;
+	}
+
+	if (s[1] != '[')
+		return 0;
+
+	/* CSI: parameter and intermediate bytes, followed by a final byte */
+	for (i = 2; i < len && s[i] >= 0x20 && s[i] <= 0x3f; i++);
+	if (i == len || s[i] < 0x40 || s[i] > 0x7e)
+		return 0;
+
+	const size_t seq_len = i + 1;
+
+	switch (s[i]) {
+	case 'm': { /* SGR */
+		/* Does it start by resetting attributes (empty or zero parameter)? */
+		size_t j = 2;
+		while (s[j] == '0')
+			j++;
+		if (s[j] == 'm' || s[j] == ';')
+			*sgr_len = 0;
+		if (*sgr_len + seq_len > FRAME_SGR_MAX)
+			return 0;
+		memcpy(sgr + *sgr_len, s, seq_len);
+		*sgr_len += seq_len;
+		return seq_len;
+	}
+
+	case 'C': { /* CUF */
+		const int n = (i > 2 && s[2] >= '0' && s[2] <= '9')
+			? atoi(s + 2) : 1;
+		*width += n > 0 ? (size_t)n : 1;
+		return seq_len;
+	}
+
+	case 'K': /* EL */
+	case 'h': /* SM (e.g. cursor visibility) */
+	case 'l': /* RM */
+		return seq_len;
+
+	default: return 0;
+	}
+}
+
+/* Split the frame in S (LEN bytes) into lines, and store them into
+ * SCR_NEXT.
+ * Returns 0 on success, or -1 if the frame cannot be drawn differentially:
+ * it does not start by clearing the screen, it contains control chars or
+ * sequences moving the cursor to another line, it has lines wider than
+ * the terminal, or it does not leave enough room for the prompt. */
+static int
+load_screen(const char *s, const size_t len)
+{
+	const char *end = s + len;
+	size_t n = clear_seq_len(s, len);
+	if (n == 0 || !rl_prompt)
+		return (-1);
+
+	/* Several clear screen and cursor visibility sequences may precede the
+	 * first line */
+	frame_cursor = (const char *)NULL;
+	while (s + n < end) {
+		const size_t l = clear_seq_len(s + n, (size_t)(end - s - n));
+		if (l > 0) {
+			n += l;
+		} else if ((size_t)(end - s - n) >= 6 && memcmp(s + n, "\x1b[?25", 5) == 0
+		&& (s[n + 5] == 'l' || s[n + 5] == 'h')) {
+			frame_cursor = s[n + 5] == 'l' ? "\x1b[?25l" : "\x1b[?25h";
+			n += 6;
+		} else {
+			break;
+		}
+	}
+
+	/* Keep room for the prompt (below the files list) */
+	size_t max_lines = FRAME_RESERVED_LINES + 1;
+	const char *q;
+	for (q = rl_prompt; *q; q++) {
+		if (*q == '\n')
+			max_lines++;
+	}
+
+	if (term_lines <= max_lines || term_cols == 0)
+		return (-1);
+	max_lines = (size_t)term_lines - max_lines;
+
+	struct scr_t *scr = scr_next;
+	scr->n = scr->buf_len = 0;
+	scr->cols = term_cols;
+	scr->rows = term_lines;
+
+	char sgr[FRAME_SGR_MAX];
+	size_t sgr_len = 0;
+	mbstate_t ps;
+	memset(&ps, 0, sizeof(mbstate_t));
+
+	const char *p = s + n;
+	while (1) {
+		const char *line = p;
+		char line_sgr[FRAME_SGR_MAX];
+		const size_t line_sgr_len = sgr_len;
+		memcpy(line_sgr, sgr, sgr_len);
+		size_t width = 0;
+
+		while (p < end && *p != '\n') {
+			const unsigned char c = (unsigned char)*p;
+
+			if (c == 0x1b) {
+				const size_t l = check_esc_seq(p, (size_t)(end - p), &width,
+					sgr, &sgr_len);
+				if (l == 0)
+					return (-1);
+				p += l;
+			} else if (c < 0x20 || c == 0x7f) {
+				return (-1);
+			} else if (c < 0x80) {
+				width++;
+				p++;
+			} else {
+				wchar_t wc;
+				const size_t l = mbrtowc(&wc, p, (size_t)(end - p), &ps);
+				if (l == (size_t)-1 || l == (size_t)-2 || l == 0)
+					return (-1);
+				const int w = wcwidth(wc);
+				if (w < 0)
+					return (-1);
+				width += (size_t)w;
+				p += l;
+			}
+		}
+
+		if (width > term_cols)
+			return (-1);
+
+		scr_add_line(scr, line_sgr, line_sgr_len, line, (size_t)(p - line));
+
+		if (p == end)
+			break;
+
+		p++; /* Skip the new line char */
+		if (scr->n > max_lines)
+			return (-1);
+	}
+
+	return 0;
+}
+
+static int
+same_line(const struct scr_t *a, const struct scr_t *b, const size_t i)
+{
+	const struct scr_line_t *la = &a->lines[i];
+	const struct scr_line_t *lb = &b->lines[i];
+
+	return (la->sgr_len == lb->sgr_len && la->len == lb->len
+		&& memcmp(a->buf + la->off, b->buf + lb->off,
+		la->sgr_len + la->len) == 0);
+}
+
+/* Move the cursor to line I of SCR_NEXT, erase it via ERASE, and print
+ * the line */
+static void
+diff_add_line(const size_t i, const char *erase)
+{
+	char seq[48];
+	const int n = snprintf(seq, sizeof(seq), "\x1b[%zu;1H\x1b[0m%s", i + 1,
+		erase);
+	if (n > 0)
+		diff_append(seq, (size_t)n);
+
+	const struct scr_line_t *l = &scr_next->lines[i];
+	diff_append(scr_next->buf + l->off, l->sgr_len + l->len);
+}
+
+/* Print into DIFF_BUF only those lines in SCR_NEXT which differ from the
+ * ones in SCR_PREV (currently on screen). The last line of the frame
+ * (usually empty) is always printed, followed by an erase below, so that
+ * the screen and the cursor position are left exactly as the whole frame
+ * would have left them. */
+static void
+build_diff(void)
+{
+	diff_len = 0;
+	if (conf.sync_updates == 1)
+		diff_append(BSU, BSU_LEN);
+	if (frame_cursor)
+		diff_append(frame_cursor, strlen(frame_cursor));
+
+	/* The last line of the previous frame was followed by the prompt */
+	const size_t prev_n = scr_prev->n - 1;
+	const size_t last = scr_next->n - 1;
+	size_t i;
+
+	for (i = 0; i < last; i++) {
+		if (i < prev_n && same_line(scr_prev, scr_next, i))
+			continue;
+		diff_add_line(i, "\x1b[2K");
+	}
+
+	diff_add_line(last, "\x1b[J");
+
+	if (conf.sync_updates == 1)
+		diff_append(ESU, ESU_LEN);
+}
+
+static void
+write_all(const char *p, size_t n)
+{
+	while (n > 0) {
+		const ssize_t ret = write(STDOUT_FILENO, p, n);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		p += ret;
+		n -= (size_t)ret;
+	}
+}
+
+/* Write the frame buffer to stdout and empty it. If possible, only the
+ * differences with the previous frame are written */
+static void
+frame_write(void)
+{
+	const size_t start = conf.sync_updates == 1 ? BSU_LEN : 0;
+	if (frame_len <= start)
+		goto END;
+
+	int diff = 0;
+	if (frame_partial == 0
+	&& load_screen(frame_buf + start, frame_len - start) == 0) {
+		if (scr_valid != 0 && scr_prev->n > 0
+		&& scr_prev->cols == scr_next->cols
+		&& scr_prev->rows == scr_next->rows) {
+			build_diff();
+			diff = diff_len < frame_len - start;
+		}
+
+		struct scr_t *tmp = scr_prev;
+		scr_prev = scr_next;
+		scr_next = tmp;
+		scr_valid = 1;
+	} else {
+		scr_valid = 0;
+	}
+
+	if (conf.sync_updates == 1)
+		frame_append(ESU, ESU_LEN);
+
+	/* Just in case something was printed via stdio in the meanwhile */
+	fflush(stdout);
+
+	if (diff == 1)
+		write_all(diff_buf, diff_len);
+	else
+		write_all(frame_buf, frame_len);
+
+END:
+	frame_len = 0;
+}
+
+/* Start a new frame: output is buffered until frame_end() is called */
+void
+frame_begin(void)
+{
+	if (frame_depth++ > 0)
+		return;
+
+	fflush(stdout);
+	frame_len = 0;
+	frame_partial = 0;
+	if (conf.sync_updates == 1)
+		frame_append(BSU, BSU_LEN);
+}
+
+/* Write the current frame and stop buffering output */
+void
+frame_end(void)
+{
+	if (frame_depth == 0 || --frame_depth > 0)
+		return;
+
+	frame_write();
+}
+
+/* Write what has been buffered so far, without closing the frame. Used
+ * before waiting for user input (e.g. the pager), running external
+ * commands, or exiting. */
+void
+frame_flush(void)
+{
+	if (frame_depth == 0) {
+		fflush(stdout);
+		return;
+	}
+
+	/* What follows does not start by clearing the screen */
+	frame_partial = 1;
+	frame_write();
+	if (conf.sync_updates == 1)
+		frame_append(BSU, BSU_LEN);
+}
+
+/* The screen may no longer show the last frame written (something else
+ * was printed, or the screen was cleared or resized): the next frame will
+ * be written as a whole. Async-signal-safe. */
+void
+frame_invalidate(void)
+{
+	scr_valid = 0;
+}
+
+/* Used before running a command which may print a new files list, but
+ * nothing else (unless it fails, in which case the error message calls
+ * frame_invalidate()): the new list can be written differentially. */
+void
+frame_hold(void)
+{
+	if (scr_valid == 1)
+		scr_valid = 2;
+}
+
+/* Used after running the command: if it did not print a new list, assume
+ * it printed something else. */
+void
+frame_release(void)
+{
+	if (scr_valid == 2)
+		scr_valid = 0;
+}
+
+__attribute__((__format__(__printf__, 1, 2)))
+int
+frame_printf(const char *fmt, ...)
+{
+	va_list arglist, tmp_list;
+	va_start(arglist, fmt);
+
+	if (frame_depth == 0) {
+		const int ret = vprintf(fmt, arglist);
+		va_end(arglist);
+		return ret;
+	}
+
+	size_t avail = frame_size - frame_len;
+	va_copy(tmp_list, arglist);
+	const int ret = vsnprintf(avail > 0 ? frame_buf + frame_len
+		: (char *)NULL, avail, fmt, tmp_list);
+	va_end(tmp_list);
+
+	if (ret >= 0 && (size_t)ret >= avail) {
+		/* Not enough room: grow the buffer and try again */
+		frame_grow((size_t)ret + 1);
+		avail = frame_size - frame_len;
+		vsnprintf(frame_buf + frame_len, avail, fmt, arglist);
+	}
+
+	va_end(arglist);
+
+	if (ret > 0)
+		frame_len += (size_t)ret;
+
+	return ret;
+}
+
+void
+frame_putchar(const int c)
+{
+	if (frame_depth == 0) {
+		putchar(c);
+		return;
+	}
+
+	if (frame_len == frame_size)
+		frame_grow(1);
+
+	frame_buf[frame_len++] = (char)c;
+}
+
+/* Like fputs(S, stdout) */
+void
+frame_puts(const char *s)
+{
+	if (frame_depth == 0)
+		fputs(s, stdout);
+	else
+		frame_append(s, strlen(s));
+}
+
+void
+free_frame(void)
+{
+	free(frame_buf);
+	frame_buf = (char *)NULL;
+	frame_len = frame_size = 0;
+
+	free(diff_buf);
+	diff_buf = (char *)NULL;
+	diff_len = diff_size = 0;
+
+	free(scr_a.buf);
+	free(scr_a.lines);
+	free(scr_b.buf);
+	free(scr_b.lines);
+	scr_a = scr_b = (struct scr_t){0};
+	scr_valid = 0;
+}
@@ -0,0 +1,63 @@
+/* frame.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+/* Frame versions of some of the terminal escape sequences defined in
+ * helpers.h, to be used while printing the files list */
+#define FRAME_CLEAR_SB  "\x1b[H\x1b[2J\x1b[3J" /* Also delete scrollback */
+#define FRAME_CLEAR_NSB "\x1b[H\x1b[J"
+#define FRAME_CLEAR \
+	if (term_caps.home == 1 && term_caps.clear == 1) { \
+		if (term_caps.del_scrollback == 1)             \
+			frame_puts(FRAME_CLEAR_SB);                \
+		else                                           \
+			frame_puts(FRAME_CLEAR_NSB);               \
+	}
+
+#define FRAME_MOVE_CURSOR_DOWN(n)  frame_printf("\x1b[%dB", (n)) /* CUD */
+#define FRAME_MOVE_CURSOR_RIGHT(n) frame_printf("\x1b[%dC", (n)) /* CUF */
+#define FRAME_ERASE_TO_RIGHT       frame_puts("\x1b[0K") /* EL0 */
+#define FRAME_HIDE_CURSOR \
+	frame_puts(term_caps.hide_cursor == 1 ? "\x1b[?25l" : "") /* DECTCEM */
+#define FRAME_UNHIDE_CURSOR \
+	frame_puts(term_caps.hide_cursor == 1 ? "\x1b[?25h" : "")
+
+__BEGIN_DECLS
+
+void frame_begin(void);
+void frame_end(void);
+void frame_flush(void);
+void frame_hold(void);
+void frame_invalidate(void);
+int  frame_printf(const char *, ...);
+void frame_putchar(const int);
+void frame_puts(const char *);
+void frame_release(void);
+void free_frame(void);
+
+__END_DECLS
+
+#endif /* FRAME_H */
@@ -32,6 +32,7 @@
 # include <sys/sysmacros.h> /* major() and minor(), used by get_dev_name() */
 # include "linuxfs.h" /* FS_MAGIC macros for file system types */
 # include "aux.h" /* open_fread() */
+# include "startup.h" /* run_startup_task() */
 #elif defined(HAVE_STATFS)
 # include <sys/mount.h> /* statfs(2) */
 #endif /* __linux__ */
@@ -41,14 +42,17 @@
  * Returns a pointer to a constant string with the proper name. If none is
  * found a generic "ext2/3/4" is returned.
  *
- * This function just checks information gathered at startup, which is way
- * faster than performing the whole thing each time it is needed. However,
- * File systems mounted in the current session won't be checked here. */
+ * This function just checks information gathered at startup (loaded on
+ * first use: see startup.c), which is way faster than performing the whole
+ * thing each time it is needed. However, File systems mounted in the
+ * current session won't be checked here. */
 static char *
 get_ext_fs_type(const char *file)
 {
 	char *type = "ext2/3/4";
 
+	run_startup_task(STARTUP_EXT_MOUNTPOINTS);
+
 	if (!ext_mnt || !file)
 		return type;
 
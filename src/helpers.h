@@ -353,6 +353,22 @@ if (S_ISNWK(mode)) return 'n'; // HP/UX: network special file
 # if defined(STATX_TYPE) && (!defined(__ANDROID__) || __ANDROID_API__ >= 30)
 #  define LINUX_STATX
 # endif /* STATX_TYPE */
+/* Batched statx(2) calls via io_uring(7) to gather files information for
+ * the files list (opt-in: compile with -DUSE_IO_URING) */
+# if defined(USE_IO_URING) && defined(LINUX_STATX) \
+&& LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#  define LINUX_IO_URING
+# endif /* USE_IO_URING && LINUX_STATX && LINUX_VERSION (5.6) */
+/* Read directories in big batches via getdents64(2) instead of readdir(3).
+ * See read_dirbuf() and count_dir() in aux.c */
+# define LINUX_GETDENTS
+/* Size of the buffer used to read directory entries. The bigger the buffer,
+ * the less system calls are needed to read big directories (the default
+ * buffer used by readdir(3) is 32KiB in glibc, and 2KiB in musl). It can
+ * be tuned at compile time: -DGETDENTS_BUF_SIZE=BYTES */
+# ifndef GETDENTS_BUF_SIZE
+#  define GETDENTS_BUF_SIZE (256 * 1024)
+# endif /* !GETDENTS_BUF_SIZE */
 # if !defined(__GLIBC__) || (__GLIBC__ > 2 \
 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 3))
 #  if LINUX_VERSION_CODE >= KERNEL_VERSION(2,4,0)
@@ -843,6 +859,7 @@ extern time_t curdir_mtime;
 
 #define UNUSED(x) (void)(x) /* Just silence the compiler's warning */
 #define TOUPPER(c) (((c) >= 'a' && (c) <= 'z') ? ((c) - 'a' + 'A') : (c))
+#define TOLOWER(c) (((c) >= 'A' && (c) <= 'Z') ? ((c) - 'A' + 'a') : (c))
 
 /* UINT_MAX is 4294967295 == 10 digits */
 #define DIGINUM(n) (((n) < 10) ? 1 \
@@ -896,12 +913,14 @@ extern time_t curdir_mtime;
 				|| strcmp((s), "--help") == 0))
 
 /* TERMINAL ESCAPE CODES */
+/* NOTE: frame.h must be included to use CLEAR (see frame_invalidate()) */
 #define CLEAR \
 	if (term_caps.home == 1 && term_caps.clear == 1) { \
 		if (term_caps.del_scrollback == 1)             \
 			fputs("\x1b[H\x1b[2J\x1b[3J", stdout);     \
 		else                                           \
 			fputs("\x1b[H\x1b[J", stdout);             \
+		frame_invalidate();                            \
 	}
 
 #define MOVE_CURSOR_DOWN(n)      printf("\x1b[%dB", (n))  /* CUD */
@@ -984,6 +1003,10 @@ extern time_t curdir_mtime;
  * 32-bit/ARM: INT_MAX == LONG_MAX == SSIZE_MAX < SIZE_MAX < INTMAX_MAX == LLONG_MAX
  * 64-bit:     INT_MAX < LONG_MAX == LLONG_MAX == INTMAX_MAX == SSIZE_MAX < SIZE_MAX */
 #define FILESN_MAX SSIZE_MAX
+/* Value of the filesn field of a directory whose files are still being
+ * counted in the background (see fcounter.c) */
+#define FC_PENDING (-FILESN_MAX)
+#define FC_PENDING_CHR '?'
 typedef ssize_t filesn_t;
 extern filesn_t files;
 
@@ -1024,18 +1047,24 @@ struct config_t {
 	int cp_cmd;
 	int desktop_notifications;
 	int dirhist_map;
+	int dir_size_cache;
 	int disk_usage;
 	int ext_cmd_ok;
 	int files_counter;
+	int files_counter_timeout;
 	int full_dir_size;
 	int fuzzy_match;
 	int fuzzy_match_algo;
 	int fzf_preview;
 	int highlight;
 	int icons;
+	int lazy_stat_timeout;
 	int light_mode;
 	int list_dirs_first;
+	int listing_cache;
+	int listing_cache_size;
 	int listing_mode;
+	int listing_threads;
 	int log_cmds;
 	int log_msgs;
 	int long_view;
@@ -1047,12 +1076,15 @@ struct config_t {
 	int max_name_len_bk;
 	int max_path;
 	int max_printselfiles;
+	int max_refresh_latency;
 	int min_jump_rank;
 	int min_name_trim;
+	int min_refresh_interval;
 	int mv_cmd;
 	int no_eln;
 	int only_dirs;
 	int pager;
+	int pager_window;
 	int purge_jumpdb;
 	int print_selfiles;
 	int private_ws_settings;
@@ -1069,6 +1101,7 @@ struct config_t {
 	int splash_screen;
 	int suggest_filetype_color;
 	int suggestions;
+	int sync_updates;
 	int tips;
 	int trim_names;
 #ifndef _NO_TRASH
@@ -1079,7 +1112,6 @@ struct config_t {
 	int unicode;
 	int warning_prompt;
 	int welcome_message;
-	int pad2;
 };
 
 extern struct config_t conf;
@@ -1185,14 +1217,20 @@ struct fileinfo {
 	char *icon;
 	char *icon_color;
 	char *name;
+	char *sort_key; /* Precomputed name sort key (see name_sort_key()) */
 	filesn_t filesn;
+	filesn_t dir_index; /* Position in directory order (see load_entry()) */
 	size_t len;   /* File name len (columns needed to display file name) */
 	size_t bytes; /* Bytes consumed by file name */
+	size_t sort_key_len;
 #if defined(__arm__) && !defined(__ANDROID__)
 	size_t pad0;
 #endif /* __arm__ && !__ANDROID__ */
 	time_t ltime; /* For long view mode */
-	time_t time;
+	time_t atime; /* Times for sorting (btime is zero unless needed, see */
+	time_t btime; /* load_entry()) */
+	time_t ctime;
+	time_t mtime;
 	ino_t inode;
 	off_t size;
 	dev_t rdev; /* 4 bytes in OpenBSD (used to calculate major and minor devs in long view) */
@@ -1367,6 +1405,7 @@ struct param_t {
 	int sort;
 	int sort_reverse;
 	int splash;
+	int startup_profile;
 	int stat;
 	int stealth_mode;
 #ifndef _NO_SUGGESTIONS
@@ -1560,7 +1599,7 @@ struct ext_t {
 	char  *value;
 	size_t len; /* Name length */
 	size_t value_len;
-//	size_t hash;
+	size_t hash; /* See ext_hash() */
 };
 extern struct ext_t *ext_colors;
 
@@ -1745,13 +1784,8 @@ extern size_t
 	trash_n,
 	usrvar_n,
 	words_num,
-	zombies;
-
-#ifndef _NO_ICONS
-extern size_t *name_icons_hashes;
-extern size_t *dir_icons_hashes;
-extern size_t *ext_icons_hashes;
-#endif /* !_NO_ICONS */
+	zombies,
+	*bin_commands_idx;
 
 extern struct termios shell_tmodes;
 extern pid_t own_pid;
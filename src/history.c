@@ -34,6 +34,7 @@
 #include "aux.h"
 #include "checks.h"
 #include "exec.h"
+#include "frame.h"
 #include "history.h"
 #include "init.h"
 #include "misc.h"
@@ -375,6 +376,7 @@ log_msg(char *_msg, const int print_prompt, const int logme,
 			print_msg = 1;
 	} else {
 		fputs(_msg, stderr);
+		frame_invalidate();
 	}
 
 	if (xargs.stealth_mode == 1 || config_ok == 0 || !msgs_log_file
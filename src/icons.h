@@ -433,6 +433,10 @@ char
 #define DEF_FILE_ICON ICON_REG
 #define DEF_FILE_ICON_COLOR WHITE
 
+/* The tables below are looked up via binary search (see find_icon() in
+ * listing.c): entries MUST be kept sorted case-insensitively (ASCII,
+ * comparing uppercased bytes), and names must be unique. */
+
 /* Per file extension icons */
 struct icons_t icon_ext[] = {
     {"7z", ICON_ARCHIVE, YELLOW},
@@ -455,14 +459,14 @@ struct icons_t icon_ext[] = {
 
     {"c", ICON_C, BLUE},
     {"c++", ICON_CPP, WHITE},
-    {"cabal", ICON_HASKELL, BLUE},
     {"cab", ICON_ARCHIVE, YELLOW},
+    {"cabal", ICON_HASKELL, BLUE},
     {"cbr", ICON_ARCHIVE, YELLOW},
     {"cbz", ICON_ARCHIVE, YELLOW},
     {"cc", ICON_CPP, WHITE},
     {"cfg", ICON_CONF, WHITE},
-    {"clifm", ICON_CONF, WHITE},
     {"class", ICON_JAVA, B_WHITE},
+    {"clifm", ICON_CONF, WHITE},
     {"clj", ICON_CLOJURE, GREEN},
     {"cljc", ICON_CLOJURE, GREEN},
     {"cljs", ICON_CLOJURE, GREEN},
@@ -478,8 +482,8 @@ struct icons_t icon_ext[] = {
     {"cvs", ICON_CONF, WHITE},
     {"cxx", ICON_CPP, WHITE},
 
-    {"dat", ICON_BINARY, WHITE},
     {"dart", ICON_DART, BLUE},
+    {"dat", ICON_BINARY, WHITE},
     {"db", ICON_DATABASE, WHITE},
     {"deb", ICON_DEBIAN, RED},
     {"diff", ICON_DIFF, WHITE},
@@ -512,8 +516,8 @@ struct icons_t icon_ext[] = {
 
     {"gem", ICON_ARCHIVE, YELLOW},
     {"gif", ICON_IMG, GREEN},
-    {"gpg", ICON_LOCK, YELLOW},
     {"go", ICON_GO, YELLOW},
+    {"gpg", ICON_LOCK, YELLOW},
     {"gz", ICON_ARCHIVE, YELLOW},
     {"gzip", ICON_ARCHIVE, YELLOW},
 
@@ -522,12 +526,12 @@ struct icons_t icon_ext[] = {
     {"heex", ICON_ELIXIR, BLUE},
     {"hh", ICON_CPP, WHITE},
     {"hpp", ICON_CPP, WHITE},
-    {"htaccess", ICON_CONF, WHITE},
-    {"htpasswd", ICON_CONF, WHITE},
     {"hrl", ICON_ERLANG, RED},
     {"hs", ICON_HASKELL, BLUE},
+    {"htaccess", ICON_CONF, WHITE},
     {"htm", ICON_HTML, WHITE},
     {"html", ICON_HTML, WHITE},
+    {"htpasswd", ICON_CONF, WHITE},
     {"hxx", ICON_CPP, WHITE},
 
     {"ico", ICON_IMG, GREEN},
@@ -547,9 +551,9 @@ struct icons_t icon_ext[] = {
 
     {"key", ICON_KEY, YELLOW},
     {"ko", ICON_BINARY, WHITE},
+    {"ksh", ICON_SCRIPT, WHITE},
     {"kt", ICON_KOTLIN, BLUE},
     {"kts", ICON_KOTLIN, BLUE},
-    {"ksh", ICON_SCRIPT, WHITE},
 
     {"lha", ICON_ARCHIVE, YELLOW},
     {"lhs", ICON_HASKELL, BLUE},
@@ -578,8 +582,8 @@ struct icons_t icon_ext[] = {
 
     {"o", ICON_BINARY, WHITE},
     {"odp", ICON_OPENOFFICE, BLUE},
-    {"odt", ICON_OPENOFFICE, BLUE},
     {"ods", ICON_OPENOFFICE, BLUE},
+    {"odt", ICON_OPENOFFICE, BLUE},
     {"ogg", ICON_AUDIO, YELLOW},
     {"ogv", ICON_VID, BLUE},
     {"opdownload", ICON_DOWNLOADS, WHITE},
@@ -589,8 +593,8 @@ struct icons_t icon_ext[] = {
 
     {"part", ICON_DOWNLOADS, WHITE},
     {"patch", ICON_PATCH, WHITE},
-    {"pem", ICON_KEY, YELLOW},
     {"pdf", ICON_PDF, RED},
+    {"pem", ICON_KEY, YELLOW},
     {"pgn", ICON_CHESS, WHITE},
     {"php", ICON_PHP, WHITE},
     {"pl", ICON_PERL, YELLOW},
@@ -602,19 +606,19 @@ struct icons_t icon_ext[] = {
     {"pptx", ICON_POWERPOINT, YELLOW},
     {"ps", ICON_POSTSCRIPT, RED},
     {"psb", ICON_PHOTOSHOP, WHITE},
-    {"psv", ICON_PHOTOSHOP, WHITE},
     {"psd", ICON_PHOTOSHOP, WHITE},
+    {"psv", ICON_PHOTOSHOP, WHITE},
     {"py", ICON_PYTHON, GREEN},
     {"pyc", ICON_PYTHON, GREEN},
     {"pyd", ICON_PYTHON, GREEN},
     {"pyo", ICON_PYTHON, GREEN},
 
     {"r", ICON_R, WHITE},
-    {"rda", ICON_R, WHITE},
-    {"rdata", ICON_R, WHITE},
     {"rar", ICON_ARCHIVE, YELLOW},
     {"rb", ICON_RUBY, RED},
     {"rc", ICON_CONF, WHITE},
+    {"rda", ICON_R, WHITE},
+    {"rdata", ICON_R, WHITE},
     {"rlib", ICON_RUST, WHITE},
     {"rom", ICON_ROM, WHITE},
     {"rpm", ICON_REDHAT, RED},
@@ -663,11 +667,11 @@ struct icons_t icon_ext[] = {
 
     {"xbps", ICON_ARCHIVE, YELLOW},
     {"xcf", ICON_IMG, GREEN},
-    {"xthml", ICON_HTML, WHITE},
     {"xls", ICON_EXCEL, GREEN},
     {"xlsx", ICON_EXCEL, GREEN},
     {"xml", ICON_CODE, WHITE},
     {"xs", ICON_PERL, YELLOW},
+    {"xthml", ICON_HTML, WHITE},
     {"xz", ICON_ARCHIVE, RED},
 
     {"yaml", ICON_CONF, WHITE},
@@ -682,14 +686,14 @@ struct icons_t icon_ext[] = {
 struct icons_t icon_dirnames[] = {
 /* Translated version for these dirs should be added here
  * See https://github.com/alexanderjeurissen/ranger_devicons/blob/main/devicons.py*/
-    {"home", ICON_HOME, DEF_DIR_ICON_COLOR},
-    {".git", ICON_DOTGIT, DEF_DIR_ICON_COLOR},
     {".config", ICON_CONFIGURE, DEF_DIR_ICON_COLOR},
+    {".git", ICON_DOTGIT, DEF_DIR_ICON_COLOR},
     {"Desktop", ICON_DESKTOP, DEF_DIR_ICON_COLOR},
     {"Documents", ICON_DOCUMENTS, DEF_DIR_ICON_COLOR},
     {"Downloads", ICON_DOWNLOADS, DEF_DIR_ICON_COLOR},
     {"Dropbox", ICON_DROPBOX, DEF_DIR_ICON_COLOR},
     {"games", ICON_GAMES, DEF_DIR_ICON_COLOR},
+    {"home", ICON_HOME, DEF_DIR_ICON_COLOR},
     {"Music", ICON_MUSIC, DEF_DIR_ICON_COLOR},
     {"Pictures", ICON_PICTURES, DEF_DIR_ICON_COLOR},
     {"Public", ICON_PUBLIC, DEF_DIR_ICON_COLOR},
@@ -701,10 +705,10 @@ struct icons_t icon_dirnames[] = {
 /* Icons for some specific file names */
 struct icons_t icon_filenames[] = {
 /* More specific filenames from here https://github.com/alexanderjeurissen/ranger_devicons/blob/main/devicons.py */
+    {".bashrc", ICON_CONF, WHITE},
     {".bash_history", ICON_CONF, WHITE},
     {".bash_logout", ICON_CONF, WHITE},
     {".bash_profile", ICON_CONF, WHITE},
-    {".bashrc", ICON_CONF, WHITE},
     {".gitconfig", ICON_CONF, WHITE},
     {".gitignore", ICON_CONF, WHITE},
     {".inputrc", ICON_CONF, WHITE},
@@ -200,9 +200,12 @@ init_conf_struct(void)
 	conf.cp_cmd = UNSET;
 	conf.desktop_notifications = UNSET;
 	conf.dirhist_map = UNSET;
+	conf.dir_size_cache = UNSET;
 	conf.disk_usage = UNSET;
 	conf.ext_cmd_ok = UNSET;
 	conf.files_counter = UNSET;
+	conf.files_counter_timeout = UNSET;
+	conf.lazy_stat_timeout = UNSET;
 	conf.full_dir_size = UNSET;
 	conf.fuzzy_match = UNSET;
 	conf.fuzzy_match_algo = UNSET;
@@ -219,7 +222,10 @@ init_conf_struct(void)
 #endif /* !_NO_ICONS */
 	conf.light_mode = UNSET;
 	conf.list_dirs_first = UNSET;
+	conf.listing_cache = UNSET;
+	conf.listing_cache_size = UNSET;
 	conf.listing_mode = UNSET;
+	conf.listing_threads = UNSET;
 	conf.log_cmds = UNSET;
 	conf.log_msgs = UNSET;
 	conf.long_view = UNSET;
@@ -234,12 +240,15 @@ init_conf_struct(void)
 
 	conf.max_path = UNSET;
 	conf.max_printselfiles = UNSET;
+	conf.max_refresh_latency = UNSET;
 	conf.min_jump_rank = JUMP_UNSET; /* UNSET (-1) is a valid value for MinJumpRank */
 	conf.min_name_trim = UNSET;
+	conf.min_refresh_interval = UNSET;
 	conf.mv_cmd = UNSET;
 	conf.no_eln = UNSET;
 	conf.only_dirs = UNSET;
 	conf.pager = UNSET;
+	conf.pager_window = UNSET;
 	conf.private_ws_settings = UNSET;
 	conf.purge_jumpdb = UNSET;
 
@@ -257,6 +266,7 @@ init_conf_struct(void)
 	conf.splash_screen = UNSET;
 	conf.suggest_filetype_color = UNSET;
 	conf.suggestions = UNSET;
+	conf.sync_updates = UNSET;
 	conf.tips = UNSET;
 
 	conf.trim_names = UNSET;
@@ -1653,6 +1663,7 @@ unset_xargs(void)
 	xargs.sort = UNSET;
 	xargs.sort_reverse = UNSET;
 	xargs.splash = UNSET;
+	xargs.startup_profile = UNSET;
 
 	xargs.stat = 0;
 
@@ -1744,79 +1755,6 @@ init_shell(void)
 	tcgetattr(STDIN_FILENO, &shell_tmodes);
 }
 
-/* Get current entries in the Selection Box, if any. */
-int
-get_sel_files(void)
-{
-	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
-		return EXIT_FAILURE;
-
-	size_t selnbk = sel_n;
-	/* First, clear the sel array, in case it was already used. */
-	if (sel_n > 0) {
-		int i = (int)sel_n;
-		while (--i >= 0)
-			free(sel_elements[i].name);
-	}
-	sel_n = 0;
-
-	/* Open the tmp sel file and load its contents into the sel array. */
-	int fd;
-	FILE *fp = open_fread(sel_file, &fd);
-	/*  sel_elements = xcalloc(1, sizeof(char *)); */
-	if (!fp)
-		return EXIT_FAILURE;
-
-	struct stat a;
-	/* Since this file contains only paths, PATH_MAX should be enough. */
-	char line[PATH_MAX];
-	while (fgets(line, (int)sizeof(line), fp) != NULL) {
-		size_t len = strlen(line);
-		if (len == 0) continue;
-
-		if (line[len - 1] == '\n') {
-			len--;
-			line[len] = '\0';
-		}
-
-		/* Remove the ending slash: fstatat() won't take a symlink to dir as
-		 * a symlink (but as a dir), if the file name ends with a slash. */
-		if (len > 1 && line[len - 1] == '/') {
-			len--;
-			line[len] = '\0';
-		}
-
-		if (!*line || *line == '#' || len == 0)
-			continue;
-
-		if (fstatat(XAT_FDCWD, line, &a, AT_SYMLINK_NOFOLLOW) == -1)
-			continue;
-
-		sel_elements = (struct sel_t *)xrealloc(sel_elements,
-				(sel_n + 2) * sizeof(struct sel_t));
-		sel_elements[sel_n].name = savestring(line, len);
-		sel_elements[sel_n].size = (off_t)UNSET;
-		/* Store device and inode number to identify later selected files
-		 * and mark them in the files list. */
-		sel_devino = (struct devino_t *)xrealloc(sel_devino,
-				(sel_n + 1) * sizeof(struct devino_t));
-		sel_devino[sel_n].ino = a.st_ino;
-		sel_devino[sel_n].dev = a.st_dev;
-		sel_n++;
-		sel_elements[sel_n].name = (char *)NULL;
-		sel_elements[sel_n].size = (off_t)UNSET;
-	}
-
-	fclose(fp);
-	/* If previous and current amount of sel files don't match (mostly
-	 * because some selected files were removed), recreate the selections
-	 * file to reflect current state. */
-	if (selnbk != sel_n)
-		save_sel();
-
-	return EXIT_SUCCESS;
-}
-
 /* Store each path in CDPATH env variable into an array (CDPATHS)
  * Returns the number of paths found or zero if none */
 size_t
@@ -2150,55 +2088,314 @@ skip_this_path(char *name)
 	return 0;
 }
 
-/* Get the list of files in PATH, plus CliFM internal commands, aliases, and
- * action names, and store them into an array (bin_commands) to be read by
- * my_rl_completion(). */
-void
-get_path_programs(void)
+/* Commands found in a PATH directory */
+struct path_cmds_t {
+	char *path;
+	char **names;
+	size_t n;
+	time_t mtime;
+	int owner; /* Index of the PATH entry the names were handed to, or -1 */
+};
+
+/* The commands found in each PATH directory are cached in PATH_CACHE_FILE
+ * (under the main configuration directory), so that only directories
+ * modified since the last time they were scanned need to be scanned again.
+ * For each directory, the file holds its path (a line starting with a
+ * slash), its modification time, and then its commands, one per line
+ * (command names never contain slashes). */
+#define PATH_CACHE_FILE   "pathcache.clifm"
+#define PATH_CACHE_HEADER "#clifm path cache v1"
+
+static char *
+get_path_cache_file(char *buf, const size_t size)
+{
+	if (xargs.stealth_mode == 1 || config_ok == 0 || !config_dir_gral
+	|| !*config_dir_gral)
+		return (char *)NULL;
+
+	snprintf(buf, size, "%s/%s", config_dir_gral, PATH_CACHE_FILE);
+	return buf;
+}
+
+static void
+free_path_cmds(struct path_cmds_t *dirs, const size_t n)
 {
-	int i, l = 0, total_cmd = 0;
-	int *cmd_n = (int *)0;
-	struct dirent ***commands_bin = (struct dirent ***)NULL;
+	size_t i, j;
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < dirs[i].n; j++)
+			free(dirs[i].names[j]);
+		free(dirs[i].names);
+	}
 
-	if (conf.ext_cmd_ok == 1) {
-		char tmp[PATH_MAX] = "";
-		char *cwd = get_cwd(tmp, sizeof(tmp), 0);
+	free(dirs);
+}
 
-		commands_bin = (struct dirent ***)xnmalloc(path_n,
-			sizeof(struct dirent));
-		cmd_n = (int *)xnmalloc(path_n, sizeof(int));
+/* Read the PATH cache file FILE, and return the directories found there,
+ * updating N to their amount. The cache is discarded if created under a
+ * different light mode setting (which changes what is taken as a command). */
+static struct path_cmds_t *
+load_path_cache(char *file, size_t *n)
+{
+	*n = 0;
+	int fd;
+	FILE *fp = open_fread(file, &fd);
+	if (!fp)
+		return (struct path_cmds_t *)NULL;
 
-		i = (int)path_n;
-		while (--i >= 0) {
-			if (!paths[i].path || !*paths[i].path
-			|| skip_this_path(paths[i].path) == 1
-			|| xchdir(paths[i].path, NO_TITLE) == -1) {
-				cmd_n[i] = 0;
-				continue;
-			}
+	struct path_cmds_t *dirs = (struct path_cmds_t *)NULL;
+	struct path_cmds_t *cur = (struct path_cmds_t *)NULL;
+	char header[sizeof(PATH_CACHE_HEADER) + 16];
+	snprintf(header, sizeof(header), "%s light=%d\n", PATH_CACHE_HEADER,
+		conf.light_mode == 1);
+
+	char line[PATH_MAX + 1];
+	if (!fgets(line, (int)sizeof(line), fp) || strcmp(line, header) != 0) {
+		fclose(fp);
+		return (struct path_cmds_t *)NULL;
+	}
+
+	int want_mtime = 0;
+	while (fgets(line, (int)sizeof(line), fp) != NULL) {
+		size_t len = strlen(line);
+		if (len == 0 || line[len - 1] != '\n')
+			break; /* Truncated */
+		line[--len] = '\0';
+
+		if (want_mtime == 1) {
+			want_mtime = 0;
+			cur->mtime = (time_t)strtoll(line, NULL, 10);
+			continue;
+		}
+
+		if (*line == '/') {
+			dirs = (struct path_cmds_t *)xrealloc(dirs, (*n + 1)
+				* sizeof(struct path_cmds_t));
+			cur = &dirs[*n];
+			(*n)++;
+			cur->path = savestring(line, len);
+			cur->names = (char **)NULL;
+			cur->n = 0;
+			cur->mtime = 0;
+			cur->owner = -1;
+			want_mtime = 1;
+			continue;
+		}
+
+		if (!cur || len == 0)
+			continue;
+
+		/* Grow to the next power of two */
+		if (cur->n == 0 || (cur->n >= 32 && (cur->n & (cur->n - 1)) == 0))
+			cur->names = (char **)xrealloc(cur->names,
+				(cur->n == 0 ? 32 : cur->n * 2) * sizeof(char *));
+		cur->names[cur->n] = savestring(line, len);
+		cur->n++;
+	}
+
+	fclose(fp);
+	return dirs;
+}
+
+/* Write the commands found in each PATH directory (DIRS) into the PATH
+ * cache file FILE. Directories modified in the current second are not
+ * cached: they might change again without changing their modification
+ * time. Relative directories are not cached either. */
+static void
+write_path_cache(char *file, const struct path_cmds_t *dirs)
+{
+	char tmp_file[PATH_MAX + 8];
+	snprintf(tmp_file, sizeof(tmp_file), "%s.XXXXXX", file);
+
+	const int fd = mkstemp(tmp_file);
+	FILE *fp = fd == -1 ? (FILE *)NULL : fdopen(fd, "w");
+	if (!fp) {
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp_file);
+		}
+		return;
+	}
+
+	fprintf(fp, "%s light=%d\n", PATH_CACHE_HEADER, conf.light_mode == 1);
+
+	const time_t now = time(NULL);
+	size_t i, j;
+	for (i = 0; i < path_n; i++) {
+		if (!dirs[i].path || *dirs[i].path != '/' || dirs[i].mtime == 0
+		|| dirs[i].mtime >= now || strchr(dirs[i].path, '\n'))
+			continue;
 
-			cmd_n[i] = scandir(paths[i].path, &commands_bin[i],
+		/* Listed twice in PATH */
+		for (j = 0; j < i && (!dirs[j].path
+		|| strcmp(dirs[j].path, dirs[i].path) != 0); j++);
+		if (j < i)
+			continue;
+
+		fprintf(fp, "%s\n%lld\n", dirs[i].path, (long long)dirs[i].mtime);
+		for (j = 0; j < dirs[i].n; j++) {
+			fputs(dirs[i].names[j], fp);
+			fputc('\n', fp);
+		}
+	}
+
+	if (fclose(fp) != 0 || rename(tmp_file, file) == -1)
+		unlink(tmp_file);
+}
+
+/* Scan the PATH directory DIR->PATH for commands */
+static void
+scan_path_dir(struct path_cmds_t *dir)
+{
+	if (xchdir(dir->path, NO_TITLE) == -1)
+		return;
+
+	struct dirent **ents = (struct dirent **)NULL;
+	const int n = scandir(dir->path, &ents,
 #if defined(__CYGWIN__)
-					NULL, xalphasort);
+			NULL, xalphasort);
 #else
-					conf.light_mode == 1 ? NULL : skip_nonexec, xalphasort);
+			conf.light_mode == 1 ? NULL : skip_nonexec, xalphasort);
 #endif /* __CYGWIN__ */
-			/* If paths[i] directory does not exist, scandir returns -1.
-			 * Fedora, for example, adds HOME/bin and HOME/.local/bin to
-			 * PATH disregarding if they exist or not. If paths[i] dir is
-			 * empty do not use it either. */
-			if (cmd_n[i] > 0)
-				total_cmd += cmd_n[i];
+	/* If DIR does not exist, scandir returns -1. Fedora, for example,
+	 * adds HOME/bin and HOME/.local/bin to PATH disregarding if they exist
+	 * or not. If DIR is empty do not use it either. */
+	if (n <= 0) {
+		if (n == 0)
+			free(ents);
+		return;
+	}
+
+	dir->names = (char **)xnmalloc((size_t)n, sizeof(char *));
+	int i;
+	for (i = 0; i < n; i++) {
+		/* New line chars would break the cache file: do not cache DIR */
+		if (strchr(ents[i]->d_name, '\n'))
+			dir->mtime = 0;
+
+		if (!SELFORPARENT(ents[i]->d_name)) {
+			dir->names[dir->n] = savestring(ents[i]->d_name,
+				strlen(ents[i]->d_name));
+			dir->n++;
 		}
 
-		xchdir(cwd, NO_TITLE);
+		free(ents[i]);
+	}
+
+	free(ents);
+}
+
+/* Get the commands in each PATH directory, either from the PATH cache file
+ * or, if modified since cached, by scanning the directory. Returns an array
+ * of path_n entries (indexed like paths), and updates TOTAL to the total
+ * amount of commands found. The cache file is updated if needed. */
+static struct path_cmds_t *
+get_path_cmds(size_t *total)
+{
+	char buf[PATH_MAX + 1];
+	char *cache_file = get_path_cache_file(buf, sizeof(buf));
+	size_t cached_n = 0;
+	struct path_cmds_t *cached = cache_file
+		? load_path_cache(cache_file, &cached_n) : (struct path_cmds_t *)NULL;
+
+	struct path_cmds_t *dirs = (struct path_cmds_t *)xcalloc(path_n + 1,
+		sizeof(struct path_cmds_t));
+
+	char tmp[PATH_MAX] = "";
+	char *cwd = (char *)NULL;
+	size_t used = 0;
+	int scanned = 0;
+
+	int i = (int)path_n;
+	while (--i >= 0) {
+		dirs[i].owner = -1;
+		/* Non-existent directories have no modification time */
+		if (!paths[i].path || !*paths[i].path || paths[i].mtime == 0
+		|| skip_this_path(paths[i].path) == 1)
+			continue;
+
+		dirs[i].path = paths[i].path;
+		dirs[i].mtime = paths[i].mtime;
+
+		size_t j;
+		for (j = 0; j < cached_n; j++) {
+			if (*cached[j].path == *paths[i].path
+			&& strcmp(cached[j].path, paths[i].path) == 0)
+				break;
+		}
+
+		if (j < cached_n && cached[j].owner != -1) {
+			/* Listed twice in PATH */
+			const struct path_cmds_t *o = &dirs[cached[j].owner];
+			dirs[i].names = (char **)xnmalloc(o->n + 1, sizeof(char *));
+			for (dirs[i].n = 0; dirs[i].n < o->n; dirs[i].n++)
+				dirs[i].names[dirs[i].n] = savestring(o->names[dirs[i].n],
+					strlen(o->names[dirs[i].n]));
+			dirs[i].owner = cached[j].owner;
+		} else if (j < cached_n && cached[j].mtime != 0
+		&& cached[j].mtime == paths[i].mtime) {
+			dirs[i].names = cached[j].names;
+			dirs[i].n = cached[j].n;
+			cached[j].names = (char **)NULL;
+			cached[j].n = 0;
+			cached[j].owner = i;
+			used++;
+		} else {
+			if (!cwd)
+				cwd = get_cwd(tmp, sizeof(tmp), 0);
+			scan_path_dir(&dirs[i]);
+			if (*paths[i].path == '/')
+				scanned = 1;
+		}
+
+		*total += dirs[i].n;
 	}
 
+	if (cwd)
+		xchdir(cwd, NO_TITLE);
+
+	if (cache_file && (scanned == 1 || used != cached_n))
+		write_path_cache(cache_file, dirs);
+
+	for (i = 0; i < (int)cached_n; i++)
+		free(cached[i].path);
+	free_path_cmds(cached, cached_n);
+
+	return dirs;
+}
+
+/* Sort indices of bin_commands by command name. Commands with the same
+ * name keep their relative order. */
+static int
+compare_bin_cmds(const void *a, const void *b)
+{
+	const size_t x = *(const size_t *)a;
+	const size_t y = *(const size_t *)b;
+
+	const int ret = strcmp(bin_commands[x], bin_commands[y]);
+	if (ret != 0)
+		return ret;
+
+	return x < y ? -1 : (x > y);
+}
+
+/* Get the list of files in PATH, plus CliFM internal commands, aliases, and
+ * action names, and store them into an array (bin_commands) to be read by
+ * my_rl_completion(). */
+void
+get_path_programs(void)
+{
+	int i, l = 0;
+	size_t total_cmd = 0;
+	struct path_cmds_t *dirs = (struct path_cmds_t *)NULL;
+
+	if (conf.ext_cmd_ok == 1 && path_n > 0)
+		dirs = get_path_cmds(&total_cmd);
+
 	/* Add internal commands */
 	for (internal_cmds_n = 0; internal_cmds[internal_cmds_n].name;
 		internal_cmds_n++);
 
-	bin_commands = (char **)xnmalloc((size_t)total_cmd
+	bin_commands = (char **)xnmalloc(total_cmd
 		+ internal_cmds_n + aliases_n + actions_n + 2, sizeof(char *));
 
 	i = (int)internal_cmds_n;
@@ -2228,39 +2425,77 @@ get_path_programs(void)
 		}
 	}
 
-	if (conf.ext_cmd_ok == 1 && total_cmd > 0) {
+	if (dirs) {
 		/* And finally, add commands in PATH */
 		i = (int)path_n;
 		while (--i >= 0) {
-			if (cmd_n[i] <= 0)
-				continue;
-
-			int j = cmd_n[i];
+			int j = (int)dirs[i].n;
 			while (--j >= 0) {
-				if (SELFORPARENT(commands_bin[i][j]->d_name)) {
-					free(commands_bin[i][j]);
-					continue;
-				}
 #if defined(__CYGWIN__)
-				if (cygwin_exclude_file(commands_bin[i][j]->d_name) == 1) {
-					free(commands_bin[i][j]);
+				if (cygwin_exclude_file(dirs[i].names[j]) == 1) {
+					free(dirs[i].names[j]);
 					continue;
 				}
 #endif /* __CYGWIN__ */
-				bin_commands[l] = savestring(commands_bin[i][j]->d_name,
-					strlen(commands_bin[i][j]->d_name));
+				bin_commands[l] = dirs[i].names[j];
 				l++;
-				free(commands_bin[i][j]);
 			}
 
-			free(commands_bin[i]);
+			dirs[i].n = 0;
 		}
+
+		free_path_cmds(dirs, path_n);
 	}
 
-	free(commands_bin);
-	free(cmd_n);
 	path_progsn = (size_t)l;
 	bin_commands[l] = (char *)NULL;
+
+	/* Sort the array indices by command name, so that commands starting
+	 * with a given prefix can be found via binary search
+	 * (see get_bin_cmds_range()) */
+	free(bin_commands_idx);
+	bin_commands_idx = (size_t *)xnmalloc((size_t)l + 1, sizeof(size_t));
+	for (i = 0; i < l; i++)
+		bin_commands_idx[i] = (size_t)i;
+	qsort(bin_commands_idx, (size_t)l, sizeof(size_t), compare_bin_cmds);
+}
+
+/* Return the amount of commands in bin_commands starting with the first
+ * LEN bytes of PREFIX, and update START to the position of the first of
+ * them in bin_commands_idx (matches are contiguous there). */
+size_t
+get_bin_cmds_range(const char *prefix, const size_t len, size_t *start)
+{
+	*start = 0;
+	if (!bin_commands || !bin_commands_idx || path_progsn == 0)
+		return 0;
+
+	if (!prefix || len == 0)
+		return path_progsn;
+
+	/* Lower bound: first command not sorting before PREFIX */
+	size_t lo = 0, hi = path_progsn;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (strncmp(bin_commands[bin_commands_idx[mid]], prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*start = lo;
+
+	/* Upper bound: first command sorting after PREFIX */
+	hi = path_progsn;
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		if (strncmp(bin_commands[bin_commands_idx[mid]], prefix, len) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo - *start;
 }
 
 static void
@@ -2839,6 +3074,15 @@ check_options(void)
 	if (conf.max_printselfiles == UNSET)
 		conf.max_printselfiles = DEF_MAX_PRINTSEL;
 
+	if (conf.listing_threads == UNSET)
+		conf.listing_threads = DEF_LISTING_THREADS;
+
+	if (conf.listing_cache == UNSET)
+		conf.listing_cache = DEF_LISTING_CACHE;
+
+	if (conf.listing_cache_size == UNSET)
+		conf.listing_cache_size = DEF_LISTING_CACHE_SIZE;
+
 	if (conf.case_sens_list == UNSET) {
 		if (xargs.case_sens_list == UNSET)
 			conf.case_sens_list = DEF_CASE_SENS_LIST;
@@ -2907,6 +3151,18 @@ check_options(void)
 			conf.files_counter = xargs.files_counter;
 	}
 
+	if (conf.files_counter_timeout == UNSET)
+		conf.files_counter_timeout = DEF_FILES_COUNTER_TIMEOUT;
+
+	if (conf.lazy_stat_timeout == UNSET)
+		conf.lazy_stat_timeout = DEF_LAZY_STAT_TIMEOUT;
+
+	if (conf.min_refresh_interval == UNSET)
+		conf.min_refresh_interval = DEF_MIN_REFRESH_INTERVAL;
+
+	if (conf.max_refresh_latency == UNSET)
+		conf.max_refresh_latency = DEF_MAX_REFRESH_LATENCY;
+
 	if (conf.long_view == UNSET) {
 		if (xargs.longview == UNSET)
 			conf.long_view = DEF_LONG_VIEW;
@@ -2928,6 +3184,9 @@ check_options(void)
 			conf.pager = xargs.pager;
 	}
 
+	if (conf.pager_window == UNSET)
+		conf.pager_window = DEF_PAGER_WINDOW;
+
 	if (conf.max_dirhist == UNSET) {
 		if (xargs.max_dirhist == UNSET)
 			conf.max_dirhist = DEF_MAX_DIRHIST;
@@ -3042,6 +3301,12 @@ check_options(void)
 			conf.dirhist_map = xargs.dirmap;
 	}
 
+	if (conf.dir_size_cache == UNSET)
+		conf.dir_size_cache = DEF_DIR_SIZE_CACHE;
+
+	if (conf.sync_updates == UNSET)
+		conf.sync_updates = DEF_SYNC_UPDATES;
+
 	if (conf.disk_usage == UNSET) {
 		if (xargs.disk_usage == UNSET)
 			conf.disk_usage = DEF_DISK_USAGE;
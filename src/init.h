@@ -39,8 +39,8 @@ int  get_home(void);
 int  get_last_path(void);
 size_t get_path_env(void);
 void get_path_programs(void);
+size_t get_bin_cmds_range(const char *, const size_t, size_t *);
 void get_prompt_cmds(void);
-int  get_sel_files(void);
 int  get_sys_shell(void);
 struct user_t get_user_data(void);
 void init_conf_struct(void);
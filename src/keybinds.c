@@ -50,6 +50,7 @@ typedef char *rl_cpvfunc_t;
 #include "aux.h"
 #include "config.h"
 #include "exec.h"
+#include "frame.h"
 #include "keybinds.h"
 #include "listing.h"
 #include "misc.h"
@@ -1175,7 +1176,8 @@ rl_sort_next(int count, int key)
 		sort_switch = 1;
 		if (conf.clear_screen == 0)
 			putchar('\n');
-		reload_dirlist();
+		if (resort_dirlist() == -1)
+			reload_dirlist();
 		sort_switch = 0;
 	}
 
@@ -1202,7 +1204,8 @@ rl_sort_previous(int count, int key)
 		sort_switch = 1;
 		if (conf.clear_screen == 0)
 			putchar('\n');
-		reload_dirlist();
+		if (resort_dirlist() == -1)
+			reload_dirlist();
 		sort_switch = 0;
 	}
 
@@ -0,0 +1,394 @@
+/* lazystat.c -- list files before their stat data is available */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* On a slow network mount, stat'ing every file in a large directory might
+ * take several seconds, during which nothing is printed. If enabled
+ * (LazyStatTimeout), list_dir() hands the entries it just read over to
+ * lazy_stat_entries(), which runs prefetch_entries() in a background
+ * thread, and waits for it at most conf.lazy_stat_timeout milliseconds.
+ *
+ * If the stat data is not ready in time, entries are marked as pending,
+ * and the list is printed using the information provided by the directory
+ * itself (d_type and d_ino): file type colors, extension colors, and icons
+ * are still available, while the remaining information (say, permissions
+ * or file sizes) is not. Once the background job is done, it writes to a
+ * pipe, watched by my_rl_getc() (readline.c) via lazy_stat_notify_fd(),
+ * and the files list is refreshed by lazy_stat_refresh(), reusing the
+ * stat data gathered by the job (only changed lines are printed again:
+ * see frame.c). Since file types are all we have, directories containing
+ * DT_UNKNOWN entries are never listed this way (see use_lazy_stat() in
+ * listing.c).
+ *
+ * Only fd-relative calls (fstatat(2)) are run in the background: the
+ * current directory might change at any moment. Extended attributes and
+ * the files counter are handled by the foreground prefetch_entries() call
+ * made by list_dir() once the stat data has been merged. */
+
+#include "helpers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h> /* SSIZE_MAX (FC_PENDING) */
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "aux.h"
+#include "fcounter.h"
+#include "lazystat.h"
+#include "listing.h"
+
+struct ls_job_t {
+	struct pf_list_t list;
+	char *dir;   /* Directory containing the entries in LIST */
+	int fd;      /* File descriptor of DIR (a duplicate of the caller's) */
+	int flags;   /* Flags passed to prefetch_entries() */
+	int done;
+	int orphan;  /* No longer needed: freed by the worker once done */
+};
+
+struct ls_state_t {
+	struct ls_job_t *job; /* Job for the current files list, if any */
+	pthread_mutex_t mutex;
+	pthread_cond_t done_cond;
+	int orphans;  /* Jobs still running for previous lists */
+	int waiting;  /* lazy_stat_entries() is waiting for the job */
+	int notified; /* The job was notified via the pipe */
+	int reuse;    /* Reuse the results of a finished job */
+	int pipe[2];
+};
+
+static struct ls_state_t ls = {
+	NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	0, 0, 0, 0, {-1, -1}
+};
+
+static void
+free_job(struct ls_job_t *job)
+{
+	if (job->fd != -1)
+		close(job->fd);
+	free_pf_list(&job->list);
+	free(job->dir);
+	free(job);
+}
+
+/* Get rid of JOB, or let the worker do it if it is still running.
+ * Must be called with the mutex locked. */
+static void
+dismiss_job(struct ls_job_t *job)
+{
+	if (job->done == 1) {
+		free_job(job);
+		return;
+	}
+
+	job->orphan = 1;
+	ls.orphans++;
+}
+
+static void *
+ls_worker(void *arg)
+{
+	struct ls_job_t *job = (struct ls_job_t *)arg;
+	prefetch_entries(&job->list, job->fd, job->flags);
+
+	pthread_mutex_lock(&ls.mutex);
+
+	if (job->orphan == 1) {
+		ls.orphans--;
+		pthread_mutex_unlock(&ls.mutex);
+		free_job(job);
+		return (void *)NULL;
+	}
+
+	job->done = 1;
+
+	if (ls.waiting == 1) {
+		pthread_cond_signal(&ls.done_cond);
+	} else if (ls.notified == 0 && ls.pipe[1] != -1) {
+		ls.notified = 1;
+		const char c = 1;
+		if (write(ls.pipe[1], &c, 1) == -1)
+			ls.notified = 0;
+	}
+
+	pthread_mutex_unlock(&ls.mutex);
+	return (void *)NULL;
+}
+
+/* Create the pipe used to notify results to the main thread. Both ends
+ * are non-blocking: we never want to wait for it. */
+static int
+init_ls_pipe(void)
+{
+	if (ls.pipe[0] != -1)
+		return 0;
+
+	if (pipe(ls.pipe) == -1) {
+		ls.pipe[0] = ls.pipe[1] = -1;
+		return (-1);
+	}
+
+	int i;
+	for (i = 0; i < 2; i++) {
+		fcntl(ls.pipe[i], F_SETFD, FD_CLOEXEC);
+		const int fl = fcntl(ls.pipe[i], F_GETFL);
+		if (fl != -1)
+			fcntl(ls.pipe[i], F_SETFL, fl | O_NONBLOCK);
+	}
+
+	return 0;
+}
+
+static void
+drain_ls_pipe(void)
+{
+	char buf[64];
+	if (ls.pipe[0] != -1)
+		while (read(ls.pipe[0], buf, sizeof(buf)) > 0);
+}
+
+/* Start a background job to gather stat data for the entries in LIST,
+ * located in DIR, whose file descriptor is FD. Returns the new job, or
+ * NULL on error. Must be called with the mutex locked. The worker thread
+ * blocks all signals: these should be handled by the main thread only. */
+static struct ls_job_t *
+start_job(const struct pf_list_t *list, const int fd, const char *dir,
+	const int flags)
+{
+	if (ls.orphans >= LS_MAX_ORPHANS)
+		return (struct ls_job_t *)NULL;
+
+	struct ls_job_t *job =
+		(struct ls_job_t *)xcalloc(1, sizeof(struct ls_job_t));
+	job->fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	job->flags = flags;
+	job->dir = savestring(dir, strlen(dir));
+
+	if (job->fd == -1) {
+		free_job(job);
+		return (struct ls_job_t *)NULL;
+	}
+
+	size_t i;
+	for (i = 0; i < list->n; i++)
+		add_pf_entry(&job->list, list->ent[i].name, list->ent[i].ino,
+			list->ent[i].type);
+
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) != 0) {
+		free_job(job);
+		return (struct ls_job_t *)NULL;
+	}
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	pthread_t tid;
+	const int ret = pthread_create(&tid, &attr, ls_worker, job);
+
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	pthread_attr_destroy(&attr);
+
+	if (ret != 0) {
+		free_job(job);
+		return (struct ls_job_t *)NULL;
+	}
+
+	return job;
+}
+
+/* Wait for JOB to finish, at most conf.lazy_stat_timeout milliseconds.
+ * Must be called with the mutex locked. */
+static void
+wait_job(const struct ls_job_t *job)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += conf.lazy_stat_timeout / 1000;
+	ts.tv_nsec += (long)(conf.lazy_stat_timeout % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	ls.waiting = 1;
+
+	int ret = 0;
+	while (job->done == 0 && ret != ETIMEDOUT)
+		ret = pthread_cond_timedwait(&ls.done_cond, &ls.mutex, &ts);
+
+	ls.waiting = 0;
+}
+
+/* Look for the entry NAME among the entries of the job list JL, starting
+ * at index *CUR (entries are usually read in the same order). */
+static const struct pf_entry_t *
+find_job_entry(const struct pf_list_t *jl, size_t *cur, const char *name)
+{
+	size_t i, j = *cur;
+	for (i = 0; i < jl->n; i++, j++) {
+		if (j >= jl->n)
+			j = 0;
+
+		if (*jl->ent[j].name == *name && strcmp(jl->ent[j].name, name) == 0) {
+			*cur = j + 1;
+			return &jl->ent[j];
+		}
+	}
+
+	return (const struct pf_entry_t *)NULL;
+}
+
+/* Copy the stat data gathered by JOB into the matching entries of LIST.
+ * Merged entries are marked as stat'ed, so that prefetch_entries() will
+ * not stat them again. Entries not found in JOB (created after the job
+ * was started) are left for prefetch_entries(). */
+static void
+merge_job(struct pf_list_t *list, const struct ls_job_t *job)
+{
+	size_t i, cur = 0;
+	for (i = 0; i < list->n; i++) {
+		struct pf_entry_t *e = &list->ent[i];
+		const struct pf_entry_t *je = find_job_entry(&job->list, &cur, e->name);
+		if (!je)
+			continue;
+
+		e->attr = je->attr;
+		e->stat_ok = je->stat_ok;
+		e->stat_done = 1;
+		if (je->lattr) {
+			e->lattr = (struct stat *)xnmalloc(1, sizeof(struct stat));
+			*e->lattr = *je->lattr;
+		}
+		e->lattr_done = 1;
+	}
+}
+
+/* Mark all entries in LIST as pending: list_dir() will rely on d_type */
+static void
+mark_pending(struct pf_list_t *list)
+{
+	size_t i;
+	for (i = 0; i < list->n; i++) {
+		list->ent[i].pending = 1;
+		if (list->ent[i].type == DT_DIR)
+			list->ent[i].filesn = FC_PENDING;
+	}
+}
+
+/* Gather stat data for the entries in LIST, located in DIR, whose file
+ * descriptor is FD, in the background, according to FLAGS (only fd-relative
+ * flags are honored: see the comment at the top of this file).
+ *
+ * Returns 1 if the data is not available in time, in which case entries
+ * are marked as pending, or 0 if LIST is to be handed over to
+ * prefetch_entries(), either because the stat data was merged into it,
+ * or because no background job could be started. */
+int
+lazy_stat_entries(struct pf_list_t *list, const int fd, const char *dir,
+	const int flags)
+{
+	if (!list || list->n == 0 || !dir || init_ls_pipe() == -1)
+		return 0;
+
+	pthread_mutex_lock(&ls.mutex);
+
+	drain_ls_pipe();
+	ls.notified = 0;
+
+	/* Finished jobs are only reused when refreshing the list: otherwise,
+	 * files might have changed since the job was run. */
+	const int reuse = (ls.reuse == 1 || fc_reusing() == 1);
+	struct ls_job_t *job = ls.job;
+	if (job && (strcmp(job->dir, dir) != 0
+	|| (job->done == 1 && reuse == 0))) {
+		dismiss_job(job);
+		job = (struct ls_job_t *)NULL;
+	}
+
+	if (!job)
+		job = start_job(list, fd, dir,
+			(flags & (PF_FOLLOW_LINKS | PF_LINK_TARGETS)) | PF_NO_URING);
+
+	ls.job = job;
+	if (!job) {
+		pthread_mutex_unlock(&ls.mutex);
+		return 0;
+	}
+
+	if (job->done == 0)
+		wait_job(job);
+
+	const int pending = (job->done == 0);
+	if (pending == 1)
+		mark_pending(list);
+	else
+		merge_job(list, job);
+
+	pthread_mutex_unlock(&ls.mutex);
+	return pending;
+}
+
+/* Return the file descriptor written to whenever the stat data of a
+ * pending files list is available (call lazy_stat_refresh() then), or -1
+ * if there is none. */
+int
+lazy_stat_notify_fd(void)
+{
+	return ls.pipe[0];
+}
+
+/* Refresh the files list to print the stat data gathered in the background.
+ * Returns 1 if the list was refreshed, or 0 otherwise. */
+int
+lazy_stat_refresh(void)
+{
+	pthread_mutex_lock(&ls.mutex);
+	drain_ls_pipe();
+	ls.notified = 0;
+	const int same_dir = (ls.job && ls.job->done == 1 && workspaces
+		&& workspaces[cur_ws].path
+		&& strcmp(ls.job->dir, workspaces[cur_ws].path) == 0);
+	pthread_mutex_unlock(&ls.mutex);
+
+	if (same_dir == 0 || conf.autols == 0 || rl_nohist == 1
+	|| kbind_busy == 1)
+		return 0;
+
+	if (conf.clear_screen == 0)
+		putchar('\n');
+
+	ls.reuse = 1;
+	reload_dirlist();
+	ls.reuse = 0;
+
+	return 1;
+}
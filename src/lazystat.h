@@ -0,0 +1,43 @@
+/* lazystat.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef LAZYSTAT_H
+#define LAZYSTAT_H
+
+#include "prefetch.h"
+
+/* Max amount of background jobs still running for previous lists (say,
+ * blocked on a stale mount point). Once reached, files are stat'ed in the
+ * foreground, as usual. */
+#define LS_MAX_ORPHANS 4
+
+__BEGIN_DECLS
+
+int  lazy_stat_entries(struct pf_list_t *, const int, const char *, const int);
+int  lazy_stat_notify_fd(void);
+int  lazy_stat_refresh(void);
+
+__END_DECLS
+
+#endif /* LAZYSTAT_H */
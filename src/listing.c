@@ -38,10 +38,6 @@
 # include <sys/capability.h>
 #endif /* LINUX_FILE_CAPS */
 
-#if defined(LINUX_FILE_XATTRS)
-# include <sys/xattr.h>
-#endif /* LINUX_FILE_XATTRS */
-
 #include <limits.h> /* INT_MAX */
 
 #if defined(LINUX_FSINFO) || defined(HAVE_STATFS)
@@ -90,19 +86,20 @@
 #include "exec.h"
 #include "autocmds.h"
 #include "sanitize.h"
+#include "selection.h" /* is_sel_file() */
+#include "prefetch.h"
+#include "fcounter.h"
+#include "lazystat.h"
+#include "frame.h"
+#include "listing.h"
 
 #ifndef _NO_ICONS
 # include "icons.h"
 #endif /* !_NO_ICONS */
 
-/* In case we want to try some faster printf implementation */
-/*#if defined(_PALAND_PRINTF)
-# include "printf.h"
-# define xprintf printf_
-#else
-# define xprintf printf
-#endif // _PALAND_PRINTF */
-#define xprintf printf
+/* The files list is printed into a frame buffer, written at once when
+ * the list is complete. See frame.c */
+#define xprintf frame_printf
 
 /* Macros for run_dir_cmd function */
 #define DIR_IN  0
@@ -110,12 +107,103 @@
 #define DIR_IN_NAME  ".cfm.in"
 #define DIR_OUT_NAME ".cfm.out"
 
+/* Autocommand files found in the current directory (see
+ * get_autocmd_file()) */
+#define AUTOCMD_IN  (1 << 0)
+#define AUTOCMD_OUT (1 << 1)
+
 #define ENTRY_N 64
 
+/* Whether the files counter of the entry at index N is to be printed.
+ * FC_PENDING means the count is still running in the background (see
+ * fcounter.c): it is printed as FC_PENDING_CHR */
+#define SHOW_FILES_COUNTER(n) (conf.files_counter == 1 \
+	&& (file_info[(n)].filesn > 0 || file_info[(n)].filesn == FC_PENDING))
+
 /* Amount of digits of the files counter of the longest directory */
 static size_t longest_fc = 0;
+
+/* Options affecting the contents of a files list: a cached list (see
+ * store_cached_list()) is reused only if these did not change */
+struct list_opts_t {
+	int sort;
+	int sort_reverse;
+	int show_hidden;
+	int only_dirs;
+	int long_view;
+	int prop_time;
+	int files_counter;
+	int follow_symlinks;
+	int color_lnk_as_target;
+	int colorize;
+	int icons;
+	int icons_use_file_color;
+	int apparent_size;
+	int case_sens_list;
+	int list_dirs_first;
+	int check_cap;
+	int check_ext;
+	int full_dir_size; /* Directory sizes are full sizes in long view */
+};
+
+/* Information about the current files list (set by list_dir()) needed to
+ * update it in place (see update_dirlist()) */
+struct dirlist_t {
+	char *path;        /* Listed directory (cacheable lists only) */
+	filesn_t excluded; /* Files excluded by filters */
+	filesn_t next_index; /* Directory order index of the next loaded file */
+	int have_xattr;    /* At least one file has extended attributes */
+	int virtual_dir;
+	int updatable;     /* The list can be updated by update_dirlist() */
+	int have_btime;    /* Birth times were loaded (see load_entry()) */
+	int pending;       /* Stat data still pending (see lazystat.c) */
+	int cacheable;     /* The list can be kept by store_cached_list() */
+	int autocmd_files; /* .cfm.in and .cfm.out files found (AUTOCMD_*) */
+	int pad0;
+	dev_t dev;         /* Device and inode number of the listed directory */
+	ino_t ino;
+	time_t read_time;  /* When entries were last read from the directory */
+	struct list_opts_t opts; /* Options used to load the list */
+};
+
+static struct dirlist_t cur_list = {0};
 static int pager_bk = 0;
 
+/* A files list, as printed by the windowed pager (see run_pager_window()) */
+struct window_t {
+	void (*print_entry)(int *, const filesn_t, const int, const int);
+	void (*pad_filename)(const int, const filesn_t, const int, const int);
+	const struct maxes_t *maxes; /* Long view only */
+	filesn_t nn; /* Amount of files to list */
+	filesn_t rows; /* Amount of rows needed to list NN files */
+	size_t columns_n; /* Files per row (0 for long view) */
+	int pad; /* ELN padding */
+	int move_right; /* Pad file names via cursor movement (see pad_filename()) */
+	uint8_t have_xattr; /* Long view only */
+	char pad0[7];
+};
+
+/* Names and extension colors of listed files are stored in blocks of this
+ * size (see list_alloc()) */
+#define LIST_BLOCK_SIZE (64 * 1024)
+
+struct list_block_t {
+	struct list_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/* Storage for the strings of the current files list: everything is freed
+ * at once by free_dirlist(), instead of one free(3) per string */
+struct list_arena_t {
+	struct list_block_t *blocks;
+	size_t used;   /* Bytes handed out */
+	size_t wasted; /* Bytes of entries removed by update_dirlist() */
+};
+
+static struct list_arena_t arena = {0};
+
 /* Struct to store information about trimmed file names. Used only when
  * Unicode is disabled */
 struct trim_t {
@@ -139,42 +227,38 @@ struct wtrim_t {
 static char name_buf[(NAME_MAX + 1) * sizeof(wchar_t)];
 
 #if !defined(_NO_ICONS)
-static void
-set_icon_names_hashes(void)
-{
-	int i = (int)(sizeof(icon_filenames) / sizeof(struct icons_t));
-	name_icons_hashes = (size_t *)xnmalloc((size_t)i + 1, sizeof(size_t));
-
-	while (--i >= 0)
-		name_icons_hashes[i] = hashme(icon_filenames[i].name, 0);
-}
-
-static void
-set_dir_names_hashes(void)
+/* Compare the strings A and B case-insensitively (ASCII only), the same
+ * way the icons tables in icons.h are sorted. */
+static int
+icon_name_cmp(const char *a, const char *b)
 {
-	int i = (int)(sizeof(icon_dirnames) / sizeof(struct icons_t));
-	dir_icons_hashes = (size_t *)xnmalloc((size_t)i + 1, sizeof(size_t));
+	while (*a && TOUPPER(*a) == TOUPPER(*b)) {
+		a++;
+		b++;
+	}
 
-	while (--i >= 0)
-		dir_icons_hashes[i] = hashme(icon_dirnames[i].name, 0);
+	return (TOUPPER((unsigned char)*a) - TOUPPER((unsigned char)*b));
 }
 
-static void
-set_ext_names_hashes(void)
+/* Binary search NAME in the sorted icons table TABLE, holding N entries.
+ * Return the index of the matching entry, or -1 if not found. */
+static int
+find_icon(const struct icons_t *table, const size_t n, const char *name)
 {
-	int i = (int)(sizeof(icon_ext) / sizeof(struct icons_t));
-	ext_icons_hashes = (size_t *)xnmalloc((size_t)i + 1,  sizeof(size_t));
-
-	while (--i >= 0)
-		ext_icons_hashes[i] = hashme(icon_ext[i].name, 0);
-}
+	size_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		const size_t mid = lo + (hi - lo) / 2;
+		const int ret = icon_name_cmp(name, table[mid].name);
+		if (ret == 0)
+			return (int)mid;
+		if (ret < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
 
-void
-init_icons_hashes(void)
-{
-	set_icon_names_hashes();
-	set_dir_names_hashes();
-	set_ext_names_hashes();
+	return (-1);
 }
 #endif /* !_NO_ICONS */
 
@@ -229,21 +313,21 @@ static void
 set_div_line_color(void)
 {
 	if (*dl_c) {
-		fputs(dl_c, stdout);
+		frame_puts(dl_c);
 		return;
 	}
 
 	/* If div line color isn't set, use the current workspace color */
 	switch (cur_ws) {
-	case 0: fputs(*ws1_c ? ws1_c : DEF_DL_C, stdout); break;
-	case 1: fputs(*ws2_c ? ws2_c : DEF_DL_C, stdout); break;
-	case 2: fputs(*ws3_c ? ws3_c : DEF_DL_C, stdout); break;
-	case 3: fputs(*ws4_c ? ws4_c : DEF_DL_C, stdout); break;
-	case 4: fputs(*ws5_c ? ws5_c : DEF_DL_C, stdout); break;
-	case 5: fputs(*ws6_c ? ws6_c : DEF_DL_C, stdout); break;
-	case 6: fputs(*ws7_c ? ws7_c : DEF_DL_C, stdout); break;
-	case 7: fputs(*ws8_c ? ws8_c : DEF_DL_C, stdout); break;
-	default: fputs(DEF_DL_C, stdout); break;
+	case 0: frame_puts(*ws1_c ? ws1_c : DEF_DL_C); break;
+	case 1: frame_puts(*ws2_c ? ws2_c : DEF_DL_C); break;
+	case 2: frame_puts(*ws3_c ? ws3_c : DEF_DL_C); break;
+	case 3: frame_puts(*ws4_c ? ws4_c : DEF_DL_C); break;
+	case 4: frame_puts(*ws5_c ? ws5_c : DEF_DL_C); break;
+	case 5: frame_puts(*ws6_c ? ws6_c : DEF_DL_C); break;
+	case 6: frame_puts(*ws7_c ? ws7_c : DEF_DL_C); break;
+	case 7: frame_puts(*ws8_c ? ws8_c : DEF_DL_C); break;
+	default: frame_puts(DEF_DL_C); break;
 	}
 }
 
@@ -264,15 +348,15 @@ print_div_line(void)
 		set_div_line_color();
 
 	if (!*div_line) { /* Let's draw the line with box drawing chars */
-		fputs("\x1b(0m", stdout);
+		frame_puts("\x1b(0m");
 		int k;
 		for (k = 0; k < (int)term_cols - 2; k++)
-			putchar('q');
-		fputs("\x1b(0j\x1b(B", stdout);
-		putchar('\n');
+			frame_putchar('q');
+		frame_puts("\x1b(0j\x1b(B");
+		frame_putchar('\n');
 	} else if (*div_line == '0' && !div_line[1]) {
 		/* No line */
-		putchar('\n');
+		frame_putchar('\n');
 	} else {
 		/* Custom line */
 		size_t len = wc_xstrlen(div_line);
@@ -282,16 +366,16 @@ print_div_line(void)
 			 * dividing line in some terminals (e.g. cons25) */
 			int i;
 			for (i = (int)(term_cols / len); i > 1; i--)
-				fputs(div_line, stdout);
-			putchar('\n');
+				frame_puts(div_line);
+			frame_putchar('\n');
 		} else {
 			/* Print DIV_LINE exactly */
-			puts(div_line);
+			frame_puts(div_line);
+			frame_putchar('\n');
 		}
 	}
 
-	fputs(df_c, stdout);
-	fflush(stdout);
+	frame_puts(df_c);
 }
 
 #ifdef LINUX_FSINFO
@@ -391,7 +475,7 @@ print_sel_files(const unsigned short t_rows)
 	}
 
 	if (conf.max_printselfiles != UNSET && limit < (int)sel_n)
-		printf("... (%d/%zu)\n", i, sel_n);
+		xprintf("... (%d/%zu)\n", i, sel_n);
 
 	print_div_line();
 }
@@ -405,13 +489,13 @@ print_dirhist_map(void)
 			continue;
 
 		if (i > 0 && old_pwd[i - 1])
-			printf("%zu %s\n", i, old_pwd[i - 1]);
+			xprintf("%zu %s\n", i, old_pwd[i - 1]);
 
-		printf("%zu %s%s%s\n", i + 1, mi_c,
+		xprintf("%zu %s%s%s\n", i + 1, mi_c,
 		    old_pwd[i], df_c);
 
 		if (i + 1 < (size_t)dirhist_total_index && old_pwd[i + 1])
-			printf("%zu %s\n", i + 2, old_pwd[i + 1]);
+			xprintf("%zu %s\n", i + 2, old_pwd[i + 1]);
 
 		break;
 	}
@@ -425,18 +509,14 @@ get_name_icon(const char *file, const filesn_t n)
 	if (!file)
 		return 0;
 
-	size_t nhash = hashme(file, 0);
-
-	int i = (int)(sizeof(icon_filenames) / sizeof(struct icons_t));
-	while (--i >= 0) {
-		if (nhash != name_icons_hashes[i])
-			continue;
-		file_info[n].icon = icon_filenames[i].icon;
-		file_info[n].icon_color = icon_filenames[i].color;
-		return 1;
-	}
+	const int i = find_icon(icon_filenames,
+		sizeof(icon_filenames) / sizeof(struct icons_t), file);
+	if (i == -1)
+		return 0;
 
-	return 0;
+	file_info[n].icon = icon_filenames[i].icon;
+	file_info[n].icon_color = icon_filenames[i].color;
+	return 1;
 }
 
 /* Set the icon field to the corresponding icon for DIR. If not found,
@@ -451,16 +531,13 @@ get_dir_icon(const char *dir, const int n)
 	if (!dir)
 		return;
 
-	size_t dhash = hashme(dir, 0);
+	const int i = find_icon(icon_dirnames,
+		sizeof(icon_dirnames) / sizeof(struct icons_t), dir);
+	if (i == -1)
+		return;
 
-	int i = (int)(sizeof(icon_dirnames) / sizeof(struct icons_t));
-	while (--i >= 0) {
-		if (dhash != dir_icons_hashes[i])
-			continue;
-		file_info[n].icon = icon_dirnames[i].icon;
-		file_info[n].icon_color = icon_dirnames[i].color;
-		break;
-	}
+	file_info[n].icon = icon_dirnames[i].icon;
+	file_info[n].icon_color = icon_dirnames[i].color;
 }
 
 /* Set the icon field to the corresponding icon for EXT. If not found,
@@ -478,16 +555,13 @@ get_ext_icon(const char *restrict ext, const filesn_t n)
 
 	ext++;
 
-	size_t ehash = hashme(ext, 0);
+	const int i = find_icon(icon_ext,
+		sizeof(icon_ext) / sizeof(struct icons_t), ext);
+	if (i == -1)
+		return;
 
-	int i = (int)(sizeof(icon_ext) / sizeof(struct icons_t));
-	while (--i >= 0) {
-		if (ehash != ext_icons_hashes[i])
-			continue;
-		file_info[n].icon = icon_ext[i].icon;
-		file_info[n].icon_color = icon_ext[i].color;
-		break;
-	}
+	file_info[n].icon = icon_ext[i].icon;
+	file_info[n].icon_color = icon_ext[i].color;
 }
 #endif /* _NO_ICONS */
 
@@ -503,14 +577,16 @@ post_listing(DIR *dir, const int close_dir, const int reset_pager)
 
 	dir_changed = 0;
 
-	if (xargs.list_and_quit == 1)
+	if (xargs.list_and_quit == 1) {
+		frame_flush();
 		exit(exit_code);
+	}
 
 	if (reset_pager == 1 && (conf.pager < 2 || files < (filesn_t)conf.pager))
 		conf.pager = pager_bk;
 
 	if (max_files != UNSET && files > (filesn_t)max_files)
-		printf("... (%d/%jd)\n", max_files, (intmax_t)files);
+		xprintf("... (%d/%jd)\n", max_files, (intmax_t)files);
 
 	print_div_line();
 
@@ -528,7 +604,7 @@ post_listing(DIR *dir, const int close_dir, const int reset_pager)
 	}
 
 	if (switch_cscheme == 1)
-		printf(_("Color scheme %s->%s %s\n"), mi_c, df_c, cur_cscheme);
+		xprintf(_("Color scheme %s->%s %s\n"), mi_c, df_c, cur_cscheme);
 
 	if (conf.print_selfiles == 1 && sel_n > 0)
 		print_sel_files(term_lines);
@@ -536,13 +612,27 @@ post_listing(DIR *dir, const int close_dir, const int reset_pager)
 	return EXIT_SUCCESS;
 }
 
+/* Print the files counter of the directory at index I in the files list */
+static inline void
+print_files_counter(const filesn_t i)
+{
+	if (!SHOW_FILES_COUNTER(i))
+		return;
+
+	if (file_info[i].filesn == FC_PENDING)
+		frame_putchar(FC_PENDING_CHR);
+	else
+		frame_puts(xitoa(file_info[i].filesn));
+}
+
 /* A basic pager for directories containing large amount of files.
  * What's missing? It only goes downwards. To go backwards, use the
  * terminal scrollback function */
 static int
 run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 {
-	fputs(PAGER_LABEL, stdout);
+	frame_puts(PAGER_LABEL);
+	frame_flush();
 
 	switch (xgetchar()) {
 
@@ -560,15 +650,16 @@ run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 	/* h: Print pager help */
 	case 63: /* fallthrough */ /* ? */
 	case 104: {
-		CLEAR;
+		FRAME_CLEAR;
 
-		fputs(_(PAGER_HELP), stdout);
+		frame_puts(_(PAGER_HELP));
 		int l = (int)term_lines - 5;
-		MOVE_CURSOR_DOWN(l);
-		fputs(PAGER_LABEL, stdout);
+		FRAME_MOVE_CURSOR_DOWN(l);
+		frame_puts(PAGER_LABEL);
+		frame_flush();
 
 		xgetchar();
-		CLEAR;
+		FRAME_CLEAR;
 
 		if (columns_n == -1) { /* Long view */
 			*i = 0;
@@ -594,19 +685,25 @@ run_pager(const int columns_n, int *reset_pager, filesn_t *i, size_t *counter)
 	/* If another key is pressed, go back one position.
 	 * Otherwise, some file names won't be listed.*/
 	default:
-		putchar('\r');
-		ERASE_TO_RIGHT;
+		frame_putchar('\r');
+		FRAME_ERASE_TO_RIGHT;
 		return (-1);
 	}
 
-	putchar('\r');
-	ERASE_TO_RIGHT;
+	frame_putchar('\r');
+	FRAME_ERASE_TO_RIGHT;
 	return 0;
 }
 
 static void
 set_events_checker(void)
 {
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+	/* Pending events are outdated now: we are about to read the whole
+	 * directory */
+	clear_fs_events();
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
 #if defined(LINUX_INOTIFY)
 	reset_inotify();
 
@@ -640,6 +737,84 @@ set_events_checker(void)
 #endif /* LINUX_INOTIFY */
 }
 
+/* Return SIZE bytes from the files list arena */
+static char *
+list_alloc(const size_t size)
+{
+	struct list_block_t *b = arena.blocks;
+
+	if (!b || b->used + size > b->size) {
+		/* Names (NAME_MAX) and colors are way smaller than a block: this
+		 * is just a safety net. */
+		const size_t bsize = size > LIST_BLOCK_SIZE ? size : LIST_BLOCK_SIZE;
+		b = (struct list_block_t *)xnmalloc(1,
+			sizeof(struct list_block_t) + bsize);
+		b->size = bsize;
+		b->used = 0;
+		b->next = arena.blocks;
+		arena.blocks = b;
+	}
+
+	char *p = b->data + b->used;
+	b->used += size;
+	arena.used += size;
+
+	return p;
+}
+
+/* Copy the LEN bytes long string STR into the files list arena */
+static char *
+list_strdup(const char *str, const size_t len)
+{
+	char *p = list_alloc(len + 1);
+	memcpy(p, str, len + 1);
+	return p;
+}
+
+/* Store in the files list arena the sort key for the name of the entry N
+ * (see name_sort_key()), so that sorting does not need to compare (and
+ * collate) names over and over again.
+ * Version sort compares names via xstrverscmp(), which cannot be expressed
+ * as a key: names are compared via namecmp() only in case of a tie, which
+ * is too rare to be worth computing keys. */
+static void
+set_sort_key(const filesn_t n)
+{
+	if (conf.sort == SNONE || conf.sort == SVER)
+		return;
+
+	char buf[PATH_MAX + 1];
+	const size_t len = name_sort_key(file_info[n].name, buf, sizeof(buf));
+	if (len == 0)
+		return;
+
+	if (len < sizeof(buf)) {
+		file_info[n].sort_key = list_strdup(buf, len);
+	} else {
+		file_info[n].sort_key = list_alloc(len + 1);
+		name_sort_key(file_info[n].name, file_info[n].sort_key, len + 1);
+	}
+
+	file_info[n].sort_key_len = len;
+}
+
+static void
+free_list_blocks(struct list_block_t *b)
+{
+	while (b) {
+		struct list_block_t *next = b->next;
+		free(b);
+		b = next;
+	}
+}
+
+static void
+free_list_arena(void)
+{
+	free_list_blocks(arena.blocks);
+	arena = (struct list_arena_t){0};
+}
+
 static void
 get_longest_filename(const filesn_t n, const size_t pad)
 {
@@ -677,7 +852,7 @@ get_longest_filename(const filesn_t n, const size_t pad)
 			if (file_info[i].dir)
 				total_len++;
 
-			if (file_info[i].filesn > 0 && conf.files_counter == 1)
+			if (SHOW_FILES_COUNTER(i))
 				total_len += DIGINUM(file_info[i].filesn);
 
 			if (file_info[i].dir == 0 && conf.colorize == 0) {
@@ -827,6 +1002,143 @@ compute_maxes(void)
 	return maxes;
 }
 
+static void
+print_long_entry(const filesn_t i, const int pad, const struct maxes_t *maxes,
+	const uint8_t have_xattr)
+{
+	int ind_chr = 0;
+	char *ind_chr_color = get_ind_char(i, &ind_chr);
+
+	if (conf.no_eln == 0) {
+		xprintf("%s%*jd%s%s%c%s", el_c, pad, (intmax_t)i + 1, df_c,
+			ind_chr_color, ind_chr, df_c);
+	} else {
+		xprintf("%s%c%s", ind_chr_color, ind_chr, df_c);
+	}
+
+	/* Print the remaining part of the entry. */
+	print_entry_props(&file_info[i], maxes, have_xattr);
+}
+
+/* Print row ROW of the files list described by W */
+static void
+print_window_row(const struct window_t *w, const filesn_t row)
+{
+	if (w->columns_n == 0) { /* Long view: one entry per row */
+		print_long_entry(row, w->pad, w->maxes, w->have_xattr);
+		return;
+	}
+
+	size_t c;
+	for (c = 0; c < w->columns_n; c++) {
+		const filesn_t x = conf.listing_mode == VERTLIST
+			? (filesn_t)c * w->rows + row : row * (filesn_t)w->columns_n
+			+ (filesn_t)c;
+		if (x >= w->nn)
+			break;
+
+		int ind_char = (conf.classify != 0);
+		const int fc = file_info[x].dir != 1 ? (int)longest_fc : 0;
+
+		file_info[x].eln_n = conf.no_eln == 1 ? -1 : DIGINUM(x + 1);
+		w->print_entry(&ind_char, x, w->pad, conf.max_name_len + fc);
+
+		if (c + 1 < w->columns_n)
+			w->pad_filename(ind_char, x, w->pad, w->move_right);
+	}
+
+	frame_putchar('\n');
+}
+
+/* Rows of files printed in each page by the windowed pager */
+static filesn_t
+window_page_rows(void)
+{
+	return term_lines > 2 ? (filesn_t)term_lines - 1 : 1;
+}
+
+/* Return 1 if a files list taking ROWS rows should be printed by the
+ * windowed pager, or 0 otherwise */
+static int
+use_pager_window(const int reset_pager, const filesn_t rows)
+{
+	return (conf.pager_window == 1 && (conf.pager == 1 || (reset_pager == 0
+	&& conf.pager > 1 && files >= (filesn_t)conf.pager))
+	&& rows > window_page_rows());
+}
+
+/* The windowed pager: instead of printing the whole files list (W), print
+ * only those rows fitting in the screen (a page), and let the user move to
+ * the next or previous page, replacing the current one. Only the files in
+ * the current page are formatted and printed, no matter how many files
+ * the list has. When the pager is stopped, the current page is kept on
+ * the screen. */
+static void
+run_pager_window(const struct window_t *w)
+{
+	const filesn_t page = window_page_rows();
+	const filesn_t pages = (w->rows - 1) / page + 1;
+	filesn_t cur = 0; /* Current page */
+	int prev = 0; /* Previous key: to recognize escape sequences */
+
+	while (1) {
+		filesn_t r;
+		const filesn_t last = (cur + 1) * page;
+		for (r = cur * page; r < last && r < w->rows; r++)
+			print_window_row(w, r);
+
+		frame_puts(PAGER_LABEL);
+		xprintf(" %jd/%jd", (intmax_t)cur + 1, (intmax_t)pages);
+		frame_flush();
+
+		filesn_t next = cur;
+		int help = 0, quit = 0;
+
+		while (next == cur && help == 0 && quit == 0) {
+			const int c = xgetchar();
+			const int seq = (prev == '[');
+			const int tilde = (c == '~' ? prev : 0);
+			prev = c;
+
+			if (c == ' ' || c == '\n' || (seq && c == 'B') || tilde == '6') {
+				/* Advancing from the last page stops the pager */
+				if (cur + 1 == pages)
+					quit = 1;
+				else
+					next = cur + 1;
+			} else if (c == 'b' || (seq && c == 'A') || tilde == '5')
+				next = cur > 0 ? cur - 1 : 0;
+			else if (c == 'g' || (seq && c == 'H'))
+				next = 0;
+			else if (c == 'G' || (seq && c == 'F'))
+				next = pages - 1;
+			else if (c == '?' || c == 'h')
+				help = 1;
+			else if (c == 'q' || c == 'c' || c == 'p')
+				quit = 1;
+		}
+
+		frame_putchar('\r');
+		FRAME_ERASE_TO_RIGHT;
+
+		if (quit == 1)
+			break;
+
+		FRAME_CLEAR;
+
+		if (help == 1) {
+			frame_puts(_(PAGER_WINDOW_HELP));
+			FRAME_MOVE_CURSOR_DOWN((int)term_lines - 7);
+			frame_puts(PAGER_LABEL);
+			frame_flush();
+			xgetchar();
+			FRAME_CLEAR;
+		}
+
+		cur = next;
+	}
+}
+
 static void
 print_long_mode(size_t *counter, int *reset_pager, const int pad,
 	uint8_t have_xattr)
@@ -852,6 +1164,19 @@ print_long_mode(size_t *counter, int *reset_pager, const int pad,
 
 	maxes.name = space_left + (conf.icons == 1 ? 3 : 0);
 
+	const filesn_t nn = (max_files != UNSET && (filesn_t)max_files < files)
+		? (filesn_t)max_files : files;
+
+	if (use_pager_window(*reset_pager, nn) == 1) {
+		struct window_t w = {0};
+		w.maxes = &maxes;
+		w.nn = w.rows = nn;
+		w.pad = pad;
+		w.have_xattr = have_xattr;
+		run_pager_window(&w);
+		return;
+	}
+
 	filesn_t i, k = files;
 	for (i = 0; i < k; i++) {
 		if (max_files != UNSET && i == max_files)
@@ -871,18 +1196,7 @@ print_long_mode(size_t *counter, int *reset_pager, const int pad,
 			++(*counter);
 		}
 
-		int ind_chr = 0;
-		char *ind_chr_color = get_ind_char(i, &ind_chr);
-
-		if (conf.no_eln == 0) {
-			printf("%s%*jd%s%s%c%s", el_c, pad, (intmax_t)i + 1, df_c,
-				ind_chr_color, ind_chr, df_c);
-		} else {
-			printf("%s%c%s", ind_chr_color, ind_chr, df_c);
-		}
-
-		/* Print the remaining part of the entry. */
-		print_entry_props(&file_info[i], &maxes, have_xattr);
+		print_long_entry(i, pad, &maxes, have_xattr);
 	}
 }
 
@@ -1056,16 +1370,15 @@ print_entry_color(int *ind_char, const filesn_t i, const int pad,
 		case DT_DIR: /* fallthrough */
 		case DT_LNK:
 			if (file_info[i].dir == 1)
-				putchar(DIR_CHR);
-			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+				frame_putchar(DIR_CHR);
+			print_files_counter(i);
 			break;
 		default: break;
 		}
 	}
 
 	if (end_color == fc_c)
-		fputs(df_c, stdout);
+		frame_puts(df_c);
 
 	free(wtrim.wname);
 }
@@ -1130,43 +1443,41 @@ print_entry_nocolor(int *ind_char, const filesn_t i, const int pad,
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
-			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+			frame_putchar(DIR_CHR);
+			print_files_counter(i);
 			break;
 
 		case DT_LNK:
 			if (file_info[i].color == or_c) {
-				putchar(BRK_LNK_CHR);
+				frame_putchar(BRK_LNK_CHR);
 			} else if (file_info[i].dir) {
 				*ind_char = 0;
-				putchar(DIR_CHR);
-				if (file_info[i].filesn > 0 && conf.files_counter == 1)
-					fputs(xitoa(file_info[i].filesn), stdout);
+				frame_putchar(DIR_CHR);
+				print_files_counter(i);
 			} else {
-				putchar(LINK_CHR);
+				frame_putchar(LINK_CHR);
 			}
 			break;
 
 		case DT_REG:
 			if (file_info[i].exec == 1)
-				putchar(EXEC_CHR);
+				frame_putchar(EXEC_CHR);
 			else
 				*ind_char = 0;
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putchar(BLK_CHR); break;
+		case DT_CHR: frame_putchar(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putchar(DOOR_CHR); break;
 //		case DT_PORT: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putchar(FIFO_CHR); break;
+		case DT_SOCK: frame_putchar(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putchar(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNKNOWN_CHR); break;
+		case DT_UNKNOWN: frame_putchar(UNKNOWN_CHR); break;
 		default: *ind_char = 0;
 		}
 	}
@@ -1249,13 +1560,12 @@ print_entry_color_light(int *ind_char, const filesn_t i, const int pad,
 	}
 
 	if (file_info[i].dir == 1 && conf.classify == 1) {
-		putchar(DIR_CHR);
-		if (file_info[i].filesn > 0 && conf.files_counter == 1)
-			fputs(xitoa(file_info[i].filesn), stdout);
+		frame_putchar(DIR_CHR);
+		print_files_counter(i);
 	}
 
 	if (end_color == fc_c)
-		fputs(df_c, stdout);
+		frame_puts(df_c);
 
 	free(wtrim.wname);
 }
@@ -1298,7 +1608,7 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i, const int pad,
 				xprintf("%ls%s%c%s", (wchar_t *)n, trim_diff, TRIMFILE_CHR,
 					wtrim.type == TRIM_EXT ? file_info[i].ext_name : "");
 			} else {
-				fputs(file_info[i].name, stdout);
+				frame_puts(file_info[i].name);
 			}
 		} else {
 			if (wtrim.type > 0) {
@@ -1315,24 +1625,23 @@ print_entry_nocolor_light(int *ind_char, const filesn_t i, const int pad,
 		switch (file_info[i].type) {
 		case DT_DIR:
 			*ind_char = 0;
-			putchar(DIR_CHR);
-			if (file_info[i].filesn > 0 && conf.files_counter == 1)
-				fputs(xitoa(file_info[i].filesn), stdout);
+			frame_putchar(DIR_CHR);
+			print_files_counter(i);
 			break;
 
-		case DT_BLK: putchar(BLK_CHR); break;
-		case DT_CHR: putchar(CHR_CHR); break;
+		case DT_BLK: frame_putchar(BLK_CHR); break;
+		case DT_CHR: frame_putchar(CHR_CHR); break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: putchar(DOOR_CHR); break;
+		case DT_DOOR: frame_putchar(DOOR_CHR); break;
 //		case DT_DOOR: break;
 #endif /* SOLARIS_DOORS */
-		case DT_FIFO: putchar(FIFO_CHR); break;
-		case DT_LNK: putchar(LINK_CHR); break;
-		case DT_SOCK: putchar(SOCK_CHR); break;
+		case DT_FIFO: frame_putchar(FIFO_CHR); break;
+		case DT_LNK: frame_putchar(LINK_CHR); break;
+		case DT_SOCK: frame_putchar(SOCK_CHR); break;
 #ifdef S_IFWHT
-		case DT_WHT: putchar(WHT_CHR); break;
+		case DT_WHT: frame_putchar(WHT_CHR); break;
 #endif /* S_IFWHT */
-		case DT_UNKNOWN: putchar(UNKNOWN_CHR); break;
+		case DT_UNKNOWN: frame_putchar(UNKNOWN_CHR); break;
 		default: *ind_char = 0; break;
 		}
 	}
@@ -1356,8 +1665,7 @@ pad_filename(const int ind_char, const filesn_t i, const int pad,
 
 	if (file_info[i].dir == 1 && conf.classify == 1) {
 		++cur_len;
-		if (file_info[i].filesn > 0 && conf.files_counter == 1
-		&& file_info[i].ruser == 1)
+		if (SHOW_FILES_COUNTER(i) && file_info[i].ruser == 1)
 			cur_len += DIGINUM((int)file_info[i].filesn);
 	}
 
@@ -1365,9 +1673,9 @@ pad_filename(const int ind_char, const filesn_t i, const int pad,
 	if (termcap_move_right == 0) {
 		int j = diff + 1;
 		while (--j >= 0)
-			putchar(' ');
+			frame_putchar(' ');
 	} else {
-		MOVE_CURSOR_RIGHT(diff + 1);
+		FRAME_MOVE_CURSOR_RIGHT(diff + 1);
 	}
 }
 
@@ -1387,8 +1695,7 @@ pad_filename_light(const int ind_char, const filesn_t i, const int pad,
 	if (conf.classify == 1) {
 		if (file_info[i].dir == 1)
 			++cur_len;
-		if (file_info[i].filesn > 0 && conf.files_counter == 1
-		&& file_info[i].ruser == 1)
+		if (SHOW_FILES_COUNTER(i) && file_info[i].ruser == 1)
 			cur_len += DIGINUM((int)file_info[i].filesn);
 	}
 
@@ -1397,9 +1704,9 @@ pad_filename_light(const int ind_char, const filesn_t i, const int pad,
 	if (termcap_move_right == 0) {
 		int j = diff + 1;
 		while(--j >= 0)
-			putchar(' ');
+			frame_putchar(' ');
 	} else {
-		MOVE_CURSOR_RIGHT(diff + 1);
+		FRAME_MOVE_CURSOR_RIGHT(diff + 1);
 	}
 }
 
@@ -1428,6 +1735,21 @@ list_files_horizontal(size_t *counter, int *reset_pager, const int pad,
 	const int termcap_move_right = (xargs.list_and_quit == 1
 		|| term_caps.suggestions == 0) ? 0 : 1;
 
+	const filesn_t rows = nn / (filesn_t)columns_n
+		+ (nn % (filesn_t)columns_n > 0);
+	if (use_pager_window(*reset_pager, rows) == 1) {
+		struct window_t w = {0};
+		w.print_entry = print_entry_function;
+		w.pad_filename = pad_filename_function;
+		w.nn = nn;
+		w.rows = rows;
+		w.columns_n = columns_n;
+		w.pad = pad;
+		w.move_right = termcap_move_right;
+		run_pager_window(&w);
+		return;
+	}
+
 	const int int_longest_fc = (int)longest_fc;
 	size_t cur_cols = 0;
 	filesn_t i;
@@ -1483,11 +1805,11 @@ list_files_horizontal(size_t *counter, int *reset_pager, const int pad,
 		if (last_column == 0)
 			pad_filename_function(ind_char, i, pad, termcap_move_right);
 		else
-			putchar('\n');
+			frame_putchar('\n');
 	}
 
 	if (last_column == 0)
-		putchar('\n');
+		frame_putchar('\n');
 }
 
 /* List files vertically, like ls(1) would
@@ -1527,6 +1849,19 @@ list_files_vertical(size_t *counter, int *reset_pager, const int pad,
 	const int termcap_move_right = (xargs.list_and_quit == 1
 		|| term_caps.suggestions == 0) ? 0 : 1;
 
+	if (use_pager_window(*reset_pager, rows) == 1) {
+		struct window_t w = {0};
+		w.print_entry = print_entry_function;
+		w.pad_filename = pad_filename_function;
+		w.nn = nn;
+		w.rows = rows;
+		w.columns_n = columns_n;
+		w.pad = pad;
+		w.move_right = termcap_move_right;
+		run_pager_window(&w);
+		return;
+	}
+
 	const int int_longest_fc = (int)longest_fc;
 	size_t cur_cols = 0;
 	size_t cc = columns_n; // Current column number
@@ -1568,7 +1903,7 @@ list_files_vertical(size_t *counter, int *reset_pager, const int pad,
 				 * 1 file  3 file3  5 file5
 				 * 2 file2 4 file4  HERE
 				 * ... */
-				putchar('\n');
+				frame_putchar('\n');
 			continue;
 		}
 
@@ -1624,11 +1959,11 @@ list_files_vertical(size_t *counter, int *reset_pager, const int pad,
 			 * 1 file  3 file3  5 file5HERE
 			 * 2 file2 4 file4  6 file6HERE
 			 * ... */
-			putchar('\n');
+			frame_putchar('\n');
 	}
 
 	if (last_column == 0)
-		putchar('\n');
+		frame_putchar('\n');
 }
 
 /* Execute commands in either DIR_IN_NAME or DIR_OUT_NAME files.
@@ -1672,19 +2007,31 @@ run_dir_cmd(const int mode)
 		launch_execl(buf);
 }
 
-/* Check if the file named S is either cfm.in or cfm.out.
- * We already know it starts with a dot. */
+/* Return AUTOCMD_IN or AUTOCMD_OUT if the file named S is either cfm.in
+ * or cfm.out, or 0 otherwise. We already know it starts with a dot. */
+static int
+get_autocmd_file(const char *s)
+{
+	if (s[0] != 'c' || s[1] != 'f' || s[2] != 'm' || s[3] != '.')
+		return 0;
+
+	if (s[4] == 'o' && s[5] == 'u' && s[6] == 't' && !s[7])
+		return AUTOCMD_OUT;
+	if (s[4] == 'i' && s[5] == 'n' && !s[6])
+		return AUTOCMD_IN;
+
+	return 0;
+}
+
+/* Handle the autocommand files FILES (AUTOCMD_IN and/or AUTOCMD_OUT) found
+ * in the directory we just changed to */
 static void
-check_autocmd_file(const char *s)
+run_autocmd_files(const int files)
 {
-	if (s[0] == 'c' && s[1] == 'f' && s[2] == 'm' && s[3] == '.') {
-		if (s[4] == 'o' && s[5] == 'u' && s[6] == 't' && !s[7]) {
-			dir_out = 1;
-		} else {
-			if (s[4] == 'i' && s[5] == 'n' && !s[6])
-				run_dir_cmd(DIR_IN);
-		}
-	}
+	if (files & AUTOCMD_OUT)
+		dir_out = 1;
+	if (files & AUTOCMD_IN)
+		run_dir_cmd(DIR_IN);
 }
 
 static void
@@ -1817,7 +2164,8 @@ list_dir_light(void)
 		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
 
 	DIR *dir;
-	struct dirent *ent;
+	struct dirbuf_t db;
+	xdirent_t *ent;
 	int reset_pager = 0;
 	filesn_t excluded_files = 0;
 	uint8_t close_dir = 1;
@@ -1828,6 +2176,7 @@ list_dir_light(void)
 	char *largest_name = (char *)NULL, *largest_color = (char *)NULL;
 
 	if ((dir = opendir(workspaces[cur_ws].path)) == NULL) {
+		frame_flush();
 		xerror("%s: %s: %s\n", PROGRAM_NAME, workspaces[cur_ws].path,
 			strerror(errno));
 		close_dir = 0;
@@ -1849,7 +2198,8 @@ list_dir_light(void)
 	file_info = (struct fileinfo *)xnmalloc(ENTRY_N + 2,
 		sizeof(struct fileinfo));
 
-	while ((ent = readdir(dir))) {
+	init_dirbuf(&db, dir);
+	while ((ent = read_dirbuf(&db))) {
 		const char *ename = ent->d_name;
 		/* Skip self and parent directories */
 		if (SELFORPARENT(ename))
@@ -1857,7 +2207,7 @@ list_dir_light(void)
 
 		/* Check .cfm.in and .cfm.out files for the autocommands function */
 		if (*ename == '.' && dir_changed == 1)
-			check_autocmd_file(ename + 1);
+			run_autocmd_files(get_autocmd_file(ename + 1));
 
 		/* Skip files according to a regex filter */
 		if (filter.str && filter.type == FILTER_FILE_NAME) {
@@ -1908,11 +2258,11 @@ list_dir_light(void)
 		}
 
 		init_fileinfo(n);
+		file_info[n].dir_index = n;
 
 		file_info[n].utf8 = is_utf8_name(ename, &file_info[n].bytes);
-		file_info[n].name =
-			(char *)xnmalloc(file_info[n].bytes + 1, sizeof(char));
-		memcpy(file_info[n].name, ename, file_info[n].bytes + 1);
+		file_info[n].name = list_strdup(ename, file_info[n].bytes);
+		set_sort_key(n);
 		file_info[n].len = (file_info[n].utf8 == 0)
 			? file_info[n].bytes : wc_xstrlen(ename);
 
@@ -2033,17 +2383,17 @@ list_dir_light(void)
 		++count;
 	}
 
+	free_dirbuf(&db);
 	file_info[n].name = (char *)NULL;
 	files = n;
 
 	if (xargs.disk_usage_analyzer == 1
 	|| (conf.long_view == 1 && conf.full_dir_size == 1)) {
-		fputs("\r            \r", stdout); /* Erase the "Scanning ..." message */
-		fflush(stdout);
+		frame_puts("\r            \r"); /* Erase the "Scanning ..." message */
 	}
 
 	if (n == 0) {
-		printf("%s. ..%s\n", di_c, df_c);
+		xprintf("%s. ..%s\n", di_c, df_c);
 		free(file_info);
 		goto END;
 	}
@@ -2051,7 +2401,7 @@ list_dir_light(void)
 	const int pad = (max_files != UNSET && files > (filesn_t)max_files)
 		? DIGINUM(max_files) : DIGINUM(files);
 
-	if (conf.sort != SNONE)
+	if (conf.sort != SNONE && sort_by_keys(file_info, n) == -1)
 		ENTSORT(file_info, (size_t)n, entrycmp);
 
 	size_t counter = 0;
@@ -2087,7 +2437,7 @@ END:
 	if (virtual_dir == 1)
 		print_reload_msg(_("Virtual directory\n"));
 	if (excluded_files > 0)
-		printf(_("Excluded files: %zd\n"), excluded_files);
+		xprintf(_("Excluded files: %zd\n"), excluded_files);
 
 	if (xargs.disk_usage_analyzer == 1 && conf.long_view == 1
 	&& conf.full_dir_size == 1) {
@@ -2097,7 +2447,7 @@ END:
 
 #ifdef LIST_SPEED_TEST
 	clock_t end = clock();
-	printf("list_dir time: %f\n", (double)(end - start) / CLOCKS_PER_SEC);
+	xprintf("list_dir time: %f\n", (double)(end - start) / CLOCKS_PER_SEC);
 #endif /* LIST_SPEED_TEST */
 
 	return exit_code;
@@ -2112,24 +2462,8 @@ check_seltag(const dev_t dev, const ino_t ino, const nlink_t links,
 	if (sel_n == 0 || !sel_devino)
 		return 0;
 
-	filesn_t j = (filesn_t)sel_n;
-	while (--j >= 0) {
-		if (sel_devino[j].dev != dev || sel_devino[j].ino != ino)
-			continue;
-		/* Only check hardlinks in case of regular files */
-		if (file_info[index].type != DT_DIR && links > 1) {
-			const char *p = strrchr(sel_elements[j].name, '/');
-			if (!p || !*(++p))
-				continue;
-			if (*p == *file_info[index].name
-			&& strcmp(p, file_info[index].name) == 0)
-				return 1;
-		} else {
-			return 1;
-		}
-	}
-
-	return 0;
+	return is_sel_file(dev, ino, links, file_info[index].type == DT_DIR,
+		file_info[index].name);
 }
 
 /* Get the color of a link target NAME, whose file attributes are ATTR,
@@ -2166,7 +2500,7 @@ get_link_target_color(const char *name, const struct stat *attr,
 		}
 
 		if (ext == 1) {
-			file_info[i].ext_color = savestring(color, strlen(color));
+			file_info[i].ext_color = list_strdup(color, strlen(color));
 			file_info[i].color = file_info[i].ext_color;
 		} else {
 			file_info[i].color = color;
@@ -2195,609 +2529,1319 @@ check_extra_file_types(mode_t *mode, const struct stat *s)
 		*mode = DT_TPO;
 }
 
-/* List files in the current working directory. Uses file type colors
- * and columns. Return 0 on success or 1 on error. */
-int
-list_dir(void)
+/* Print the files list (FILES entries in the file_info array, already
+ * sorted) */
+static void
+print_dirlist(int *reset_pager)
 {
-#ifdef LIST_SPEED_TEST
-	clock_t start = clock();
-#endif /* LIST_SPEED_TEST */
+	const int pad = (max_files != UNSET && files > (filesn_t)max_files)
+		? DIGINUM(max_files) : DIGINUM(files);
 
-	if (conf.clear_screen == 1)
-		{ CLEAR; fflush(stdout); }
+		/* ##########################################
+		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
+		 * ########################################## */
 
-	/* Hide the cursor to minimize flickering: it will be unhidden immediately
-	 * before printing the next prompt (prompt.c) */
-	if (xargs.list_and_quit != 1)
-		HIDE_CURSOR;
+	size_t counter = 0;
+	size_t columns_n = 1;
 
-	if (autocmds_n > 0 && dir_changed == 1) {
-		if (autocmd_set == 1)
-			revert_autocmd_opts();
-		check_autocmds();
-	}
+	/* Get the longest file name */
+	longest = 0;
+	if (conf.columned == 1 || conf.long_view == 1)
+		get_longest_filename(files, (size_t)pad);
 
-	if (dir_changed == 1 && dir_out == 1) {
-		run_dir_cmd(DIR_OUT);
-		dir_out = 0;
-	}
+				/* ########################
+				 * #    LONG VIEW MODE    #
+				 * ######################## */
 
-	if (conf.clear_screen == 1) {
-		/* For some reason we need to clear the screen twice to prevent
-		 * a garbage first line when scrolling up */
-		CLEAR; fflush(stdout);
+	if (conf.long_view == 1) {
+		print_long_mode(&counter, reset_pager, pad,
+			(uint8_t)cur_list.have_xattr);
+		return;
 	}
 
-	if (xargs.disk_usage_analyzer == 1
-	|| (conf.long_view == 1 && conf.full_dir_size == 1)) {
-		UNHIDE_CURSOR;
-		fputs(_("Scanning... "), stdout);
-		fflush(stdout);
-		if (xargs.list_and_quit != 1)
-			HIDE_CURSOR;
+				/* ########################
+				 * #   NORMAL VIEW MODE   #
+				 * ######################## */
+
+	/* Get amount of columns needed to print files in CWD  */
+	columns_n = conf.columned == 0 ? 1 : get_columns();
+
+	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
+		list_files_vertical(&counter, reset_pager, pad, columns_n);
+	else
+		list_files_horizontal(&counter, reset_pager, pad, columns_n);
+}
+
+static void
+print_dirlist_msgs(void)
+{
+	if (cur_list.virtual_dir == 1)
+		print_reload_msg(_("Virtual directory\n"));
+	if (cur_list.excluded > 0)
+		xprintf(_("Excluded files: %zd\n"), cur_list.excluded);
+}
+
+/* Update the stats struct for the entry F: SIGN is 1 to add the entry,
+ * or -1 to remove it (except the hidden files counter, which also counts
+ * files not in the files list). */
+static void
+count_entry_stats(const struct fileinfo *f, const int sign)
+{
+	const size_t v = (size_t)sign; /* -1 wraps around as expected */
+
+	if (f->mode == 0) { /* Not statable: see load_entry() */
+		stats.unstat += v;
+		stats.unknown += v;
+		return;
 	}
 
-	if (conf.unicode == 0) {
-		trim.state = trim.a = trim.b = 0;
-		trim.len = 0;
+	switch (f->mode & S_IFMT) {
+	case S_IFREG: stats.reg += v; break;
+	case S_IFDIR: stats.dir += v; break;
+	case S_IFLNK: stats.link += v; break;
+	case S_IFIFO: stats.fifo += v; break;
+	case S_IFSOCK: stats.socket += v; break;
+	case S_IFBLK: stats.block_dev += v; break;
+	case S_IFCHR: stats.char_dev += v; break;
+#ifndef _BE_POSIX
+# ifdef SOLARIS_DOORS
+	case S_IFDOOR: stats.door += v; break;
+	case S_IFPORT: stats.port += v; break;
+# endif /* SOLARIS_DOORS */
+# ifdef S_ARCH1
+	case S_ARCH1: stats.arch1 += v; break;
+	case S_ARCH2: stats.arch2 += v; break;
+# endif /* S_ARCH1 */
+# ifdef S_IFWHT
+	case S_IFWHT: stats.whiteout += v; break;
+# endif /* S_IFWHT */
+#endif /* !_BE_POSIX */
+	default: stats.unknown += v; break;
 	}
 
-	/* Reset the stats struct */
-	stats = (struct stats_t){0};
-	get_term_size();
+	if (f->exec == 1)
+		stats.exec += v;
 
-	if (conf.long_view == 1)
-		props_now = time(NULL);
+	if (S_ISREG(f->mode)) {
+		if (f->color == su_c) stats.suid += v;
+		else if (f->color == sg_c) stats.sgid += v;
+		else if (f->color == ca_c) stats.caps += v;
+		else if (f->color == mh_c) stats.multi_link += v;
+	} else if (S_ISDIR(f->mode)) {
+		if (f->color == tw_c || f->color == ow_c)
+			stats.other_writable += v;
+		if (f->color == tw_c || f->color == st_c)
+			stats.sticky += v;
+	} else if (S_ISLNK(f->mode) && f->color == or_c) {
+		stats.broken_link += v;
+	}
+}
 
-	if (conf.light_mode == 1)
-		return list_dir_light();
+#if defined(ST_BTIME) && !defined(__sun) && defined(LINUX_STATX)
+/* Return the birth time of the file NAME, or zero on error */
+static time_t
+get_btime(const char *name)
+{
+	struct statx attx;
+	if (statx(AT_FDCWD, name, AT_SYMLINK_NOFOLLOW, STATX_BTIME, &attx) == -1)
+		return 0;
 
-	const int virtual_dir =
-		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
+	return (time_t)attx.ST_BTIME.tv_sec;
+}
+#endif /* ST_BTIME && !__sun && LINUX_STATX */
 
-	DIR *dir;
-	struct dirent *ent;
-	struct stat attr;
-	int reset_pager = 0;
-	filesn_t excluded_files = 0;
-	uint8_t close_dir = 1;
-	uint8_t have_xattr = 0;
-
-	/* A few variables for the disk usage analyzer mode */
-	off_t largest_size = 0, total_size = 0;
-	char *largest_name = (char *)NULL, *largest_color = (char *)NULL;
-
-	if ((dir = opendir(workspaces[cur_ws].path)) == NULL) {
-		xerror("%s: %s: %s\n", PROGRAM_NAME, workspaces[cur_ws].path,
-			strerror(errno));
-		close_dir = 0;
-		goto END;
+/* Store information about the entry PF (see prefetch.c) at index N of the
+ * file_info array. Returns 1 if the entry is to be listed, or 0 if it
+ * must be skipped (in which case nothing is stored). */
+static int
+load_entry(const filesn_t n, const struct pf_entry_t *pf, const int virtual_dir)
+{
+	const char *ename = pf->name;
+	const struct stat attr = pf->attr;
+
+	init_fileinfo(n);
+	file_info[n].dir_index = cur_list.next_index++;
+
+	uint8_t stat_ok = 1;
+	if (pf->stat_ok == 0) {
+		if (virtual_dir == 1)
+			return 0;
+		stat_ok = 0;
+	}
+
+	/* Filter files according to file type */
+	if (filter.str && filter.type == FILTER_FILE_TYPE && stat_ok == 1
+	&& exclude_file_type(attr.st_mode, attr.st_nlink) == EXIT_SUCCESS) {
+		/* Decrease counters: the file won't be displayed */
+		if (*ename == '.' && stats.hidden > 0)
+			--stats.hidden;
+		++cur_list.excluded;
+		return 0;
 	}
 
-	set_events_checker();
-
-	const int fd = dirfd(dir);
-
-#ifdef POSIX_FADV_SEQUENTIAL
-	/* A hint to the kernel to optimize current dir for reading */
-	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
-#endif /* POSIX_FADV_SEQUENTIAL */
-
-		/* ##########################################
-		 * #    GATHER AND STORE FILE INFORMATION   #
-		 * ########################################## */
-
-	errno = 0;
-	longest = 0;
-	filesn_t n = 0, count = 0;
-	size_t total_dents = 0;
-
-	file_info =
-		(struct fileinfo *)xnmalloc(ENTRY_N + 2, sizeof(struct fileinfo));
-
-	while ((ent = readdir(dir))) {
-		const char *ename = ent->d_name;
-		/* Skip self and parent directories */
-		if (SELFORPARENT(ename))
-			continue;
-
-		/* Check .cfm.in and .cfm.out files for the autocommands function */
-		if (*ename == '.' && dir_changed == 1)
-			check_autocmd_file(ename + 1);
-
-		/* Filter files according to a regex filter */
-		if (filter.str && filter.type == FILTER_FILE_NAME) {
-			if (regexec(&regex_exp, ename, 0, NULL, 0) == EXIT_SUCCESS) {
-				if (filter.rev == 1) {
-					++excluded_files;
-					continue;
-				}
-			} else if (filter.rev == 0) {
-				++excluded_files;
-				continue;
-			}
-		}
-
-		if (*ename == '.') {
-			++stats.hidden;
-			if (conf.show_hidden == 0)
-				continue;
-		}
-
-		init_fileinfo(n);
-
-		uint8_t stat_ok = 1;
-		if (fstatat(fd, ename, &attr, virtual_dir == 1
-		? 0 : AT_SYMLINK_NOFOLLOW) == -1) {
-			if (virtual_dir == 1)
-				continue;
-			stat_ok = 0;
-			++stats.unstat;
-		}
-
-		/* Filter files according to file type */
-		if (filter.str && filter.type == FILTER_FILE_TYPE && stat_ok == 1
-		&& exclude_file_type(attr.st_mode, attr.st_nlink) == EXIT_SUCCESS) {
-			/* Decrease counters: the file won't be displayed */
-			if (*ename == '.' && stats.hidden > 0)
-				--stats.hidden;
-			if (stat_ok == 0 && stats.unstat > 0)
-				--stats.unstat;
-			++excluded_files;
-			continue;
-		}
-
 #if defined(_DIRENT_HAVE_D_TYPE)
-		if (conf.only_dirs == 1 && ent->d_type != DT_DIR
-		&& (ent->d_type != DT_LNK || get_link_ref(ename) != S_IFDIR))
+	if (conf.only_dirs == 1 && pf->type != DT_DIR
+	&& (pf->type != DT_LNK || get_link_ref(ename) != S_IFDIR))
 #else
-		if (conf.only_dirs == 1 && stat_ok == 1 && !S_ISDIR(attr.st_mode)
-		&& (!S_ISLNK(attr.st_mode) || get_link_ref(ename) != S_IFDIR))
+	if (conf.only_dirs == 1 && stat_ok == 1 && !S_ISDIR(attr.st_mode)
+	&& (!S_ISLNK(attr.st_mode) || get_link_ref(ename) != S_IFDIR))
 #endif /* _DIRENT_HAVE_D_TYPE */
-			continue;
-
-		if (count > ENTRY_N) {
-			count = 0;
-			total_dents = (size_t)n + ENTRY_N;
-			file_info = xrealloc(file_info, (total_dents + 2)
-				* sizeof(struct fileinfo));
-		}
-
-		/* Both is_utf8_name() and wc_xstrlen() calculate the number of
-		 * columns needed to display the current file name on the screen
-		 * (the former for ASCII names, where 1 char = 1 byte = 1 column, and
-		 * the latter for UTF-8 names, i.e. containing at least one non-ASCII
-		 * character).
-		 * Now, since is_utf8_name() is ~8 times faster than wc_xstrlen()
-		 * (10,000 entries, optimization O3), we only run wc_xstrlen() in
-		 * case of an UTF-8 name.
-		 * However, since is_utf8_name() will be executed anyway, this ends
-		 * up being actually slower whenever the current directory contains
-		 * more UTF-8 than ASCII names. The assumption here is that ASCII
-		 * names are far more common than UTF-8 names. */
-		file_info[n].utf8 = is_utf8_name(ename, &file_info[n].bytes);
-
-		file_info[n].name =
-			(char *)xnmalloc(file_info[n].bytes + 1, sizeof(char));
-		memcpy(file_info[n].name, ename, file_info[n].bytes + 1);
+		return 0;
 
-		/* Columns needed to display file name */
-		file_info[n].len = file_info[n].utf8 == 0
-			? file_info[n].bytes : wc_xstrlen(ename);
+	/* Both is_utf8_name() and wc_xstrlen() calculate the number of
+	 * columns needed to display the current file name on the screen
+	 * (the former for ASCII names, where 1 char = 1 byte = 1 column, and
+	 * the latter for UTF-8 names, i.e. containing at least one non-ASCII
+	 * character).
+	 * Now, since is_utf8_name() is ~8 times faster than wc_xstrlen()
+	 * (10,000 entries, optimization O3), we only run wc_xstrlen() in
+	 * case of an UTF-8 name.
+	 * However, since is_utf8_name() will be executed anyway, this ends
+	 * up being actually slower whenever the current directory contains
+	 * more UTF-8 than ASCII names. The assumption here is that ASCII
+	 * names are far more common than UTF-8 names. */
+	file_info[n].utf8 = is_utf8_name(ename, &file_info[n].bytes);
+
+	file_info[n].name = list_strdup(ename, file_info[n].bytes);
+	set_sort_key(n);
+
+	/* Columns needed to display file name */
+	file_info[n].len = file_info[n].utf8 == 0
+		? file_info[n].bytes : wc_xstrlen(ename);
 
 #ifdef _NO_ICONS
-		file_info[n].icon = (char *)NULL;
-		file_info[n].icon_color = df_c;
+	file_info[n].icon = (char *)NULL;
+	file_info[n].icon_color = df_c;
 #endif /* _NO_ICONS */
 
-		if (stat_ok == 1) {
-			switch (attr.st_mode & S_IFMT) {
-			case S_IFREG: file_info[n].type = DT_REG; stats.reg++; break;
-			case S_IFDIR: file_info[n].type = DT_DIR; stats.dir++; break;
-			case S_IFLNK: file_info[n].type = DT_LNK; stats.link++; break;
-			case S_IFIFO: file_info[n].type = DT_FIFO; stats.fifo++; break;
-			case S_IFSOCK: file_info[n].type = DT_SOCK; stats.socket++; break;
-			case S_IFBLK: file_info[n].type = DT_BLK; stats.block_dev++; break;
-			case S_IFCHR: file_info[n].type = DT_CHR; stats.char_dev++; break;
+	if (stat_ok == 1) {
+		switch (attr.st_mode & S_IFMT) {
+		case S_IFREG: file_info[n].type = DT_REG; break;
+		case S_IFDIR: file_info[n].type = DT_DIR; break;
+		case S_IFLNK: file_info[n].type = DT_LNK; break;
+		case S_IFIFO: file_info[n].type = DT_FIFO; break;
+		case S_IFSOCK: file_info[n].type = DT_SOCK; break;
+		case S_IFBLK: file_info[n].type = DT_BLK; break;
+		case S_IFCHR: file_info[n].type = DT_CHR; break;
 #ifndef _BE_POSIX
 # ifdef SOLARIS_DOORS
-			case S_IFDOOR: file_info[n].type = DT_DOOR; stats.door++; break;
-			case S_IFPORT: file_info[n].type = DT_PORT; stats.port++; break;
+		case S_IFDOOR: file_info[n].type = DT_DOOR; break;
+		case S_IFPORT: file_info[n].type = DT_PORT; break;
 # endif /* SOLARIS_DOORS */
 # ifdef S_ARCH1
-			case S_ARCH1: file_info[n].type = DT_ARCH1; stats.arch1++; break;
-			case S_ARCH2: file_info[n].type = DT_ARCH2; stats.arch2++; break;
+		case S_ARCH1: file_info[n].type = DT_ARCH1; break;
+		case S_ARCH2: file_info[n].type = DT_ARCH2; break;
 # endif /* S_ARCH1 */
 # ifdef S_IFWHT
-			case S_IFWHT: file_info[n].type = DT_WHT; stats.whiteout++; break;
+		case S_IFWHT: file_info[n].type = DT_WHT; break;
 # endif /* S_IFWHT */
 #endif /* !_BE_POSIX */
-			default: file_info[n].type = DT_UNKNOWN; stats.unknown++; break;
-			}
+		default: file_info[n].type = DT_UNKNOWN; break;
+		}
 
-			check_extra_file_types(&file_info[n].type, &attr);
-
-			file_info[n].sel =
-				check_seltag(attr.st_dev, attr.st_ino, attr.st_nlink, n);
-			file_info[n].inode = ent->d_ino;
-			file_info[n].linkn = attr.st_nlink;
-			file_info[n].size =
-				FILE_TYPE_NON_ZERO_SIZE(attr.st_mode) ? FILE_SIZE(attr) : 0;
-			file_info[n].uid = attr.st_uid;
-			file_info[n].gid = attr.st_gid;
-			file_info[n].mode = attr.st_mode;
-
-#if defined(LINUX_FILE_XATTRS)
-			if (file_info[n].type != DT_LNK
-			&& (conf.long_view == 1 || check_cap == 1)
-			&& listxattr(ename, NULL, 0) > 0)
-				file_info[n].xattr = have_xattr = 1;
-#endif /* LINUX_FILE_XATTRS */
-
-			if (conf.long_view == 1) {
-				switch (prop_fields.time) {
-				case PROP_TIME_ACCESS:
-					file_info[n].ltime = (time_t)attr.st_atime; break;
-				case PROP_TIME_CHANGE:
-					file_info[n].ltime = (time_t)attr.st_ctime; break;
-				case PROP_TIME_MOD:
-					file_info[n].ltime = (time_t)attr.st_mtime; break;
-				default: file_info[n].ltime = (time_t)attr.st_mtime; break;
-				}
+		check_extra_file_types(&file_info[n].type, &attr);
+
+		file_info[n].sel =
+			check_seltag(attr.st_dev, attr.st_ino, attr.st_nlink, n);
+		file_info[n].inode = pf->ino;
+		file_info[n].linkn = attr.st_nlink;
+		file_info[n].size =
+			FILE_TYPE_NON_ZERO_SIZE(attr.st_mode) ? FILE_SIZE(attr) : 0;
+		file_info[n].uid = attr.st_uid;
+		file_info[n].gid = attr.st_gid;
+		file_info[n].mode = attr.st_mode;
+
+		if (pf->xattr == 1)
+			file_info[n].xattr = cur_list.have_xattr = 1;
+
+		if (conf.long_view == 1) {
+			switch (prop_fields.time) {
+			case PROP_TIME_ACCESS:
+				file_info[n].ltime = (time_t)attr.st_atime; break;
+			case PROP_TIME_CHANGE:
+				file_info[n].ltime = (time_t)attr.st_ctime; break;
+			case PROP_TIME_MOD:
+				file_info[n].ltime = (time_t)attr.st_mtime; break;
+			default: file_info[n].ltime = (time_t)attr.st_mtime; break;
 			}
-		} else {
-			file_info[n].type = DT_UNKNOWN;
-			++stats.unknown;
 		}
+	} else if (pf->pending == 1) {
+		/* No stat data yet: rely on the information provided by the
+		 * directory itself (see lazystat.c) */
+		file_info[n].type = pf->type;
+		file_info[n].inode = pf->ino;
+		file_info[n].sel = check_seltag(cur_list.dev, pf->ino, 1, n);
+	} else {
+		file_info[n].type = DT_UNKNOWN;
+	}
 
-		file_info[n].dir = (file_info[n].type == DT_DIR);
-		file_info[n].symlink = (file_info[n].type == DT_LNK);
+	file_info[n].dir = (file_info[n].type == DT_DIR);
+	file_info[n].symlink = (file_info[n].type == DT_LNK);
 
-		switch (conf.sort) {
-		case SATIME:
-			file_info[n].time = stat_ok ? (time_t)attr.st_atime : 0;
-			break;
+	if (stat_ok == 1) {
+		file_info[n].atime = (time_t)attr.st_atime;
+		file_info[n].ctime = (time_t)attr.st_ctime;
+		file_info[n].mtime = (time_t)attr.st_mtime;
+	}
 
-		case SBTIME:
 #if defined(ST_BTIME) && !defined(__sun)
 # ifdef LINUX_STATX
-		{
-			struct statx attx;
-			if (statx(AT_FDCWD, ename, AT_SYMLINK_NOFOLLOW,
-			STATX_BTIME, &attx) == -1)
-				file_info[n].time = 0;
-			else
-				file_info[n].time = (time_t)attx.ST_BTIME.tv_sec;
-		}
+	/* Birth time takes an extra statx(2) call: get it only if needed */
+	if (cur_list.have_btime == 1)
+		file_info[n].btime = get_btime(ename);
 # else
-			file_info[n].time = stat_ok ? (time_t)attr.ST_BTIME.tv_sec : 0;
+	if (stat_ok == 1)
+		file_info[n].btime = (time_t)attr.ST_BTIME.tv_sec;
 # endif /* LINUX_STATX */
 #else
-			/* Let's use change time if birth time is not available */
-			file_info[n].time = stat_ok ? (time_t)attr.st_ctime : 0;
+	/* Let's use change time if birth time is not available */
+	file_info[n].btime = file_info[n].ctime;
 #endif /* ST_BTIME && !__sun */
-			break;
-
-		case SCTIME: file_info[n].time = stat_ok ? (time_t)attr.st_ctime : 0;
-			break;
-		case SMTIME: file_info[n].time = stat_ok ? (time_t)attr.st_mtime : 0;
-			break;
-		default: file_info[n].time = 0; break;
-		}
 
-		switch (file_info[n].type) {
-		case DT_DIR: {
+	switch (file_info[n].type) {
+	case DT_DIR: {
 #ifndef _NO_ICONS
-			if (conf.icons == 1) {
-				get_dir_icon(file_info[n].name, (int)n);
+		if (conf.icons == 1) {
+			get_dir_icon(file_info[n].name, (int)n);
 
-				if (*dir_ico_c)	/* If set from the color scheme file */
-					file_info[n].icon_color = dir_ico_c;
-			}
+			if (*dir_ico_c)	/* If set from the color scheme file */
+				file_info[n].icon_color = dir_ico_c;
+		}
 #endif /* !_NO_ICONS */
-			const int daccess = (stat_ok == 1 &&
-				check_file_access(attr.st_mode, attr.st_uid, attr.st_gid) == 1);
+		const int daccess = stat_ok == 1 ? check_file_access(attr.st_mode,
+			attr.st_uid, attr.st_gid) : pf->pending;
 
-			file_info[n].filesn = (conf.files_counter == 1
-				? (count_dir(ename, NO_CPOP) - 2) : 1);
+		file_info[n].filesn = pf->filesn;
 
-			if (daccess == 0 || file_info[n].filesn < 0) {
-				file_info[n].color = nd_c;
+		if (daccess == 0 || (file_info[n].filesn < 0
+		&& file_info[n].filesn != FC_PENDING)) {
+			file_info[n].color = nd_c;
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_LOCK;
-				file_info[n].icon_color = YELLOW;
+			file_info[n].icon = ICON_LOCK;
+			file_info[n].icon_color = YELLOW;
 #endif /* !_NO_ICONS */
-			} else {
-				file_info[n].color = stat_ok == 1 ? ((attr.st_mode & S_ISVTX)
-					? ((attr.st_mode & S_IWOTH) ? tw_c : st_c)
-					: ((attr.st_mode & S_IWOTH) ? ow_c
-					: (file_info[n].filesn == 0 ? ed_c : di_c)))
-					: df_c;
-			}
-
-			/* Let's gather some file statistics based on the file type color */
-			if (file_info[n].color == tw_c) {
-				++stats.other_writable; ++stats.sticky;
-			} else if (file_info[n].color == ow_c) {
-				++stats.other_writable;
-			} else
-				if (file_info[n].color == st_c) {
-					++stats.sticky;
-			}
-			}
+		} else {
+			file_info[n].color = stat_ok == 1 ? ((attr.st_mode & S_ISVTX)
+				? ((attr.st_mode & S_IWOTH) ? tw_c : st_c)
+				: ((attr.st_mode & S_IWOTH) ? ow_c
+				: (file_info[n].filesn == 0 ? ed_c : di_c)))
+				: (pf->pending == 1 ? di_c : df_c);
+		}
+		}
 
-			break;
+		break;
 
-		case DT_LNK: {
+	case DT_LNK: {
 #ifndef _NO_ICONS
-			file_info[n].icon = ICON_LINK;
+		file_info[n].icon = ICON_LINK;
 #endif /* !_NO_ICONS */
-			if (follow_symlinks == 0) {
-				file_info[n].color = ln_c;
-				break;
-			}
-
-			struct stat attrl;
-			if (fstatat(fd, ename, &attrl, 0) == -1) {
-				file_info[n].color = or_c;
-				file_info[n].xattr = 0;
-				++stats.broken_link;
-				break;
-			}
+		if (follow_symlinks == 0 || pf->pending == 1) {
+			file_info[n].color = ln_c;
+			break;
+		}
 
-			/* We only need the symlink target name provided the target
-			 * is not a directory, because get_link_target_color() will
-			 * check the file name extension. get_dir_color() only needs
-			 * this name to run count_dir(), but we have already executed
-			 * this function. */
-			static char tmp[PATH_MAX + 1]; *tmp = '\0';
-			const ssize_t ret =
-				(conf.color_lnk_as_target == 1 && !S_ISDIR(attrl.st_mode))
-				? readlinkat(XAT_FDCWD, ename, tmp, sizeof(tmp) - 1)
-				: 0;
-			if (ret > 0)
-				tmp[ret] = '\0';
-			const char *lname = *tmp ? tmp : ename;
-
-			if (S_ISDIR(attrl.st_mode)) {
-				file_info[n].dir = 1;
-				file_info[n].filesn = conf.files_counter == 1
-					? (count_dir(ename, NO_CPOP) - 2) : 1;
-
-				const filesn_t dfiles = (conf.files_counter == 1)
-					? (file_info[n].filesn == 2 ? 3
-					: file_info[n].filesn) : 3; /* 3 == populated */
-
-				/* DFILES is negative only if count_dir() failed, which in
-				 * this case only means EACCESS error. */
-				file_info[n].color = conf.color_lnk_as_target == 1
-					? ((dfiles < 0 || check_file_access(attrl.st_mode,
-					attrl.st_uid, attrl.st_gid) == 0) ? nd_c
-					: get_dir_color(lname, attrl.st_mode, attrl.st_nlink,
-					dfiles)) : ln_c;
-			} else {
-				if (conf.color_lnk_as_target == 1)
-					get_link_target_color(lname, &attrl, n);
-				else
-					file_info[n].color = ln_c;
-			}
-			}
+		const struct stat *attrl = pf->lattr;
+		if (!attrl) {
+			file_info[n].color = or_c;
+			file_info[n].xattr = 0;
 			break;
+		}
+
+		/* We only need the symlink target name provided the target
+		 * is not a directory, because get_link_target_color() will
+		 * check the file name extension. get_dir_color() only needs
+		 * this name to run count_dir(), but we have already executed
+		 * this function. */
+		static char tmp[PATH_MAX + 1]; *tmp = '\0';
+		const ssize_t ret =
+			(conf.color_lnk_as_target == 1 && !S_ISDIR(attrl->st_mode))
+			? readlinkat(XAT_FDCWD, ename, tmp, sizeof(tmp) - 1)
+			: 0;
+		if (ret > 0)
+			tmp[ret] = '\0';
+		const char *lname = *tmp ? tmp : ename;
+
+		if (S_ISDIR(attrl->st_mode)) {
+			file_info[n].dir = 1;
+			file_info[n].filesn = pf->filesn;
+
+			const filesn_t dfiles = (conf.files_counter == 1
+			&& file_info[n].filesn != FC_PENDING)
+				? (file_info[n].filesn == 2 ? 3
+				: file_info[n].filesn) : 3; /* 3 == populated */
+
+			/* DFILES is negative only if count_dir() failed, which in
+			 * this case only means EACCESS error. */
+			file_info[n].color = conf.color_lnk_as_target == 1
+				? ((dfiles < 0 || check_file_access(attrl->st_mode,
+				attrl->st_uid, attrl->st_gid) == 0) ? nd_c
+				: get_dir_color(lname, attrl->st_mode, attrl->st_nlink,
+				dfiles)) : ln_c;
+		} else {
+			if (conf.color_lnk_as_target == 1)
+				get_link_target_color(lname, attrl, n);
+			else
+				file_info[n].color = ln_c;
+		}
+		}
+		break;
 
-		case DT_REG: {
+	case DT_REG: {
 #ifdef LINUX_FILE_CAPS
-			cap_t cap;
+		cap_t cap;
 #endif /* !LINUX_FILE_CAPS */
-			/* Do not perform the access check if the user is root. */
-			if (user.uid != 0 && stat_ok == 1
-			&& check_file_access(attr.st_mode, attr.st_uid, attr.st_gid) == 0) {
+		/* Do not perform the access check if the user is root. */
+		if (user.uid != 0 && stat_ok == 1
+		&& check_file_access(attr.st_mode, attr.st_uid, attr.st_gid) == 0) {
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_LOCK;
-				file_info[n].icon_color = YELLOW;
+			file_info[n].icon = ICON_LOCK;
+			file_info[n].icon_color = YELLOW;
 #endif /* !_NO_ICONS */
-				file_info[n].color = nf_c;
-			} else if (stat_ok == 1 && (attr.st_mode & S_ISUID)) {
-				file_info[n].exec = 1;
-				++stats.exec; ++stats.suid;
-				file_info[n].color = su_c;
+			file_info[n].color = nf_c;
+		} else if (stat_ok == 1 && (attr.st_mode & S_ISUID)) {
+			file_info[n].exec = 1;
+			file_info[n].color = su_c;
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_EXEC;
+			file_info[n].icon = ICON_EXEC;
 #endif /* !_NO_ICONS */
-			} else if (stat_ok == 1 && (attr.st_mode & S_ISGID)) {
-				file_info[n].exec = 1;
-				++stats.exec; ++stats.sgid;
-				file_info[n].color = sg_c;
+		} else if (stat_ok == 1 && (attr.st_mode & S_ISGID)) {
+			file_info[n].exec = 1;
+			file_info[n].color = sg_c;
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_EXEC;
+			file_info[n].icon = ICON_EXEC;
 #endif /* !_NO_ICONS */
-			}
+		}
 
 #ifdef LINUX_FILE_CAPS
-			/* Capabilities are stored by the system as extended attributes.
-			 * No xattrs, no caps. */
-			else if (file_info[n].xattr == 1 && (cap = cap_get_file(ename))) {
-				file_info[n].color = ca_c;
-				++stats.caps;
-				cap_free(cap);
-				if (IS_EXEC(attr)) {
-					file_info[n].exec = 1;
-					++stats.exec;
+		/* Capabilities are stored by the system as extended attributes.
+		 * No xattrs, no caps. */
+		else if (file_info[n].xattr == 1 && (cap = cap_get_file(ename))) {
+			file_info[n].color = ca_c;
+			cap_free(cap);
+			if (IS_EXEC(attr)) {
+				file_info[n].exec = 1;
 # ifndef _NO_ICONS
-					file_info[n].icon = ICON_EXEC;
+				file_info[n].icon = ICON_EXEC;
 # endif /* !_NO_ICONS */
-				}
 			}
+		}
 #endif /* LINUX_FILE_CAPS */
 
-			else if (stat_ok == 1 && IS_EXEC(attr)) {
-				file_info[n].exec = 1;
-				++stats.exec;
+		else if (stat_ok == 1 && IS_EXEC(attr)) {
+			file_info[n].exec = 1;
 #ifndef _NO_ICONS
-				file_info[n].icon = ICON_EXEC;
+			file_info[n].icon = ICON_EXEC;
 #endif /* !_NO_ICONS */
-				if (file_info[n].size == 0)
-					file_info[n].color = ee_c;
-				else
-					file_info[n].color = ex_c;
-			} else if (file_info[n].linkn > 1) { /* Multi-hardlink */
-				file_info[n].color = mh_c;
-				++stats.multi_link;
-			} else if (file_info[n].size == 0) {
-				file_info[n].color = ef_c;
-			} else { /* Regular file */
-				file_info[n].color = fi_c;
-			}
+			if (file_info[n].size == 0)
+				file_info[n].color = ee_c;
+			else
+				file_info[n].color = ex_c;
+		} else if (file_info[n].linkn > 1) { /* Multi-hardlink */
+			file_info[n].color = mh_c;
+		} else if (file_info[n].size == 0) {
+			file_info[n].color = ef_c;
+		} else { /* Regular file */
+			file_info[n].color = fi_c;
+		}
 
-			/* Unaccessible files, files with capabilities, multi-hardlink
-			 * and executable files take precedence over temp and file
-			 * extension colors. */
-			const int no_override_color = (file_info[n].color == nf_c
-			|| file_info[n].color == ca_c || file_info[n].color == mh_c
-			|| file_info[n].exec == 1);
+		/* Unaccessible files, files with capabilities, multi-hardlink
+		 * and executable files take precedence over temp and file
+		 * extension colors. */
+		const int no_override_color = (file_info[n].color == nf_c
+		|| file_info[n].color == ca_c || file_info[n].color == mh_c
+		|| file_info[n].exec == 1);
 
-			if (no_override_color == 0
-			&& IS_TEMP_FILE(file_info[n].name, file_info[n].bytes)) {
-				file_info[n].color = bk_c;
-				break;
-			}
+		if (no_override_color == 0
+		&& IS_TEMP_FILE(file_info[n].name, file_info[n].bytes)) {
+			file_info[n].color = bk_c;
+			break;
+		}
 
 #ifndef _NO_ICONS
-			/* The icons check precedence order is this:
-			 * 1. filename or filename.extension
-			 * 2. extension
-			 * 3. file type */
-			/* Check icons for specific file names */
-			const int name_icon_found = (conf.icons == 1)
-				? get_name_icon(file_info[n].name, n) : 0;
+		/* The icons check precedence order is this:
+		 * 1. filename or filename.extension
+		 * 2. extension
+		 * 3. file type */
+		/* Check icons for specific file names */
+		const int name_icon_found = (conf.icons == 1)
+			? get_name_icon(file_info[n].name, n) : 0;
 #endif /* !_NO_ICONS */
 
-			/* Check file extension */
-			char *ext = (no_override_color == 0 && check_ext == 1)
-				? strrchr(file_info[n].name, '.') : (char *)NULL;
+		/* Check file extension */
+		char *ext = (no_override_color == 0 && check_ext == 1)
+			? strrchr(file_info[n].name, '.') : (char *)NULL;
 
-			if (!ext || ext == file_info[n].name || !*(ext + 1))
-				break;
-			else
-				file_info[n].ext_name = ext;
+		if (!ext || ext == file_info[n].name || !*(ext + 1))
+			break;
+		else
+			file_info[n].ext_name = ext;
 #ifndef _NO_ICONS
-			if (name_icon_found == 0 && conf.icons == 1)
-				get_ext_icon(ext, n);
+		if (name_icon_found == 0 && conf.icons == 1)
+			get_ext_icon(ext, n);
 #endif /* !_NO_ICONS */
-			size_t color_len = 0;
-			const char *extcolor = get_ext_color(ext, &color_len);
-			if (!extcolor)
-				break;
-
-			char *t = (char *)xnmalloc(color_len + 4, sizeof(char));
-			*t = '\x1b'; t[1] = '[';
-			memcpy(t + 2, extcolor, color_len);
-			t[color_len + 2] = 'm';
-			t[color_len + 3] = '\0';
-			file_info[n].ext_color = file_info[n].color = t;
-		} /* End of DT_REG block */
-		break;
+		size_t color_len = 0;
+		const char *extcolor = get_ext_color(ext, &color_len);
+		if (!extcolor)
+			break;
 
-		/* For the time being, we have no specific colors for DT_ARCH1,
-		 * DT_ARCH2, and DT_WHT. */
-		case DT_SOCK: file_info[n].color = so_c; break;
-		case DT_FIFO: file_info[n].color = pi_c; break;
-		case DT_BLK: file_info[n].color = bd_c; break;
-		case DT_CHR: file_info[n].color = cd_c; break;
+		char *t = list_alloc(color_len + 4);
+		*t = '\x1b'; t[1] = '[';
+		memcpy(t + 2, extcolor, color_len);
+		t[color_len + 2] = 'm';
+		t[color_len + 3] = '\0';
+		file_info[n].ext_color = file_info[n].color = t;
+	} /* End of DT_REG block */
+	break;
+
+	/* For the time being, we have no specific colors for DT_ARCH1,
+	 * DT_ARCH2, and DT_WHT. */
+	case DT_SOCK: file_info[n].color = so_c; break;
+	case DT_FIFO: file_info[n].color = pi_c; break;
+	case DT_BLK: file_info[n].color = bd_c; break;
+	case DT_CHR: file_info[n].color = cd_c; break;
 #ifdef SOLARIS_DOORS
-		case DT_DOOR: file_info[n].color = oo_c; break;
-		case DT_PORT: file_info[n].color = oo_c; break;
+	case DT_DOOR: file_info[n].color = oo_c; break;
+	case DT_PORT: file_info[n].color = oo_c; break;
 #endif /* SOLARIS_DOORS */
-		case DT_UNKNOWN: file_info[n].color = no_c; break;
-		default: file_info[n].color = df_c; break;
-		}
+	case DT_UNKNOWN: file_info[n].color = no_c; break;
+	default: file_info[n].color = df_c; break;
+	}
 
 #ifndef _NO_ICONS
-		if (xargs.icons_use_file_color == 1 && conf.icons == 1)
-			file_info[n].icon_color = file_info[n].color;
+	if (xargs.icons_use_file_color == 1 && conf.icons == 1)
+		file_info[n].icon_color = file_info[n].color;
 #endif /* !_NO_ICONS */
-		if (conf.long_view == 1 && stat_ok == 1)
-			set_long_attribs(n, &attr);
+	if (conf.long_view == 1 && stat_ok == 1)
+		set_long_attribs(n, &attr);
 
-		if (xargs.disk_usage_analyzer == 1)
-			get_largest(n, &largest_size, &largest_name,
-				&largest_color, &total_size);
+	count_entry_stats(&file_info[n], 1);
+	return 1;
+}
 
-		++n;
-		if (n > FILESN_MAX - 1) {
-			err('w', PRINT_PROMPT, _("%s: Integer overflow detected "
-				"(showing only %jd files)\n"), PROGRAM_NAME, (intmax_t)n);
-			break;
-		}
+/* construct_filename() overwrites the length of trimmed names with the
+ * trimmed length: restore the actual length of names kept from the
+ * previous listing before printing them again */
+static void
+restore_name_lengths(void)
+{
+	if (conf.max_name_len == UNSET || conf.long_view == 1)
+		return;
 
-		++count;
+	filesn_t i = files;
+	while (--i >= 0) {
+		if (file_info[i].utf8 == 0)
+			file_info[i].len = file_info[i].bytes;
+		else if ((int)file_info[i].len >= conf.max_name_len)
+			file_info[i].len = wc_xstrlen(file_info[i].name);
 	}
+}
 
-	/* Since we allocate memory by chunks, we might have allocated more
-	 * than needed. Reallocate only actually used memory.
-	 * NOTE: Haven't been able to measure any memory usage difference
-	 * running this code. */
-/*	filesn_t tdents = total_dents > 0 ? (filesn_t)total_dents : ENTRY_N + 2;
-	if (tdents > n)
-		file_info =
-			xrealloc(file_info, (size_t)(n + 1) * sizeof(struct fileinfo)); */
+/* FNV-1a */
+static inline size_t
+dl_name_hash(const char *name)
+{
+	size_t hash = (size_t)2166136261U;
+	while (*name) {
+		hash = (hash ^ (unsigned char)*name) * (size_t)16777619U;
+		name++;
+	}
 
-	file_info[n].name = (char *)NULL;
-	files = n;
+	return hash;
+}
 
-	if (xargs.disk_usage_analyzer == 1 || (conf.long_view == 1
-	&& conf.full_dir_size == 1)) {
-		fputs("\r            \r", stdout); /* Erase the "Scanning ..." message */
-		fflush(stdout);
-	}
+/* Store in INDEX the index in the files list of each of the N files in
+ * CHANGES, or -1 if not listed. Changed names (at most DL_MAX_CHANGES) are
+ * hashed, and the list is scanned just once, instead of once per change. */
+static void
+find_changed_entries(const struct dl_change_t *changes, const size_t n,
+	filesn_t *index)
+{
+	/* At most half full (DL_MAX_CHANGES is a power of two) */
+	size_t table[DL_MAX_CHANGES * 2];
+	size_t hashes[DL_MAX_CHANGES];
+	const size_t mask = (DL_MAX_CHANGES * 2) - 1;
+	memset(table, 0, sizeof(table));
 
-	if (n == 0) {
-		printf("%s. ..%s\n", di_c, df_c);
-		free(file_info);
-		goto END;
+	size_t i;
+	for (i = 0; i < n; i++) {
+		index[i] = -1;
+		hashes[i] = dl_name_hash(changes[i].name);
+		size_t slot = hashes[i] & mask;
+		while (table[slot] != 0)
+			slot = (slot + 1) & mask;
+		table[slot] = i + 1;
+	}
+
+	filesn_t f;
+	for (f = 0; f < files; f++) {
+		const size_t hash = dl_name_hash(file_info[f].name);
+		size_t slot = hash & mask;
+
+		while (table[slot] != 0) {
+			const size_t c = table[slot] - 1;
+			if (hashes[c] == hash
+			&& strcmp(changes[c].name, file_info[f].name) == 0) {
+				index[c] = f;
+				break;
+			}
+			slot = (slot + 1) & mask;
+		}
 	}
+}
 
-	const int pad = (max_files != UNSET && files > (filesn_t)max_files)
-		? DIGINUM(max_files) : DIGINUM(files);
-
-		/* #############################################
-		 * #    SORT FILES ACCORDING TO SORT METHOD    #
-		 * ############################################# */
+/* Mark the entry at index N to be removed from the files list by
+ * compact_dirlist() */
+static void
+discard_listed_entry(const filesn_t n)
+{
+	count_entry_stats(&file_info[n], -1);
+	/* Strings live in the arena until the whole list is freed */
+	arena.wasted += file_info[n].bytes + 1;
+	if (file_info[n].ext_color)
+		arena.wasted += strlen(file_info[n].ext_color) + 1;
+	if (file_info[n].sort_key)
+		arena.wasted += file_info[n].sort_key_len + 1;
 
-	if (conf.sort != SNONE)
-		ENTSORT(file_info, (size_t)n, entrycmp);
+	file_info[n].name = (char *)NULL;
+}
 
-		/* ##########################################
-		 * #    GET INFO TO PRINT COLUMNED OUTPUT   #
-		 * ########################################## */
+/* Remove entries discarded by discard_listed_entry() from the files list,
+ * moving each remaining entry at most once */
+static void
+compact_dirlist(void)
+{
+	filesn_t i, j = 0;
+	for (i = 0; i < files; i++) {
+		if (!file_info[i].name)
+			continue;
+		if (i != j)
+			file_info[j] = file_info[i];
+		j++;
+	}
 
-	size_t counter = 0;
-	size_t columns_n = 1;
+	files = j;
+}
 
-	/* Get the longest file name */
-	if (conf.columned == 1 || conf.long_view == 1)
-		get_longest_filename(n, (size_t)pad);
+/* Merge the N entries following the last one in the files list (just
+ * loaded by load_entry()) into the (sorted) files list: new entries are
+ * sorted, and both lists are merged from the end, so that each entry is
+ * moved at most once. */
+static void
+insert_listed_entries(const filesn_t n)
+{
+	if (conf.sort == SNONE) {
+		files += n;
+		return;
+	}
 
-				/* ########################
-				 * #    LONG VIEW MODE    #
-				 * ######################## */
+	struct fileinfo *new_ent =
+		(struct fileinfo *)xnmalloc((size_t)n, sizeof(struct fileinfo));
+	memcpy(new_ent, file_info + files, (size_t)n * sizeof(struct fileinfo));
+	qsort(new_ent, (size_t)n, sizeof(struct fileinfo), entrycmp);
 
-	if (conf.long_view == 1) {
-		print_long_mode(&counter, &reset_pager, pad, have_xattr);
+	/* New entries go after existing ones comparing equal */
+	filesn_t i = files - 1, j = n - 1, dst = files + n - 1;
+	while (j >= 0) {
+		if (i >= 0 && entrycmp(&file_info[i], &new_ent[j]) > 0)
+			file_info[dst--] = file_info[i--];
+		else
+			file_info[dst--] = new_ent[j--];
+	}
+
+	files += n;
+	free(new_ent);
+}
+
+/* Update the hidden files counter according to the change C, affecting
+ * a hidden file not included in the files list. EXISTS tells whether the
+ * file exists now. */
+static void
+update_hidden_stats(const struct dl_change_t *c, const int exists)
+{
+	if (c->existed == 1 && exists == 0 && stats.hidden > 0)
+		--stats.hidden;
+	else if (c->existed == 0 && exists == 1)
+		++stats.hidden;
+}
+
+/* Update the files list in place according to the N entries in CHANGES
+ * (files created, removed, renamed, or modified in the current directory).
+ * Only changed files are read again: the remaining entries are kept as
+ * they are, and new entries are inserted at their sorted position.
+ *
+ * Returns 1 if the list changed, 0 if no listed file changed, or -1 if the
+ * list cannot be updated this way, in which case the directory must be
+ * read again. */
+static int
+apply_dirlist_changes(const struct dl_change_t *changes, const size_t n)
+{
+	if (cur_list.updatable == 0 || !file_info || files == 0
+	|| n == 0 || n > DL_MAX_CHANGES || conf.light_mode == 1 || filter.str
+	|| conf.only_dirs == 1 || cur_list.virtual_dir == 1
+	|| xargs.disk_usage_analyzer == 1
+	/* Reading the whole list again reclaims space wasted in the arena */
+	|| arena.wasted > arena.used / 2)
+		return (-1);
+
+	size_t i;
+	if (conf.show_hidden == 0) {
+		for (i = 0; i < n; i++) {
+			/* We cannot tell whether this hidden file was counted */
+			if (*changes[i].name == '.' && changes[i].existed == -1)
+				return (-1);
+		}
+	}
+
+	struct pf_list_t pfl = {0};
+	int changed = 0, removed = 0;
+	cur_list.read_time = time(NULL);
+
+	filesn_t index[DL_MAX_CHANGES];
+	find_changed_entries(changes, n, index);
+
+	for (i = 0; i < n; i++) {
+		const struct dl_change_t *c = &changes[i];
+		struct stat a;
+		const int exists = (lstat(c->name, &a) != -1);
+
+		if (*c->name == '.' && conf.show_hidden == 0) {
+			update_hidden_stats(c, exists);
+			continue;
+		}
+
+		if (index[i] != -1) {
+			discard_listed_entry(index[i]);
+			if (*c->name == '.' && stats.hidden > 0)
+				--stats.hidden;
+			changed = removed = 1;
+		}
+
+		if (exists == 1) {
+			add_pf_entry(&pfl, c->name, a.st_ino, get_dt(a.st_mode));
+			if (*c->name == '.')
+				++stats.hidden;
+		}
+	}
+
+	if (removed == 1)
+		compact_dirlist();
+
+	if (pfl.n > 0) {
+		/* Same as in list_dir(): slow directories must not block us */
+		const int async_fc = (conf.files_counter == 1
+			&& conf.files_counter_timeout > 0 && xargs.list_and_quit != 1);
+
+		prefetch_entries(&pfl, XAT_FDCWD,
+			((conf.files_counter == 1 && async_fc == 0) ? PF_FILES_COUNTER : 0)
+			| (follow_symlinks == 1 ? PF_LINK_TARGETS : 0)
+			| ((conf.long_view == 1 || check_cap == 1) ? PF_XATTRS : 0));
+
+		if (async_fc == 1)
+			count_new_dirs_async(&pfl, workspaces[cur_ws].path);
+
+		file_info = (struct fileinfo *)xrealloc(file_info,
+			((size_t)files + pfl.n + 2) * sizeof(struct fileinfo));
+
+		filesn_t added = 0;
+		for (i = 0; i < pfl.n; i++) {
+			if (load_entry(files + added, &pfl.ent[i], 0) == 1)
+				added++;
+		}
+
+		if (added > 0) {
+			insert_listed_entries(added);
+			changed = 1;
+		}
+	}
+
+	free_pf_list(&pfl);
+
+	if (files == 0) { /* Let list_dir() handle the empty directory */
+		free(file_info);
+		file_info = (struct fileinfo *)NULL;
+		return (-1);
+	}
+
+	file_info[files].name = (char *)NULL;
+
+	return changed;
+}
+
+/* When leaving a directory, its files list (the file_info array, the
+ * arena holding its strings, and the stats struct) is not freed, but kept
+ * by store_cached_list() (up to conf.listing_cache lists, taking at most
+ * conf.listing_cache_size MiB). When going back to the directory,
+ * load_cached_list() hands the whole list back to list_dir(): the
+ * directory is not read again, and only files that changed in the meantime
+ * are (see check_cached_entries()).
+ * A list is stored only if it was up to date when leaving the directory:
+ * no pending file system events, no pending files counter, and no change
+ * to the directory since its entries were read. It is reused only if the
+ * directory (modification and change times) and the options used to load
+ * it did not change in the meantime. */
+
+struct list_cache_entry_t {
+	struct dirlist_t list;
+	struct list_arena_t arena;
+	struct stats_t stats;
+	struct fileinfo *fi;
+	filesn_t files;
+	size_t bytes;  /* Memory taken by this list */
+	size_t last_used;
+	time_t mtime;  /* Directory times when the list was stored */
+	time_t ctime;
+};
+
+struct list_cache_t {
+	struct list_cache_entry_t *ent;
+	size_t n;
+	size_t bytes;
+	size_t clock;
+};
+
+static struct list_cache_t list_cache = {0};
+
+static void
+get_list_opts(struct list_opts_t *o)
+{
+	*o = (struct list_opts_t){0};
+	o->sort = conf.sort;
+	o->sort_reverse = conf.sort_reverse;
+	o->show_hidden = conf.show_hidden;
+	o->only_dirs = conf.only_dirs;
+	o->long_view = conf.long_view;
+	o->prop_time = prop_fields.time;
+	o->files_counter = conf.files_counter;
+	o->follow_symlinks = follow_symlinks;
+	o->color_lnk_as_target = conf.color_lnk_as_target;
+	o->colorize = conf.colorize;
+	o->icons = conf.icons;
+	o->icons_use_file_color = xargs.icons_use_file_color;
+	o->apparent_size = conf.apparent_size;
+	o->case_sens_list = conf.case_sens_list;
+	o->list_dirs_first = conf.list_dirs_first;
+	o->check_cap = check_cap;
+	o->check_ext = check_ext;
+	o->full_dir_size = conf.full_dir_size;
+}
+
+/* Remove the entry at index I from the files list cache. If KEEP is set,
+ * the list itself is not freed (it was handed over to list_dir()). */
+static void
+remove_cached_list(const size_t i, const int keep)
+{
+	struct list_cache_entry_t *e = &list_cache.ent[i];
+
+	list_cache.bytes -= e->bytes;
+	if (keep == 0) {
+		free_list_blocks(e->arena.blocks);
+		free(e->fi);
+		free(e->list.path);
+	}
+
+	list_cache.n--;
+	if (i < list_cache.n)
+		*e = list_cache.ent[list_cache.n];
+}
+
+void
+purge_listing_cache(void)
+{
+	while (list_cache.n > 0)
+		remove_cached_list(list_cache.n - 1, 0);
+
+	free(list_cache.ent);
+	list_cache = (struct list_cache_t){0};
+}
+
+/* Return the index of the cached list for the directory PATH, or -1 */
+static ssize_t
+find_cached_list(const char *path)
+{
+	size_t i;
+	for (i = 0; i < list_cache.n; i++) {
+		if (strcmp(list_cache.ent[i].list.path, path) == 0)
+			return (ssize_t)i;
+	}
+
+	return (-1);
+}
+
+/* Return 1 if the current files list was up to date when leaving the
+ * directory, or 0 otherwise. A is the current state of the directory. */
+static int
+dirlist_is_current(const struct stat *a)
+{
+	if (a->st_dev != cur_list.dev || a->st_ino != cur_list.ino
+	/* Changed after (or in the same second) entries were read */
+	|| a->st_mtime >= cur_list.read_time || a->st_ctime >= cur_list.read_time)
+		return 0;
+
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+	/* Changes not yet applied to the list (see update_dirlist()) */
+	if (fs_events_timeout() != -1)
+		return 0;
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
+	if (conf.files_counter == 1) {
+		filesn_t i = files;
+		while (--i >= 0) {
+			if (file_info[i].filesn == FC_PENDING)
+				return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Keep the current files list in the files list cache (evicting the least
+ * recently used lists if needed), instead of freeing it.
+ * Returns 1 if the list was stored (file_info and the arena are now owned
+ * by the cache), or 0 otherwise. */
+static int
+store_cached_list(void)
+{
+	if (cur_list.cacheable == 0 || !cur_list.path || conf.listing_cache <= 0
+	|| !file_info || files == 0)
+		return 0;
+
+	struct stat a;
+	if (stat(cur_list.path, &a) == -1 || dirlist_is_current(&a) == 0)
+		return 0;
+
+	size_t bytes = ((size_t)files + 2) * sizeof(struct fileinfo);
+	const struct list_block_t *b;
+	for (b = arena.blocks; b; b = b->next)
+		bytes += sizeof(struct list_block_t) + b->size;
+
+	const size_t max_bytes = (size_t)conf.listing_cache_size * 1024 * 1024;
+	if (max_bytes > 0 && bytes > max_bytes)
+		return 0;
+
+	/* This list supersedes any other list for the same directory */
+	const ssize_t old = find_cached_list(cur_list.path);
+	if (old != -1)
+		remove_cached_list((size_t)old, 0);
+
+	while (list_cache.n > 0 && (list_cache.n >= (size_t)conf.listing_cache
+	|| (max_bytes > 0 && list_cache.bytes + bytes > max_bytes))) {
+		size_t i, lru = 0;
+		for (i = 1; i < list_cache.n; i++) {
+			if (list_cache.ent[i].last_used < list_cache.ent[lru].last_used)
+				lru = i;
+		}
+		remove_cached_list(lru, 0);
+	}
+
+	list_cache.ent = (struct list_cache_entry_t *)xrealloc(list_cache.ent,
+		(list_cache.n + 1) * sizeof(struct list_cache_entry_t));
+
+	struct list_cache_entry_t *e = &list_cache.ent[list_cache.n++];
+	e->list = cur_list;
+	e->arena = arena;
+	e->stats = stats;
+	e->fi = file_info;
+	e->files = files;
+	e->bytes = bytes;
+	e->last_used = ++list_cache.clock;
+	e->mtime = a.st_mtime;
+	e->ctime = a.st_ctime;
+	list_cache.bytes += bytes;
+
+	cur_list.path = (char *)NULL;
+	cur_list.cacheable = 0;
+	arena = (struct list_arena_t){0};
+	file_info = (struct fileinfo *)NULL;
+
+	return 1;
+}
+
+/* Check the entries of the current files list (just taken from the cache)
+ * against the file system (FD is the directory file descriptor): modifying
+ * a file in place (say, its contents, permissions, or, for a subdirectory,
+ * the files it contains) does not modify the directory itself. The names
+ * of changed entries (a different change time, or one not older than the
+ * list) are stored in CHANGES. Symlinks are always read again if their
+ * targets are checked: we know nothing about them.
+ * Unchanged entries are marked as selected or not, using the device they
+ * actually live in (it might be a mount point).
+ * Returns the number of changed entries, or DL_MAX_CHANGES + 1 if there
+ * are too many of them. */
+static size_t
+check_cached_entries(const int fd, struct dl_change_t *changes)
+{
+	size_t n = 0;
+	filesn_t i;
+
+	for (i = 0; i < files; i++) {
+		struct fileinfo *f = &file_info[i];
+		struct stat a;
+
+		if (fstatat(fd, f->name, &a, AT_SYMLINK_NOFOLLOW) != -1
+		&& a.st_ino == f->inode && a.st_ctime == f->ctime
+		&& a.st_ctime < cur_list.read_time
+		&& (f->symlink == 0 || follow_symlinks == 0)) {
+			f->sel = check_seltag(a.st_dev, f->inode, f->linkn, i);
+			continue;
+		}
+
+		if (n == DL_MAX_CHANGES)
+			return n + 1;
+		changes[n].name = f->name;
+		changes[n].existed = 1;
+		n++;
+	}
+
+	return n;
+}
+
+/* If there is a valid cached files list for the current directory, whose
+ * attributes are A and whose file descriptor is FD, make it the current
+ * files list, and return 1. Otherwise, return 0. Lists are only reused
+ * when changing directories: otherwise, the list is being explicitly read
+ * again. */
+static int
+load_cached_list(const struct stat *a, const int fd)
+{
+	if (list_cache.n == 0)
+		return 0;
+
+	const ssize_t index = find_cached_list(workspaces[cur_ws].path);
+	if (index == -1)
+		return 0;
+
+	struct list_cache_entry_t *e = &list_cache.ent[index];
+	struct list_opts_t opts;
+	get_list_opts(&opts);
+
+	if (dir_changed == 0 || conf.listing_cache <= 0
+	|| e->list.dev != a->st_dev || e->list.ino != a->st_ino
+	|| e->mtime != a->st_mtime || e->ctime != a->st_ctime
+	|| memcmp(&e->list.opts, &opts, sizeof(opts)) != 0) {
+		remove_cached_list((size_t)index, 0);
+		return 0;
+	}
+
+	cur_list = e->list;
+	arena = e->arena;
+	stats = e->stats;
+	file_info = e->fi;
+	files = e->files;
+	remove_cached_list((size_t)index, 1);
+
+	/* Read changed entries again (the selection might have changed in
+	 * the meantime as well) */
+	struct dl_change_t changes[DL_MAX_CHANGES];
+	const size_t n = check_cached_entries(fd, changes);
+	if (n > DL_MAX_CHANGES
+	|| (n > 0 && apply_dirlist_changes(changes, n) == -1)) {
+		free_list_arena();
+		free(file_info);
+		file_info = (struct fileinfo *)NULL;
+		files = 0;
+		free(cur_list.path);
+		cur_list = (struct dirlist_t){0};
+		cur_list.dev = a->st_dev;
+		cur_list.ino = a->st_ino;
+		stats = (struct stats_t){0};
+		return 0;
+	}
+
+	restore_name_lengths();
+	return 1;
+}
+
+/* Mark the current files list as cacheable (see store_cached_list()), if
+ * possible */
+static void
+set_list_cacheable(void)
+{
+	if (conf.listing_cache <= 0 || cur_list.pending == 1
+	|| cur_list.virtual_dir == 1 || cur_list.ino == 0 || filter.str
+	|| xargs.disk_usage_analyzer == 1 || xargs.list_and_quit == 1
+	|| (conf.long_view == 1 && conf.full_dir_size == 1))
+		return;
+
+	cur_list.path = savestring(workspaces[cur_ws].path,
+		strlen(workspaces[cur_ws].path));
+	get_list_opts(&cur_list.opts);
+	cur_list.cacheable = 1;
+}
+
+/* Return 1 if files can be listed before their stat data is available (see
+ * lazystat.c), or 0 otherwise: long view, sorting by size, times, owner,
+ * or group, and filtering by file type need stat data for every file.
+ * So does a directory not providing the type of some of its files
+ * (UNKNOWN_TYPES is set, i.e. d_type is DT_UNKNOWN): we would have no
+ * way to tell directories from regular files. */
+static int
+use_lazy_stat(const int virtual_dir, const int unknown_types)
+{
+#if !defined(_DIRENT_HAVE_D_TYPE)
+	UNUSED(virtual_dir); UNUSED(unknown_types);
+	return 0;
+#else
+	if (conf.lazy_stat_timeout <= 0 || xargs.list_and_quit == 1
+	|| virtual_dir == 1 || unknown_types == 1 || conf.long_view == 1
+	|| xargs.disk_usage_analyzer == 1
+	|| (filter.str && filter.type == FILTER_FILE_TYPE))
+		return 0;
+
+	switch (conf.sort) {
+	case SNONE: /* fallthrough */
+	case SNAME: /* fallthrough */
+	case SVER:  /* fallthrough */
+	case SEXT:  /* fallthrough */
+	case SINO: return 1;
+	default: return 0;
+	}
+#endif /* !_DIRENT_HAVE_D_TYPE */
+}
+
+/* List files in the current working directory. Uses file type colors
+ * and columns. Return 0 on success or 1 on error. */
+int
+list_dir(void)
+{
+#ifdef LIST_SPEED_TEST
+	clock_t start = clock();
+#endif /* LIST_SPEED_TEST */
+
+	/* Nothing is written to the terminal until the whole list is ready
+	 * (see frame.c) */
+	frame_begin();
+
+	if (conf.clear_screen == 1)
+		FRAME_CLEAR;
+
+	/* Hide the cursor to minimize flickering: it will be unhidden immediately
+	 * before printing the next prompt (prompt.c) */
+	if (xargs.list_and_quit != 1)
+		FRAME_HIDE_CURSOR;
+
+	if (autocmds_n > 0 && dir_changed == 1) {
+		if (autocmd_set == 1)
+			revert_autocmd_opts();
+		check_autocmds();
+	}
+
+	if (dir_changed == 1 && dir_out == 1) {
+		frame_flush();
+		run_dir_cmd(DIR_OUT);
+		dir_out = 0;
+	}
+
+	if (conf.clear_screen == 1) {
+		/* For some reason we need to clear the screen twice to prevent
+		 * a garbage first line when scrolling up */
+		FRAME_CLEAR;
+	}
+
+	if (xargs.disk_usage_analyzer == 1
+	|| (conf.long_view == 1 && conf.full_dir_size == 1)) {
+		FRAME_UNHIDE_CURSOR;
+		frame_puts(_("Scanning... "));
+		frame_flush();
+		if (xargs.list_and_quit != 1)
+			FRAME_HIDE_CURSOR;
+	}
+
+	if (conf.unicode == 0) {
+		trim.state = trim.a = trim.b = 0;
+		trim.len = 0;
+	}
+
+	/* Reset the stats struct */
+	stats = (struct stats_t){0};
+	get_term_size();
+
+	if (conf.long_view == 1)
+		props_now = time(NULL);
+
+	free(cur_list.path);
+	cur_list = (struct dirlist_t){0};
+
+	if (conf.light_mode == 1) {
+		const int ret = list_dir_light();
+		frame_end();
+		return ret;
+	}
+
+	const int virtual_dir =
+		(stdin_tmp_dir && strcmp(stdin_tmp_dir, workspaces[cur_ws].path) == 0);
+
+	DIR *dir;
+	struct dirbuf_t db;
+	xdirent_t *ent;
+	struct pf_list_t pfl = {0};
+	int reset_pager = 0;
+	uint8_t close_dir = 1;
+
+	cur_list.virtual_dir = virtual_dir;
+	cur_list.have_btime = (conf.sort == SBTIME);
+
+	/* A few variables for the disk usage analyzer mode */
+	off_t largest_size = 0, total_size = 0;
+	char *largest_name = (char *)NULL, *largest_color = (char *)NULL;
+
+	if ((dir = opendir(workspaces[cur_ws].path)) == NULL) {
+		frame_flush();
+		xerror("%s: %s: %s\n", PROGRAM_NAME, workspaces[cur_ws].path,
+			strerror(errno));
+		close_dir = 0;
 		goto END;
 	}
 
-				/* ########################
-				 * #   NORMAL VIEW MODE   #
-				 * ######################## */
+	set_events_checker();
 
-	/* Get amount of columns needed to print files in CWD  */
-	columns_n = conf.columned == 0 ? 1 : get_columns();
+	const int fd = dirfd(dir);
 
-	if (conf.listing_mode == VERTLIST) /* ls(1) like listing */
-		list_files_vertical(&counter, &reset_pager, pad, columns_n);
-	else
-		list_files_horizontal(&counter, &reset_pager, pad, columns_n);
+	struct stat dir_attr;
+	if (fstat(fd, &dir_attr) != -1) {
+		cur_list.dev = dir_attr.st_dev;
+		cur_list.ino = dir_attr.st_ino;
+
+		/* Going back to a recently visited directory: reuse its files
+		 * list, if still valid (see store_cached_list()) */
+		if (load_cached_list(&dir_attr, fd) == 1) {
+			if (dir_changed == 1)
+				run_autocmd_files(cur_list.autocmd_files);
+			print_dirlist(&reset_pager);
+			goto END;
+		}
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	/* A hint to the kernel to optimize current dir for reading */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* POSIX_FADV_SEQUENTIAL */
+
+		/* ##########################################
+		 * #    GATHER AND STORE FILE INFORMATION   #
+		 * ########################################## */
+
+	errno = 0;
+	filesn_t n = 0;
+	int unknown_types = 0;
+	cur_list.read_time = time(NULL);
+
+	init_dirbuf(&db, dir);
+	while ((ent = read_dirbuf(&db))) {
+		const char *ename = ent->d_name;
+		/* Skip self and parent directories */
+		if (SELFORPARENT(ename))
+			continue;
+
+		/* Check .cfm.in and .cfm.out files for the autocommands function */
+		if (*ename == '.')
+			cur_list.autocmd_files |= get_autocmd_file(ename + 1);
+
+		/* Filter files according to a regex filter */
+		if (filter.str && filter.type == FILTER_FILE_NAME) {
+			if (regexec(&regex_exp, ename, 0, NULL, 0) == EXIT_SUCCESS) {
+				if (filter.rev == 1) {
+					++cur_list.excluded;
+					continue;
+				}
+			} else if (filter.rev == 0) {
+				++cur_list.excluded;
+				continue;
+			}
+		}
+
+		if (*ename == '.') {
+			++stats.hidden;
+			if (conf.show_hidden == 0)
+				continue;
+		}
+
+#if defined(_DIRENT_HAVE_D_TYPE)
+		if (ent->d_type == DT_UNKNOWN)
+			unknown_types = 1;
+		add_pf_entry(&pfl, ename, ent->d_ino, ent->d_type);
+#else
+		add_pf_entry(&pfl, ename, ent->d_ino, DT_UNKNOWN);
+#endif /* _DIRENT_HAVE_D_TYPE */
+	}
+
+	free_dirbuf(&db);
+
+	if (dir_changed == 1)
+		run_autocmd_files(cur_list.autocmd_files);
+
+	const int async_fc = (conf.files_counter == 1
+		&& conf.files_counter_timeout > 0 && xargs.list_and_quit != 1);
+
+	const int pf_flags = (virtual_dir == 1 ? PF_FOLLOW_LINKS : 0)
+		| ((conf.files_counter == 1 && async_fc == 0) ? PF_FILES_COUNTER : 0)
+		| (follow_symlinks == 1 ? PF_LINK_TARGETS : 0)
+		| ((conf.long_view == 1 || check_cap == 1) ? PF_XATTRS : 0);
+
+	/* Do not wait for slow stat data: list files using d_type, and refresh
+	 * the list once the data is available. See lazystat.c */
+	if (use_lazy_stat(virtual_dir, unknown_types) == 1
+	&& lazy_stat_entries(&pfl, fd,
+	workspaces[cur_ws].path, pf_flags) == 1)
+		cur_list.pending = 1;
+
+	if (cur_list.pending == 0) {
+		/* Run all the I/O needed to display the entries we just read
+		 * (possibly in parallel). See prefetch.c */
+		prefetch_entries(&pfl, fd, pf_flags);
+
+		/* Count files in subdirectories in the background, so that slow
+		 * directories do not block the list. See fcounter.c */
+		if (async_fc == 1)
+			count_dirs_async(&pfl, workspaces[cur_ws].path);
+	}
+
+	file_info =
+		(struct fileinfo *)xnmalloc(pfl.n + 2, sizeof(struct fileinfo));
+
+	size_t ent_n;
+	for (ent_n = 0; ent_n < pfl.n; ent_n++) {
+		if (load_entry(n, &pfl.ent[ent_n], virtual_dir) == 0)
+			continue;
+
+		if (xargs.disk_usage_analyzer == 1)
+			get_largest(n, &largest_size, &largest_name,
+				&largest_color, &total_size);
+
+		++n;
+		if (n > FILESN_MAX - 1) {
+			err('w', PRINT_PROMPT, _("%s: Integer overflow detected "
+				"(showing only %jd files)\n"), PROGRAM_NAME, (intmax_t)n);
+			break;
+		}
+	}
+
+	free_pf_list(&pfl);
+
+	file_info[n].name = (char *)NULL;
+	files = n;
+
+	if (xargs.disk_usage_analyzer == 1 || (conf.long_view == 1
+	&& conf.full_dir_size == 1)) {
+		frame_puts("\r            \r"); /* Erase the "Scanning ..." message */
+	}
+
+	if (n == 0) {
+		xprintf("%s. ..%s\n", di_c, df_c);
+		free(file_info);
+		goto END;
+	}
+
+		/* #############################################
+		 * #    SORT FILES ACCORDING TO SORT METHOD    #
+		 * ############################################# */
+
+	if (conf.sort != SNONE && sort_by_keys(file_info, n) == -1)
+		ENTSORT(file_info, (size_t)n, entrycmp);
+
+	/* Pending entries will be replaced as a whole by lazy_stat_refresh() */
+	cur_list.updatable = (cur_list.pending == 0);
+	set_list_cacheable();
+	print_dirlist(&reset_pager);
 
 				/* #########################
 				 * #   POST LISTING STUFF  #
@@ -2805,10 +3849,7 @@ list_dir(void)
 
 END:
 	exit_code = post_listing(dir, close_dir, reset_pager);
-	if (virtual_dir == 1)
-		print_reload_msg(_("Virtual directory\n"));
-	if (excluded_files > 0)
-		printf(_("Excluded files: %zd\n"), excluded_files);
+	print_dirlist_msgs();
 
 	if (xargs.disk_usage_analyzer == 1 && conf.long_view == 1
 	&& conf.full_dir_size == 1) {
@@ -2818,27 +3859,136 @@ END:
 
 #ifdef LIST_SPEED_TEST
 	clock_t end = clock();
-	printf("list_dir time: %f\n", (double)(end - start) / CLOCKS_PER_SEC);
+	xprintf("list_dir time: %f\n", (double)(end - start) / CLOCKS_PER_SEC);
 #endif /* LIST_SPEED_TEST */
 
+	frame_end();
 	return exit_code;
 }
 
 void
 free_dirlist(void)
 {
-	if (!file_info || files == 0)
-		return;
+#ifdef LIST_SPEED_TEST
+	clock_t start = clock();
+	const size_t arena_used = arena.used;
+#endif /* LIST_SPEED_TEST */
 
-	filesn_t i = files;
-	while (--i >= 0) {
-		free(file_info[i].name);
-		if (file_info[i].ext_color)
-			free(file_info[i].ext_color);
+	/* Keep the list in case we come back to this directory */
+	store_cached_list();
+	free(cur_list.path);
+	cur_list.path = (char *)NULL;
+
+	free_list_arena();
+
+	if (file_info && files > 0) {
+		free(file_info);
+		file_info = (struct fileinfo *)NULL;
 	}
 
-	free(file_info);
-	file_info = (struct fileinfo *)NULL;
+#ifdef LIST_SPEED_TEST
+	clock_t end = clock();
+	xprintf("free_dirlist time: %f (%zu bytes in the arena)\n",
+		(double)(end - start) / CLOCKS_PER_SEC, arena_used);
+#endif /* LIST_SPEED_TEST */
+}
+
+/* Print the current files list again */
+static void
+redraw_dirlist(void)
+{
+	const int bk = exit_code;
+	int reset_pager = 0;
+
+	frame_begin();
+
+	if (conf.clear_screen == 1)
+		FRAME_CLEAR;
+	FRAME_HIDE_CURSOR;
+	if (conf.clear_screen == 1)
+		FRAME_CLEAR;
+
+	if (conf.unicode == 0) {
+		trim.state = trim.a = trim.b = 0;
+		trim.len = 0;
+	}
+
+	restore_name_lengths();
+	get_term_size();
+	if (conf.long_view == 1)
+		props_now = time(NULL);
+
+	print_dirlist(&reset_pager);
+	post_listing(NULL, 0, reset_pager);
+	print_dirlist_msgs();
+	frame_end();
+
+	exit_code = bk;
+}
+
+/* Update the files list according to the N entries in CHANGES, as reported
+ * by the file system events monitor (see apply_dirlist_changes()), and
+ * print it again.
+ *
+ * Returns 1 if the list was printed again, 0 if no listed file changed, or
+ * -1 if the list cannot be updated this way, in which case the caller must
+ * run reload_dirlist(). */
+int
+update_dirlist(const struct dl_change_t *changes, const size_t n)
+{
+#ifdef RUN_CMD
+	if (cmd_line_cmd)
+		return 0;
+#endif /* RUN_CMD */
+
+	const int ret = apply_dirlist_changes(changes, n);
+	if (ret == 1)
+		redraw_dirlist();
+
+	return ret;
+}
+
+/* Sort the current files list again (after changing the sort method or
+ * order) and print it, without reading the directory again: all the
+ * needed information is already in the list.
+ * Returns -1 if the list cannot be sorted in place, in which case the
+ * caller should reload it, or 0 otherwise. */
+int
+resort_dirlist(void)
+{
+#ifdef RUN_CMD
+	if (cmd_line_cmd)
+		return (-1);
+#endif /* RUN_CMD */
+
+	if (cur_list.updatable == 0 || !file_info || files == 0
+	|| conf.light_mode == 1)
+		return (-1);
+
+	filesn_t i;
+
+#if defined(ST_BTIME) && !defined(__sun) && defined(LINUX_STATX)
+	if (conf.sort == SBTIME && cur_list.have_btime == 0) {
+		for (i = 0; i < files; i++)
+			file_info[i].btime = get_btime(file_info[i].name);
+		cur_list.have_btime = 1;
+	}
+#endif /* ST_BTIME && !__sun && LINUX_STATX */
+
+	/* Name sort keys are not built for all sort methods */
+	for (i = 0; i < files; i++) {
+		if (!file_info[i].sort_key)
+			set_sort_key(i);
+	}
+
+	if (sort_by_keys(file_info, files) == -1)
+		ENTSORT(file_info, (size_t)files, entrycmp);
+
+	cur_list.opts.sort = conf.sort;
+	cur_list.opts.sort_reverse = conf.sort_reverse;
+
+	redraw_dirlist();
+	return 0;
 }
 
 void
@@ -2863,6 +4013,8 @@ refresh_screen(void)
 		return;
 	}
 
+	/* The screen could have been messed up by someone else */
+	frame_invalidate();
 	int bk = conf.clear_screen;
 	conf.clear_screen = 1;
 	reload_dirlist();
@@ -25,16 +25,27 @@
 #ifndef LISTING_H
 #define LISTING_H
 
+/* Past this amount of changed files, reading the whole directory again
+ * is cheaper than updating the files list in place */
+#define DL_MAX_CHANGES 256
+
+/* A file changed in the current directory, as reported by the file system
+ * events monitor (see read_inotify()) */
+struct dl_change_t {
+	char *name;
+	int existed; /* Existed before the change: 1, 0, or -1 (unknown) */
+	int pad0;
+};
+
 __BEGIN_DECLS
 
 void free_dirlist(void);
 int  list_dir(void);
+void purge_listing_cache(void);
 void reload_dirlist(void);
+int  resort_dirlist(void);
 void refresh_screen(void);
-
-#ifndef _NO_ICONS
-void init_icons_hashes(void);
-#endif /* !_NO_ICONS */
+int  update_dirlist(const struct dl_change_t *, const size_t);
 
 __END_DECLS
 
@@ -42,19 +42,18 @@
 #include "checks.h"
 #include "config.h"
 #include "exec.h"
+#include "frame.h"
 #include "history.h"
 #include "init.h"
-#include "jump.h"
 #include "keybinds.h"
 #include "listing.h"
 #include "misc.h"
-#ifndef _NO_PROFILES
-# include "profiles.h"
-#endif /* !_NO_PROFILES */
 #include "prompt.h"
 #include "properties.h" /* do_stat_and_exit() */
 #include "readline.h"
 #include "remotes.h"
+#include "selection.h" /* get_sel_files() */
+#include "startup.h"
 #ifdef SECURITY_PARANOID
 # include "sanitize.h"
 #endif /* SECURITY_PARANOID */
@@ -230,13 +229,9 @@ size_t
 	trash_n = 0,
 	usrvar_n = 0,
 	words_num = 0,
-	zombies = 0;
-
-#if !defined(_NO_ICONS)
-size_t *name_icons_hashes = (size_t *)0;
-size_t *dir_icons_hashes = (size_t *)0;
-size_t *ext_icons_hashes = (size_t *)0;
-#endif /* !_NO_ICONS */
+	zombies = 0,
+	/* bin_commands indices sorted by name (see get_path_programs()) */
+	*bin_commands_idx = (size_t *)NULL;
 
 char
 	cur_prompt_name[NAME_MAX + 1] = "",
@@ -804,6 +799,7 @@ int inotify_fd = UNSET, inotify_wd = UNSET;
 int watch = UNSET;
 unsigned int INOTIFY_MASK =
 	IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVE | IN_MOVE_SELF
+	| IN_ATTRIB
 /*#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0)
 	| IN_DONT_FOLLOW | IN_EXCL_UNLINK | IN_ONLYDIR | IN_MASK_CREATE;
 #else */
@@ -1125,6 +1121,7 @@ main(int argc, char *argv[])
 		exit(EINVAL);
 	}
 
+	init_startup_profile();
 	check_term(); /* Let's check terminal capabilities. */
 
 	/* # 1. INITIALIZE EVERYTHING WE NEED # */
@@ -1132,9 +1129,6 @@ main(int argc, char *argv[])
 	init_conf_struct();
 	init_filter();
 	init_msgs();
-#ifndef _NO_ICONS
-	init_icons_hashes();
-#endif /* !_NO_ICONS */
 /*	init_file_flags(); */
 
 	set_locale();
@@ -1185,6 +1179,7 @@ main(int argc, char *argv[])
 	 * per user basis. */
 	init_config();
 	check_options();
+	startup_phase("configuration");
 
 	if (xargs.stat > 0) /* Running with --stat(-full). Print and exit. */
 		do_stat_and_exit(xargs.stat == FULL_STAT ? 1 : 0);
@@ -1199,17 +1194,18 @@ main(int argc, char *argv[])
 	load_actions();
 	get_aliases();
 
-	/* Get the list of available programs in PATH to be used by the
-	 * custom TAB-completion function (tab_complete(), in tabcomp.c). */
-	if (!(flags & PATH_PROGRAMS_ALREADY_LOADED))
-		get_path_programs();
+	startup_phase("actions and aliases");
 
-	/* Check third-party programs availability: finders (fzf, fnf, smenu),
-	 * udevil, and udisks2. */
-	check_third_party_cmds();
-#ifndef _NO_FZF
-	check_completion_mode();
-#endif /* _NO_FZF */
+	/* Subsystems not needed by the first files list and prompt are
+	 * initialized while waiting for input, or when first needed
+	 * (see startup.c). */
+	defer_startup_task(STARTUP_PATH_PROGRAMS);
+	defer_startup_task(STARTUP_JUMPDB);
+	defer_startup_task(STARTUP_BOOKMARKS);
+	defer_startup_task(STARTUP_TAGS);
+#ifndef _NO_PROFILES
+	defer_startup_task(STARTUP_PROFILES);
+#endif /* !_NO_PROFILES */
 
 	/* Initialize gettext() for translations. */
 #ifndef _NO_GETTEXT
@@ -1226,6 +1222,7 @@ main(int argc, char *argv[])
 
 	load_remotes();
 	automount_remotes();
+	startup_phase("remotes");
 	print_splash_screen();
 	set_start_path();
 	check_working_directory();
@@ -1234,19 +1231,15 @@ main(int argc, char *argv[])
 	load_dirhist();
 	add_to_dirhist(workspaces[cur_ws].path);
 	get_sel_files();
+	startup_phase("start path and profile");
 
 	/* Start listing as soon as possible to speed up startup time. */
 	list_files();
+	startup_phase("first files list");
 
 	shell = get_sys_shell();
 	create_kbinds_file();
-	load_bookmarks();
 	load_keybinds();
-	load_tags();
-	load_jumpdb();
-	if (!jump_db || xargs.path == 1)
-		add_to_jumpdb(workspaces[cur_ws].path);
-
 	initialize_readline();
 	get_prompt_cmds();
 
@@ -1264,12 +1257,9 @@ main(int argc, char *argv[])
 	/* Store history into an array to be able to manipulate it. */
 	get_history();
 
-#ifndef _NO_PROFILES
-	get_profile_names();
-#endif /* !_NO_PROFILES */
-
 	load_pinned_dir();
 	init_workspaces_opts();
+	startup_phase("readline and history");
 
 	/* # 2. MAIN PROGRAM LOOP # */
 	run_main_loop();
@@ -461,7 +461,12 @@ files in the current directory:\n\n\
 
 #define FZ_USAGE "Toggle full directory size on/off (only for long view mode)\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
-  fz [on, off]"
+  fz [on, off, cache [purge]]\n\n\
+\x1b[1mEXAMPLES\x1b[0m\n\
+- Print directory size cache statistics (see DirSizeCache in the config file)\n\
+    fz cache\n\
+- Clear the directory size cache\n\
+    fz cache purge"
 
 #define HELP_USAGE "Get help\n\n\
 \x1b[1mUSAGE\x1b[0m\n\
@@ -1267,6 +1272,9 @@ emulator using the TerminalCmd option in the configuration file"
 /* Misc messages */
 #define PAGER_HELP "?, h: help\nDown arrow, Enter, Space: Advance one line\n\
 Page Down: Advance one page\nq: Stop pagging\n"
+#define PAGER_WINDOW_HELP "?, h: help\nDown arrow, Enter, Space, Page Down: \
+Next page\nUp arrow, b, Page Up: Previous page\nHome, g: First page\n\
+End, G: Last page\nq: Stop paging\n"
 #define PAGER_LABEL "\x1b[7;97m--Mas--\x1b[0;49m"
 #define NOT_AVAILABLE "This feature has been disabled at compile time"
 #define STEALTH_DISABLED "Access to configuration files is not allowed in stealth mode"
@@ -1436,6 +1444,7 @@ CliFM's built-in opener\
       --si\t\t\t Print sizes in powers of 1000 instead of 1024\
 \n      --smenutab\t\t Use smenu to display completion matches\
 \n      --sort-reverse\t\t Sort in reverse order, e.g. z-a instead of a-z\
+\n      --startup-profile\t\t Print the time taken by each startup phase at exit\
 \n      --stat=FILE\t\t Run the 'p' command on FILE and exit\
 \n      --stat-full=FILE\t\t Run the 'pp' command on FILE and exit\
 \n      --stdtab\t\t\t Force the use of the standard TAB completion mode (readline)\
@@ -61,7 +61,10 @@ typedef char *rl_cpvfunc_t;
 #include "aux.h"
 #include "bookmarks.h"
 #include "checks.h"
+#include "colors.h"
+#include "dircache.h"
 #include "exec.h"
+#include "frame.h"
 #include "history.h"
 #include "init.h"
 #include "jump.h"
@@ -69,6 +72,8 @@ typedef char *rl_cpvfunc_t;
 #include "navigation.h"
 #include "readline.h"
 #include "remotes.h"
+#include "selection.h" /* close_sel_journal(), free_sel_index() */
+#include "startup.h" /* print_startup_profile() */
 #include "messages.h"
 #include "file_operations.h"
 
@@ -267,19 +272,66 @@ print_reload_msg(const char *msg, ...)
 	}
 
 	if (conf.autols == 1)
-		printf("%s->%s ", mi_c, df_c);
+		frame_printf("%s->%s ", mi_c, df_c);
 
 	char *buf = (char *)xnmalloc((size_t)size + 1, sizeof(char));
 
 	vsnprintf(buf, (size_t)size + 1, msg, arglist);
 	va_end(arglist);
 
-	fputs(buf, stdout);
+	frame_puts(buf);
 	free(buf);
 
 	return EXIT_SUCCESS;
 }
 
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+/* File system events are not applied to the files list as soon as they
+ * are read: they are accumulated here, and then applied at once by
+ * flush_fs_events(). */
+struct fs_events_t {
+# ifdef LINUX_INOTIFY
+	struct dl_change_t changes[DL_MAX_CHANGES]; /* Changed files */
+	size_t changes_n;
+	int attrib_only;    /* Only file attributes changed */
+	int pad0;
+# endif /* LINUX_INOTIFY */
+	struct timespec first;   /* First pending event */
+	struct timespec last;    /* Last pending event */
+	struct timespec refresh; /* Last refresh */
+	size_t events_n;    /* Pending events */
+	int pending;
+	int full_reload;    /* The whole list must be read again */
+};
+
+/* Printed by the 'stats' command */
+struct fs_events_stats_t {
+	size_t events;    /* Events read */
+	size_t coalesced; /* Events applied by a refresh triggered by another one */
+	size_t refreshes; /* Refreshes triggered by events */
+};
+
+static struct fs_events_t fsev = {0};
+static struct fs_events_stats_t fs_events_stats = {0};
+
+/* Account for a new event affecting the files list */
+static void
+queue_fs_event(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (fsev.pending == 0) {
+		fsev.pending = 1;
+		fsev.first = now;
+	}
+
+	fsev.last = now;
+	fsev.events_n++;
+	fs_events_stats.events++;
+}
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
 #ifdef LINUX_INOTIFY
 void
 reset_inotify(void)
@@ -313,111 +365,141 @@ reset_inotify(void)
 			PROGRAM_NAME, rpath, strerror(errno));
 }
 
-void
-read_inotify(void)
+/* Store the file changed according to EVENT into the pending changes,
+ * unless it is already there. Returns 0 on success or -1 if there are too
+ * many changes. */
+static int
+add_inotify_change(const struct inotify_event *event)
+{
+	size_t i;
+	for (i = 0; i < fsev.changes_n; i++) {
+		if (*fsev.changes[i].name == *event->name
+		&& strcmp(fsev.changes[i].name, event->name) == 0)
+			return 0;
+	}
+
+	if (fsev.changes_n >= DL_MAX_CHANGES)
+		return (-1);
+
+	/* Only the first event tells whether the file existed before */
+	struct dl_change_t *c = &fsev.changes[fsev.changes_n];
+	c->name = savestring(event->name, strlen(event->name));
+	c->existed = (event->mask & (IN_CREATE | IN_MOVED_TO)) ? 0 : 1;
+	fsev.changes_n++;
+
+	return 0;
+}
+
+/* Read all available events for the current directory and add them to
+ * the pending changes. Returns the amount of events read. */
+static size_t
+queue_inotify_events(void)
 {
 	if (inotify_fd == UNSET)
-		return;
+		return 0;
 
-	int i;
+	ssize_t i;
+	size_t events_n = 0;
 	struct inotify_event *event;
 	char inotify_buf[EVENT_BUF_LEN];
 
-	memset((void *)inotify_buf, '\0', EVENT_BUF_LEN);
-	i = (int)read(inotify_fd, inotify_buf, EVENT_BUF_LEN);
+	/* Drain the events queue: a single command may trigger lots of events */
+	while ((i = read(inotify_fd, inotify_buf, EVENT_BUF_LEN)) > 0) {
+		for (char *ptr = inotify_buf; ptr < inotify_buf + i;
+		ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)ptr;
+			events_n++;
 
-	if (i <= 0) {
 # ifdef INOTIFY_DEBUG
-		puts("INOTIFY_RETURN");
+			printf("%s (%u:%d): ", *event->name
+				? event->name : NULL, event->len, event->wd);
 # endif /* INOTIFY_DEBUG */
-		return;
-	}
-
-	int ignore_event = 0, refresh = 0;
-	for (char *ptr = inotify_buf;
-	ptr + ((struct inotify_event *)ptr)->len < inotify_buf + i;
-	ptr += sizeof(struct inotify_event) + event->len) {
-		event = (struct inotify_event *)ptr;
 
+			if (!event->wd) {
 # ifdef INOTIFY_DEBUG
-		printf("%s (%u:%d): ", *event->name
-			? event->name : NULL, event->len, event->wd);
+				puts("INOTIFY_BREAK");
 # endif /* INOTIFY_DEBUG */
+				break;
+			}
 
-		if (!event->wd) {
 # ifdef INOTIFY_DEBUG
-			puts("INOTIFY_BREAK");
+			if (event->mask & IN_CREATE)
+				puts("IN_CREATE");
+			if (event->mask & IN_DELETE)
+				puts("IN_DELETE");
+			if (event->mask & IN_ATTRIB)
+				puts("IN_ATTRIB");
+			if (event->mask & IN_DELETE_SELF)
+				puts("IN_DELETE_SELF");
+			if (event->mask & IN_MOVE_SELF)
+				puts("IN_MOVE_SELF");
+			if (event->mask & IN_MOVED_FROM)
+				puts("IN_MOVED_FROM");
+			if (event->mask & IN_MOVED_TO)
+				puts("IN_MOVED_TO");
+			if (event->mask & IN_IGNORED)
+				puts("IN_IGNORED");
+			if (event->mask & IN_Q_OVERFLOW)
+				puts("IN_Q_OVERFLOW");
 # endif /* INOTIFY_DEBUG */
-			break;
-		}
 
-		if (event->mask & IN_CREATE) {
-# ifdef INOTIFY_DEBUG
-			puts("IN_CREATE");
-# endif /* INOTIFY_DEBUG */
-			struct stat a;
-			if (event->len && lstat(event->name, &a) != 0) {
-				/* The file was created, but doesn't exist anymore */
-				ignore_event = 1;
+			/* Events we cannot handle per file: the watch is gone, or
+			 * some events were lost. */
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF
+			| IN_IGNORED | IN_Q_OVERFLOW)) {
+				queue_fs_event();
+				fsev.full_reload = 1;
+				fsev.attrib_only = 0;
+				continue;
 			}
-		}
 
-		/* A file was renamed */
-		if (event->mask & IN_MOVED_TO) {
-			filesn_t j = files;
-			while (--j >= 0) {
-				if (*file_info[j].name == *event->name
-				&& strcmp(file_info[j].name, event->name) == 0)
-					break;
-			}
+			/* Events on the directory itself (e.g. IN_ATTRIB) */
+			if (!(event->mask & INOTIFY_MASK) || event->len == 0
+			|| !*event->name)
+				continue;
 
-			/* If destiny file name is already in the files list (j >= 0),
-			 * ignore this event. */
-			ignore_event = (j < 0) ? 0 : 1;
-		}
+			queue_fs_event();
+			if (!(event->mask & IN_ATTRIB))
+				fsev.attrib_only = 0;
 
-		if (event->mask & IN_DELETE) {
-# ifdef INOTIFY_DEBUG
-			puts("IN_DELETE");
-# endif /* INOTIFY_DEBUG */
-			struct stat a;
-			if (event->len && lstat(event->name, &a) == 0)
-				/* The file was removed, but is still there (recreated) */
-				ignore_event = 1;
+			if (fsev.full_reload == 0 && add_inotify_change(event) == -1)
+				fsev.full_reload = 1;
 		}
+	}
+
+	return events_n;
+}
 
+/* Apply the pending changes to the files list. Only the affected entries
+ * are updated (see update_dirlist()), unless the directory itself was
+ * removed or renamed, the events queue overflowed, or there are too many
+ * changes, in which case the whole list is reloaded.
+ * Returns 1 if the list was printed again, or 0 otherwise. */
+static int
+apply_inotify_events(void)
+{
+	if (fsev.full_reload == 0) {
+		const int ret = update_dirlist(fsev.changes, fsev.changes_n);
+		if (ret != -1) {
 # ifdef INOTIFY_DEBUG
-		if (event->mask & IN_DELETE_SELF)
-			puts("IN_DELETE_SELF");
-		if (event->mask & IN_MOVE_SELF)
-			puts("IN_MOVE_SELF");
-		if (event->mask & IN_MOVED_FROM)
-			puts("IN_MOVED_FROM");
-		if (event->mask & IN_MOVED_TO)
-			puts("IN_MOVED_TO");
-		if (event->mask & IN_IGNORED)
-			puts("IN_IGNORED");
+			puts("INOTIFY_UPDATE");
 # endif /* INOTIFY_DEBUG */
-
-		if (ignore_event == 0 && (event->mask & INOTIFY_MASK))
-			refresh = 1;
+			return ret;
+		}
 	}
 
-	if (refresh == 1 && exit_code == EXIT_SUCCESS) {
-# ifdef INOTIFY_DEBUG
-		puts("INOTIFY_REFRESH");
-# endif /* INOTIFY_DEBUG */
-		reload_dirlist();
-	} else {
+	/* Changes in file attributes were not tracked before: do not reload
+	 * the whole list for them. */
+	if (fsev.full_reload == 0 && fsev.attrib_only == 1)
+		return 0;
+
 # ifdef INOTIFY_DEBUG
-		puts("INOTIFY_RESET");
+	puts("INOTIFY_REFRESH");
 # endif /* INOTIFY_DEBUG */
-		/* Reset the inotify watch list */
-		reset_inotify();
-	}
-
-	return;
+	reload_dirlist();
+	return 1;
 }
+
 #elif defined(BSD_KQUEUE)
 /* Insert the following lines in the for loop to debug kqueue:
 if (event_data[i].fflags & NOTE_DELETE)
@@ -434,21 +516,178 @@ if (event_data[i].fflags & NOTE_RENAME)
 	puts("NOTE_RENAME");
 if (event_data[i].fflags & NOTE_REVOKE)
 	puts("NOTE_REVOKE"); */
-void
-read_kqueue(void)
+/* Read all available events for the current directory and add them to
+ * the pending changes. kqueue does not report which files changed: the
+ * whole list will be reloaded. */
+static void
+queue_kqueue_events(void)
 {
 	struct kevent event_data[NUM_EVENT_SLOTS];
-	memset((void *)event_data, '\0', sizeof(struct kevent) * NUM_EVENT_SLOTS);
+	int i, count;
 
-	int i;
-	int count = kevent(kq, NULL, 0, event_data, 4096, &timeout);
+	do {
+		memset((void *)event_data, '\0',
+			sizeof(struct kevent) * NUM_EVENT_SLOTS);
+		count = kevent(kq, NULL, 0, event_data, NUM_EVENT_SLOTS, &timeout);
 
-	for (i = 0; i < count; i++) {
-		if (event_data[i].fflags & KQUEUE_FFLAGS) {
-			reload_dirlist();
-			return;
+		for (i = 0; i < count; i++) {
+			if (event_data[i].fflags & KQUEUE_FFLAGS)
+				queue_fs_event();
 		}
+	} while (count == NUM_EVENT_SLOTS);
+}
+#endif /* LINUX_INOTIFY */
+
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+/* Milliseconds elapsed from SINCE to NOW */
+static long long
+elapsed_ms(const struct timespec *since, const struct timespec *now)
+{
+	return (long long)(now->tv_sec - since->tv_sec) * 1000
+		+ (now->tv_nsec - since->tv_nsec) / 1000000;
+}
+
+/* Return the file descriptor to be watched for file system events while
+ * waiting for input (see queue_fs_events()), or -1 if the files list is
+ * not to be refreshed meanwhile. */
+int
+fs_events_fd(void)
+{
+	if (conf.autols == 0 || watch != 1 || exit_code != EXIT_SUCCESS)
+		return (-1);
+
+# ifdef LINUX_INOTIFY
+	return inotify_fd;
+# else
+	return event_fd >= 0 ? kq : -1;
+# endif /* LINUX_INOTIFY */
+}
+
+/* Return the amount of milliseconds to wait before applying pending
+ * events (0 if they are due now), or -1 if there are no pending events.
+ * We wait until no event arrived for MinRefreshInterval milliseconds, so
+ * that a burst of events (say, extracting an archive) triggers a single
+ * refresh, but not longer than MaxRefreshLatency milliseconds since the
+ * first pending event. Refreshes are never closer to each other than
+ * MinRefreshInterval milliseconds. */
+int
+fs_events_timeout(void)
+{
+	if (fsev.pending == 0)
+		return (-1);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	const long long interval = conf.min_refresh_interval;
+	const long long latency = conf.max_refresh_latency > interval
+		? conf.max_refresh_latency : interval;
+
+	long long wait = interval - elapsed_ms(&fsev.last, &now);
+	const long long max_wait = latency - elapsed_ms(&fsev.first, &now);
+	if (wait > max_wait)
+		wait = max_wait;
+
+	const long long spacing = interval - elapsed_ms(&fsev.refresh, &now);
+	if (wait < spacing)
+		wait = spacing;
+
+	return wait > 0 ? (int)wait : 0;
+}
+
+/* Read available file system events, without applying them */
+void
+queue_fs_events(void)
+{
+# ifdef LINUX_INOTIFY
+	queue_inotify_events();
+# else
+	queue_kqueue_events();
+# endif /* LINUX_INOTIFY */
+}
+
+/* Discard pending events (e.g. because the whole list was just read) */
+void
+clear_fs_events(void)
+{
+# ifdef LINUX_INOTIFY
+	size_t i;
+	for (i = 0; i < fsev.changes_n; i++)
+		free(fsev.changes[i].name);
+	fsev.changes_n = 0;
+	fsev.attrib_only = 1;
+# endif /* LINUX_INOTIFY */
+	fsev.pending = fsev.full_reload = 0;
+	fsev.events_n = 0;
+}
+
+/* Apply all pending events to the files list in a single refresh.
+ * Returns 1 if the list was printed again, or 0 otherwise. */
+int
+flush_fs_events(void)
+{
+	if (fsev.pending == 0)
+		return 0;
+
+	fs_events_stats.refreshes++;
+	fs_events_stats.coalesced += fsev.events_n - 1;
+
+# ifdef LINUX_INOTIFY
+	const int ret = apply_inotify_events();
+# else
+	reload_dirlist();
+	const int ret = 1;
+# endif /* LINUX_INOTIFY */
+
+	/* reload_dirlist() may have already cleared pending events */
+	clear_fs_events();
+	clock_gettime(CLOCK_MONOTONIC, &fsev.refresh);
+
+	return ret;
+}
+
+void
+print_fs_events_stats(void)
+{
+	printf(_("File system events:          %zu\n\
+Coalesced events:            %zu\n\
+Refreshes:                   %zu\n"), fs_events_stats.events,
+	fs_events_stats.coalesced, fs_events_stats.refreshes);
+}
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
+#ifdef LINUX_INOTIFY
+/* Read pending events for the current directory and apply them to the
+ * files list at once (run after each command). */
+void
+read_inotify(void)
+{
+	if (queue_inotify_events() == 0 && fsev.pending == 0) {
+# ifdef INOTIFY_DEBUG
+		puts("INOTIFY_RETURN");
+# endif /* INOTIFY_DEBUG */
+		return;
 	}
+
+	if (fsev.pending == 1 && exit_code == EXIT_SUCCESS) {
+		flush_fs_events();
+	} else {
+# ifdef INOTIFY_DEBUG
+		puts("INOTIFY_RESET");
+# endif /* INOTIFY_DEBUG */
+		/* Reset the inotify watch list */
+		clear_fs_events();
+		reset_inotify();
+	}
+}
+#elif defined(BSD_KQUEUE)
+/* Read pending events for the current directory and apply them to the
+ * files list at once (run after each command). */
+void
+read_kqueue(void)
+{
+	queue_kqueue_events();
+	flush_fs_events();
 }
 #endif /* LINUX_INOTIFY */
 
@@ -1477,6 +1716,9 @@ free_stuff(void)
 {
 	int i = 0;
 
+	if (xargs.startup_profile == 1)
+		print_startup_profile();
+
 #ifdef LINUX_FSINFO
 	if (ext_mnt) {
 		for (i = 0; ext_mnt[i].mnt_point; i++)
@@ -1489,12 +1731,6 @@ free_stuff(void)
 	free(cmd_line_cmd);
 #endif /* RUN_CMD */
 
-#if !defined(_NO_ICONS)
-	free(name_icons_hashes);
-	free(dir_icons_hashes);
-	free(ext_icons_hashes);
-#endif /* !_NO_ICONS */
-
 	free(conf.time_str);
 	free(conf.ptime_str);
 
@@ -1520,6 +1756,12 @@ free_stuff(void)
 	if (xargs.stealth_mode != 1)
 		save_jumpdb();
 
+	close_sel_journal();
+
+#ifdef USE_XDU
+	save_dir_size_cache();
+#endif /* USE_XDU */
+
 	handle_last_path();
 
 	free(bin_name);
@@ -1529,6 +1771,7 @@ free_stuff(void)
 	free(conf.encoded_prompt);
 /*	free(right_prompt); */
 	free_dirlist();
+	purge_listing_cache();
 	free(conf.opener);
 	free(conf.wprompt_str);
 	free(conf.fzftab_options);
@@ -1583,6 +1826,7 @@ free_stuff(void)
 		free(sel_elements);
 	}
 	free(sel_devino);
+	free_sel_index();
 
 	if (bin_commands) {
 		i = (int)path_progsn;
@@ -1590,6 +1834,7 @@ free_stuff(void)
 			free(bin_commands[i]);
 		free(bin_commands);
 	}
+	free(bin_commands_idx);
 
 	if (paths) {
 		i = (int)path_n;
@@ -1659,14 +1904,8 @@ free_stuff(void)
 		free(messages);
 	}
 
-	if (ext_colors_n) {
-		i = (int)ext_colors_n;
-		while (--i >= 0) {
-			free(ext_colors[i].name);
-			free(ext_colors[i].value);
-		}
-		free(ext_colors);
-	}
+	free_extension_colors();
+	free_frame();
 
 	if (workspaces && workspaces[0].path) {
 		i = MAX_WS;
@@ -1757,6 +1996,7 @@ static void
 sigwinch_handler(int sig)
 {
 	UNUSED(sig);
+	frame_invalidate();
 	if (xargs.refresh_on_resize == 0 || conf.pager == 1 || kbind_busy == 1)
 		return;
 
@@ -68,6 +68,14 @@ void reset_inotify(void);
 #elif defined(BSD_KQUEUE)
 void read_kqueue(void);
 #endif /* LINUX_INOTIFY */
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+void clear_fs_events(void);
+int  flush_fs_events(void);
+int  fs_events_fd(void);
+int  fs_events_timeout(void);
+void print_fs_events_stats(void);
+void queue_fs_events(void);
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
 
 void set_filter_type(const char);
 /*void refresh_files_list(void); */
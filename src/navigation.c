@@ -1043,6 +1043,7 @@ change_to_dirhist_num(int n)
 	dirhist_cur_index = n;
 	ret = EXIT_SUCCESS;
 
+	dir_changed = 1;
 	if (conf.autols == 1) {
 		free_dirlist();
 		ret = list_dir();
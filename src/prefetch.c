@@ -0,0 +1,545 @@
+/* prefetch.c -- gather metadata for the files list using worker threads */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* list_dir() first reads all entries in the current directory, and then
+ * hands them over to prefetch_entries(), which performs all the I/O
+ * required to display them (fstatat(2), count_dir(), listxattr(2), and
+ * so on). The results are stored in the pf_entry_t struct of each entry,
+ * and list_dir() then processes them in order, as usual.
+ *
+ * Since the entry processing code is the same no matter how many threads
+ * were used to gather the metadata, the output is guaranteed to be
+ * identical to the one produced by the serial path. This is quite useful
+ * on network file systems (NFS, CephFS, SSHFS), where each system call
+ * takes a whole round-trip to the server. */
+
+#include "helpers.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h> /* sysconf(3) */
+
+#if defined(LINUX_FILE_XATTRS)
+# include <sys/xattr.h>
+#endif /* LINUX_FILE_XATTRS */
+
+#if defined(LINUX_IO_URING)
+# include <errno.h>
+# include <linux/io_uring.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <sys/sysmacros.h> /* makedev() */
+#endif /* LINUX_IO_URING */
+
+#include "aux.h"
+#include "prefetch.h"
+
+/* Size of each block used to store entry names */
+#define PF_BLOCK_SIZE (64 * 1024)
+
+#if defined(LINUX_IO_URING)
+/* Do not use io_uring for less than this amount of entries */
+# define PF_URING_MIN 64
+/* Max amount of statx(2) requests in flight */
+# define PF_URING_ENTRIES 256
+
+struct uring_t {
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	int fd;
+	int status; /* 0 = not initialized, 1 = ready, -1 = unavailable */
+};
+
+/* The ring is set up the first time it is needed, and kept until exit */
+static struct uring_t ring = {0};
+#endif /* LINUX_IO_URING */
+
+struct pf_block_t {
+	struct pf_block_t *next;
+	size_t used;
+	char data[];
+};
+
+struct pf_job_t {
+	struct pf_list_t *list;
+	pthread_mutex_t mutex;
+	size_t next; /* Index of the next entry to be processed */
+	int fd;
+	int flags;
+};
+
+/* Copy the string NAME, whose length is LEN, into the names storage
+ * of LIST, and return a pointer to the copy. */
+static char *
+store_name(struct pf_list_t *list, const char *name, const size_t len)
+{
+	struct pf_block_t *b = list->blocks;
+
+	if (!b || b->used + len + 1 > PF_BLOCK_SIZE) {
+		/* NAME_MAX is way smaller than PF_BLOCK_SIZE: a name
+		 * always fits into a new block. */
+		b = (struct pf_block_t *)xnmalloc(1,
+			sizeof(struct pf_block_t) + PF_BLOCK_SIZE);
+		b->used = 0;
+		b->next = list->blocks;
+		list->blocks = b;
+	}
+
+	char *p = b->data + b->used;
+	memcpy(p, name, len + 1);
+	b->used += len + 1;
+
+	return p;
+}
+
+/* Append the entry NAME, whose inode number is INO and d_type TYPE,
+ * to LIST. */
+void
+add_pf_entry(struct pf_list_t *list, const char *name, const ino_t ino,
+	const unsigned char type)
+{
+	if (list->n == list->cap) {
+		list->cap = list->cap == 0 ? 256 : list->cap * 2;
+		list->ent = (struct pf_entry_t *)xrealloc(list->ent,
+			list->cap * sizeof(struct pf_entry_t));
+	}
+
+	struct pf_entry_t *e = &list->ent[list->n];
+	e->name = store_name(list, name, strlen(name));
+	e->lattr = (struct stat *)NULL;
+	e->filesn = 1;
+	e->ino = ino;
+	e->type = type;
+	e->stat_ok = 0;
+	e->xattr = 0;
+	e->stat_done = 0;
+	e->lattr_done = 0;
+	e->pending = 0;
+
+	list->n++;
+}
+
+void
+free_pf_list(struct pf_list_t *list)
+{
+	size_t i;
+	for (i = 0; i < list->n; i++)
+		free(list->ent[i].lattr);
+
+	free(list->ent);
+
+	struct pf_block_t *b = list->blocks;
+	while (b) {
+		struct pf_block_t *next = b->next;
+		free(b);
+		b = next;
+	}
+
+	*list = (struct pf_list_t){0};
+}
+
+#if defined(LINUX_IO_URING)
+/* Set up the io_uring instance used to run statx(2) requests.
+ * Returns 1 if the ring is ready or -1 if io_uring is not available
+ * (old kernel, disabled via sysctl, blocked by seccomp, and so on). */
+static int
+setup_uring(void)
+{
+	if (ring.status != 0)
+		return ring.status;
+
+	ring.status = -1;
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+
+	const int fd = (int)syscall(__NR_io_uring_setup, PF_URING_ENTRIES, &p);
+	if (fd == -1)
+		return (-1);
+
+	size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	const size_t cq_len = p.cq_off.cqes
+		+ p.cq_entries * sizeof(struct io_uring_cqe);
+	const size_t sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	const int single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP);
+	if (single_mmap && cq_len > sq_len)
+		sq_len = cq_len;
+
+	char *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto FAIL;
+
+	char *cq = sq;
+	if (!single_mmap) {
+		cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			munmap(sq, sq_len);
+			goto FAIL;
+		}
+	}
+
+	ring.sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED) {
+		munmap(sq, sq_len);
+		if (!single_mmap)
+			munmap(cq, cq_len);
+		goto FAIL;
+	}
+
+	ring.sq_head = (unsigned *)(sq + p.sq_off.head);
+	ring.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ring.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring.sq_array = (unsigned *)(sq + p.sq_off.array);
+	ring.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ring.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ring.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ring.fd = fd;
+	ring.status = 1;
+
+	return 1;
+
+FAIL:
+	close(fd);
+	return (-1);
+}
+
+static void
+statx_to_stat(const struct statx *x, struct stat *s)
+{
+	memset(s, 0, sizeof(struct stat));
+	s->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+	s->st_ino = (ino_t)x->stx_ino;
+	s->st_mode = (mode_t)x->stx_mode;
+	s->st_nlink = (nlink_t)x->stx_nlink;
+	s->st_uid = (uid_t)x->stx_uid;
+	s->st_gid = (gid_t)x->stx_gid;
+	s->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+	s->st_size = (off_t)x->stx_size;
+	s->st_blksize = (blksize_t)x->stx_blksize;
+	s->st_blocks = (blkcnt_t)x->stx_blocks;
+	s->st_atim.tv_sec = (time_t)x->stx_atime.tv_sec;
+	s->st_atim.tv_nsec = (long)x->stx_atime.tv_nsec;
+	s->st_mtim.tv_sec = (time_t)x->stx_mtime.tv_sec;
+	s->st_mtim.tv_nsec = (long)x->stx_mtime.tv_nsec;
+	s->st_ctim.tv_sec = (time_t)x->stx_ctime.tv_sec;
+	s->st_ctim.tv_nsec = (long)x->stx_ctime.tv_nsec;
+}
+
+/* Store the result (RES) of the statx(2) request for the entry E. */
+static void
+set_uring_result(struct pf_entry_t *e, const struct statx *x,
+	const int res, const int targets)
+{
+	if (targets == 0) {
+		e->stat_done = 1;
+		if (res == 0) {
+			statx_to_stat(x, &e->attr);
+			e->stat_ok = 1;
+		}
+		return;
+	}
+
+	e->lattr_done = 1;
+	if (res == 0) {
+		e->lattr = (struct stat *)xnmalloc(1, sizeof(struct stat));
+		statx_to_stat(x, e->lattr);
+	}
+}
+
+/* Run statx(2) for all entries in LIST, located in the directory whose file
+ * descriptor is FD, submitting the requests to the kernel in batches via
+ * io_uring. If TARGETS is set, only symbolic links are checked, and the
+ * attributes of their targets are stored in the lattr field.
+ * Entries processed here are marked as such (stat_done and lattr_done),
+ * so that fetch_entry() won't stat them again (entries already marked,
+ * say, by lazy_stat_entries(), are skipped).
+ * Returns 0 on success or -1 if io_uring cannot be used: in this case,
+ * remaining entries are left for fetch_entry(). */
+static int
+uring_stat_entries(struct pf_list_t *list, const int fd, const int flags,
+	const int targets)
+{
+	struct statx *bufs = (struct statx *)xnmalloc(PF_URING_ENTRIES,
+		sizeof(struct statx));
+	/* Buffer slots are released out of order: keep a stack of free ones,
+	 * and remember which entry is using each slot. */
+	size_t slot_ent[PF_URING_ENTRIES];
+	unsigned free_slots[PF_URING_ENTRIES];
+	unsigned nfree = PF_URING_ENTRIES, inflight = 0;
+	int unsupported = 0;
+
+	unsigned i;
+	for (i = 0; i < PF_URING_ENTRIES; i++)
+		free_slots[i] = i;
+
+	const int statx_flags = (targets == 0 && !(flags & PF_FOLLOW_LINKS))
+		? AT_SYMLINK_NOFOLLOW : 0;
+
+	size_t n = 0;
+	while (n < list->n || inflight > 0) {
+		unsigned to_submit = 0;
+
+		while (unsupported == 0 && nfree > 0 && n < list->n) {
+			struct pf_entry_t *e = &list->ent[n];
+			const size_t ent_index = n++;
+			if (targets == 0 ? e->stat_done == 1 : (e->lattr_done == 1
+			|| e->stat_ok == 0 || !S_ISLNK(e->attr.st_mode)))
+				continue;
+
+			const unsigned slot = free_slots[--nfree];
+			slot_ent[slot] = ent_index;
+
+			const unsigned tail = *ring.sq_tail;
+			const unsigned index = tail & *ring.sq_mask;
+			struct io_uring_sqe *sqe = &ring.sqes[index];
+			memset(sqe, 0, sizeof(struct io_uring_sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = fd;
+			sqe->addr = (unsigned long long)(uintptr_t)e->name;
+			sqe->len = STATX_BASIC_STATS;
+			sqe->off = (unsigned long long)(uintptr_t)&bufs[slot];
+			sqe->statx_flags = (unsigned)statx_flags;
+			sqe->user_data = slot;
+			ring.sq_array[index] = index;
+			__atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+			to_submit++;
+			inflight++;
+		}
+
+		if (inflight == 0)
+			break;
+
+		do {
+			const int ret = (int)syscall(__NR_io_uring_enter, ring.fd,
+				to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+			if (ret == -1) {
+				if (errno == EINTR)
+					continue;
+				/* Requests might still be in flight: do not free BUFS */
+				ring.status = -1;
+				return (-1);
+			}
+			to_submit -= (unsigned)ret;
+		} while (to_submit > 0);
+
+		unsigned head = *ring.cq_head;
+		const unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+		while (head != tail) {
+			const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+			const unsigned slot = (unsigned)cqe->user_data;
+
+			/* Kernels older than 5.6 lack IORING_OP_STATX */
+			if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+				unsupported = 1;
+			else
+				set_uring_result(&list->ent[slot_ent[slot]], &bufs[slot],
+					cqe->res, targets);
+
+			free_slots[nfree++] = slot;
+			inflight--;
+			head++;
+		}
+
+		__atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	free(bufs);
+
+	if (unsupported == 1) {
+		ring.status = -1;
+		return (-1);
+	}
+
+	return 0;
+}
+#endif /* LINUX_IO_URING */
+
+/* Gather all the metadata needed by list_dir() for the entry E, located
+ * in the directory whose file descriptor is FD. */
+static void
+fetch_entry(struct pf_entry_t *e, const int fd, const int flags)
+{
+	if (e->stat_done == 0 && fstatat(fd, e->name, &e->attr,
+	(flags & PF_FOLLOW_LINKS) ? 0 : AT_SYMLINK_NOFOLLOW) != -1)
+		e->stat_ok = 1;
+
+	if (e->stat_ok == 0)
+		return;
+
+#if defined(LINUX_FILE_XATTRS)
+	if ((flags & PF_XATTRS) && !S_ISLNK(e->attr.st_mode)
+	&& listxattr(e->name, NULL, 0) > 0)
+		e->xattr = 1;
+#endif /* LINUX_FILE_XATTRS */
+
+	if (S_ISDIR(e->attr.st_mode)) {
+		if (flags & PF_FILES_COUNTER)
+			e->filesn = count_dir(e->name, NO_CPOP) - 2;
+		return;
+	}
+
+	if (!(flags & PF_LINK_TARGETS) || !S_ISLNK(e->attr.st_mode))
+		return;
+
+	if (e->lattr_done == 0) {
+		e->lattr = (struct stat *)xnmalloc(1, sizeof(struct stat));
+		if (fstatat(fd, e->name, e->lattr, 0) == -1) {
+			free(e->lattr);
+			e->lattr = (struct stat *)NULL;
+		}
+	}
+
+	if (!e->lattr)
+		return;
+
+	if (S_ISDIR(e->lattr->st_mode) && (flags & PF_FILES_COUNTER))
+		e->filesn = count_dir(e->name, NO_CPOP) - 2;
+}
+
+static void *
+prefetch_worker(void *arg)
+{
+	struct pf_job_t *job = (struct pf_job_t *)arg;
+	struct pf_list_t *list = job->list;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		const size_t start = job->next;
+		job->next += PF_CHUNK;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (start >= list->n)
+			break;
+
+		const size_t end = start + PF_CHUNK < list->n
+			? start + PF_CHUNK : list->n;
+
+		size_t i;
+		for (i = start; i < end; i++)
+			fetch_entry(&list->ent[i], job->fd, job->flags);
+	}
+
+	return NULL;
+}
+
+/* Return the max amount of threads allowed by the ListingThreads option
+ * (0 = auto, i.e. as many as online CPUs), no more than PF_MAX_THREADS */
+int
+get_listing_threads(void)
+{
+	if (conf.listing_threads == 1)
+		return 1;
+
+	long workers = conf.listing_threads;
+	if (workers <= 0) { /* Auto */
+#ifdef _SC_NPROCESSORS_ONLN
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+#endif /* _SC_NPROCESSORS_ONLN */
+		if (workers <= 0)
+			return 1;
+	}
+
+	return (int)(workers > PF_MAX_THREADS ? PF_MAX_THREADS : workers);
+}
+
+/* Return the amount of threads to be used to process N entries */
+static int
+get_workers_n(const size_t n)
+{
+	if (n < PF_PARALLEL_MIN)
+		return 1;
+
+	const long workers = get_listing_threads();
+
+	/* Let every thread have at least a few chunks to process */
+	const long max = (long)(n / (PF_CHUNK * 4)) + 1;
+	return (int)(workers > max ? max : workers);
+}
+
+/* Gather metadata for all entries in LIST, all of them located in the
+ * directory whose file descriptor is FD, according to FLAGS (see the
+ * PF flags in prefetch.h). The calling thread takes part in the job. */
+void
+prefetch_entries(struct pf_list_t *list, const int fd, const int flags)
+{
+	if (!list || list->n == 0)
+		return;
+
+#if defined(LINUX_IO_URING)
+	/* Let the kernel run all stat requests at once, in batches. If io_uring
+	 * is not available, fetch_entry() will take care of them. The ring is
+	 * not shared with background threads (PF_NO_URING). */
+	if (!(flags & PF_NO_URING) && list->n >= PF_URING_MIN
+	&& setup_uring() == 1
+	&& uring_stat_entries(list, fd, flags, 0) == 0
+	&& (flags & PF_LINK_TARGETS))
+		uring_stat_entries(list, fd, flags, 1);
+#endif /* LINUX_IO_URING */
+
+	struct pf_job_t job;
+	job.list = list;
+	job.next = 0;
+	job.fd = fd;
+	job.flags = flags;
+
+	const int workers_n = get_workers_n(list->n);
+	if (workers_n <= 1) {
+		size_t i;
+		for (i = 0; i < list->n; i++)
+			fetch_entry(&list->ent[i], fd, flags);
+		return;
+	}
+
+	pthread_mutex_init(&job.mutex, NULL);
+
+	pthread_t tids[PF_MAX_THREADS];
+	int i, started = 0;
+	for (i = 0; i < workers_n - 1; i++) {
+		if (pthread_create(&tids[started], NULL, prefetch_worker, &job) != 0)
+			break; /* Run with what we have: we process entries ourselves */
+		started++;
+	}
+
+	prefetch_worker(&job);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+
+	pthread_mutex_destroy(&job.mutex);
+}
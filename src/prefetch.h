@@ -0,0 +1,82 @@
+/* prefetch.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <sys/stat.h>
+
+/* Flags for prefetch_entries() */
+#define PF_FOLLOW_LINKS  (1 << 0) /* Use stat(2) instead of lstat(2) */
+#define PF_FILES_COUNTER (1 << 1) /* Count files in directories */
+#define PF_LINK_TARGETS  (1 << 2) /* Get symbolic links target attributes */
+#define PF_XATTRS        (1 << 3) /* Check for extended attributes */
+#define PF_NO_URING      (1 << 4) /* Do not use io_uring (see lazystat.c) */
+
+/* Do not spawn worker threads for less than this amount of entries: the
+ * cost of creating threads would be higher than the time saved. */
+#define PF_PARALLEL_MIN 512
+/* Entries processed at once by a single worker */
+#define PF_CHUNK 64
+/* Max amount of worker threads */
+#define PF_MAX_THREADS 64
+
+/* A directory entry, as read by readdir(3), plus the metadata gathered
+ * for it by prefetch_entries() */
+struct pf_entry_t {
+	char *name;
+	struct stat *lattr; /* Symlink target attributes (NULL if broken) */
+	struct stat attr;
+	filesn_t filesn;    /* Files in directory (count_dir() - 2) */
+	ino_t ino;          /* d_ino */
+	unsigned char type; /* d_type (DT_UNKNOWN if not available) */
+	char stat_ok;
+	char xattr;
+	char stat_done;  /* attr already filled (by io_uring) */
+	char lattr_done; /* lattr already filled (by io_uring) */
+	char pending;    /* No stat data yet (see lazystat.c) */
+	char pad0[2];
+};
+
+/* Storage for names of entries in a pf_list_t struct */
+struct pf_block_t;
+
+struct pf_list_t {
+	struct pf_entry_t *ent;
+	struct pf_block_t *blocks;
+	size_t n;
+	size_t cap;
+};
+
+__BEGIN_DECLS
+
+void add_pf_entry(struct pf_list_t *, const char *, const ino_t,
+	const unsigned char);
+void free_pf_list(struct pf_list_t *);
+int  get_listing_threads(void);
+void prefetch_entries(struct pf_list_t *, const int, const int);
+
+__END_DECLS
+
+#endif /* PREFETCH_H */
@@ -48,6 +48,7 @@
 #include "navigation.h"
 #include "prompt.h"
 #include "sanitize.h"
+#include "selection.h" /* sync_sel_files() */
 
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
@@ -984,7 +985,7 @@ initialize_prompt_data(const int prompt_flag)
 #ifndef _NO_TRASH
 	update_trash_indicator();
 #endif /* !_NO_TRASH */
-	get_sel_files();
+	sync_sel_files();
 	setenv_prompt();
 
 	args_n = 0;
@@ -36,6 +36,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h> /* SSIZE_MAX (FC_PENDING) */
 #include <unistd.h>
 #include <grp.h>
 #include <pwd.h>
@@ -110,6 +111,7 @@
 #include "aux.h"
 #include "checks.h"
 #include "colors.h"
+#include "frame.h"
 #include "messages.h"
 #include "misc.h"
 #include "readline.h" /* Required by the 'pc' command */
@@ -2129,7 +2131,7 @@ construct_and_print_filename(const struct fileinfo *props,
 	char trim_s[2] = {0};
 	*trim_s = trim > 0 ? TRIMFILE_CHR : 0;
 
-	printf("%s%s%s%s%s%ls%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
+	frame_printf("%s%s%s%s%s%ls%s%s%-*s%s\x1b[0m%s%s\x1b[0m%s%s%s  ",
 		(conf.colorize == 1 && conf.icons == 1) ? props->icon_color : "",
 		conf.icons == 1 ? props->icon : "", conf.icons == 1 ? " " : "", df_c,
 
@@ -2311,6 +2313,9 @@ construct_files_counter(const struct fileinfo *props, char *fc_str,
 	if (props->dir == 1 && props->filesn > 0) {
 		snprintf(fc_str, FC_STR_LEN, "%s%*d%s ", fc_c, (int)fc_max,
 			(int)props->filesn, df_c);
+	} else if (props->dir == 1 && props->filesn == FC_PENDING) {
+		snprintf(fc_str, FC_STR_LEN, "%s%*c%s ", fc_c, (int)fc_max,
+			FC_PENDING_CHR, df_c);
 	} else {
 		snprintf(fc_str, FC_STR_LEN, "%s%*c%s ", dn_c, (int)fc_max,
 			'-', df_c);
@@ -2413,7 +2418,7 @@ print_entry_props(const struct fileinfo *props,	const struct maxes_t *maxes,
 	if (prop_fields.time != 0) fputs(time_str, stdout);
 	if (prop_fields.size != 0) puts(size_str); */
 
-	printf("%s"    // Files counter for dirs
+	frame_printf("%s"    // Files counter for dirs
 		   "%s"    // Inode
 		   "%s"    // Permissions
 		   "%s "   // Extended attributes (@)
@@ -2462,7 +2467,7 @@ print_analysis_stats(const off_t total, const off_t largest,
 		lsize = ls;
 	}
 
-	printf(_("Total size:   %s%s%s\n"
+	frame_printf(_("Total size:   %s%s%s\n"
 		"Largest file: %s%s%s %c%s%s%s%c\n"),
 		conf.colorize == 1 ? tsize : "" , t ? t : "?",
 		conf.colorize == 1 ? tx_c : "",
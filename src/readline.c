@@ -38,6 +38,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <poll.h>
 #include <pwd.h>
 #include <grp.h> /* Needed by groups_generator(): getgrent(3) */
 
@@ -53,12 +54,16 @@ typedef char *rl_cpvfunc_t;
 #include "checks.h"
 #include "exec.h"
 #include "fuzzy_match.h"
+#include "init.h" /* get_bin_cmds_range() */
 #include "keybinds.h"
 #include "navigation.h"
 #include "readline.h"
 #include "tabcomp.h"
 #include "mime.h"
 #include "tags.h"
+#include "fcounter.h"
+#include "lazystat.h"
+#include "startup.h"
 
 #ifndef _NO_SUGGESTIONS
 # include "suggestions.h"
@@ -723,6 +728,149 @@ fix_rl_point(const unsigned char c)
 	rl_point += mlen > 0 ? mlen - 1 : 0;
 }
 
+/* Refresh the files list if new files counter results arrived while
+ * waiting for input (see fcounter.c) */
+static void
+refresh_files_counter(void)
+{
+#ifndef _NO_SUGGESTIONS
+	if (suggestion.printed && suggestion_buf)
+		free_suggestion();
+#endif /* !_NO_SUGGESTIONS */
+
+	if (fc_refresh() == 1) {
+		UNHIDE_CURSOR;
+		rl_reset_line_state();
+		rl_redisplay();
+	}
+}
+
+/* Refresh the files list if the stat data of a pending list arrived while
+ * waiting for input (see lazystat.c) */
+static void
+refresh_lazy_stat(void)
+{
+#ifndef _NO_SUGGESTIONS
+	if (suggestion.printed && suggestion_buf)
+		free_suggestion();
+#endif /* !_NO_SUGGESTIONS */
+
+	if (lazy_stat_refresh() == 1) {
+		UNHIDE_CURSOR;
+		rl_reset_line_state();
+		rl_redisplay();
+	}
+}
+
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+/* Refresh the files list to apply pending file system events */
+static void
+refresh_fs_events(void)
+{
+# ifndef _NO_SUGGESTIONS
+	if (suggestion.printed && suggestion_buf)
+		free_suggestion();
+# endif /* !_NO_SUGGESTIONS */
+
+	const int newline = (conf.clear_screen == 0);
+	if (newline == 1)
+		putchar('\n');
+
+	if (flush_fs_events() == 1 || newline == 1) {
+		UNHIDE_CURSOR;
+		rl_reset_line_state();
+		rl_redisplay();
+	}
+}
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
+/* Wait until there is input available in FD (the terminal). Meanwhile,
+ * refresh the files list whenever new files counter results or pending
+ * stat data are available (see fcounter.c and lazystat.c), or files in
+ * the current directory change (pending changes are coalesced: see
+ * fs_events_timeout()). Deferred startup tasks are run, one at a time,
+ * while there is nothing else to do (see startup.c). */
+static void
+wait_input(const int fd)
+{
+	while (1) {
+		struct pollfd pfd[4];
+		nfds_t n = 0;
+		int timeout = -1;
+
+		pfd[n].fd = fd;
+		pfd[n].events = POLLIN;
+		pfd[n++].revents = 0;
+
+		const int fc_fd = fc_notify_fd();
+		const nfds_t fc_i = n;
+		if (fc_fd != -1) {
+			pfd[n].fd = fc_fd;
+			pfd[n].events = POLLIN;
+			pfd[n++].revents = 0;
+		}
+
+		const int ls_fd = lazy_stat_notify_fd();
+		const nfds_t ls_i = n;
+		if (ls_fd != -1) {
+			pfd[n].fd = ls_fd;
+			pfd[n].events = POLLIN;
+			pfd[n++].revents = 0;
+		}
+
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+		const int ev_fd = (rl_nohist == 0 && kbind_busy == 0)
+			? fs_events_fd() : -1;
+		if (ev_fd != -1) {
+			pfd[n].fd = ev_fd;
+			pfd[n].events = POLLIN;
+			pfd[n++].revents = 0;
+			timeout = fs_events_timeout();
+		}
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+
+		const int startup = startup_tasks_pending();
+		if (startup == 1)
+			timeout = 0;
+
+		if ((n == 1 && startup == 0) || poll(pfd, n, timeout) < 0
+		|| pfd[0].revents != 0)
+			return;
+
+		nfds_t i;
+		for (i = 1; i < n; i++) {
+			/* Let read(2) block on the terminal instead of spinning */
+			if (pfd[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+				return;
+		}
+
+		if (ls_fd != -1 && (pfd[ls_i].revents & POLLIN)) {
+			refresh_lazy_stat();
+			continue;
+		}
+
+		if (fc_fd != -1 && (pfd[fc_i].revents & POLLIN)) {
+			refresh_files_counter();
+			continue;
+		}
+
+		if (startup == 1) {
+			run_next_startup_task();
+			continue;
+		}
+
+#if defined(LINUX_INOTIFY) || defined(BSD_KQUEUE)
+		if (ev_fd == -1)
+			continue;
+
+		if (pfd[n - 1].revents & POLLIN)
+			queue_fs_events();
+		if (fs_events_timeout() == 0)
+			refresh_fs_events();
+#endif /* LINUX_INOTIFY || BSD_KQUEUE */
+	}
+}
+
 /* Custom implementation of readline's rl_getc() hacked to introduce
  * suggestions, alternative TAB completion, and syntax highlighting.
  * This function is automatically called by readline() to handle input. */
@@ -736,7 +884,13 @@ my_rl_getc(FILE *stream)
 	if (prompt_offset == UNSET)
 		prompt_offset = get_prompt_offset(rl_prompt);
 
+	startup_prompt_ready();
+
 	while (1) {
+		wait_input(fileno(stream));
+		/* Whatever we are about to do might need them */
+		run_startup_tasks();
+
 		result = (int)read(fileno(stream), &c, sizeof(unsigned char)); /* flawfinder: ignore */
 		if (result > 0 && result == sizeof(unsigned char)) {
 			/* Ctrl-d (empty command line only). Let's check the previous
@@ -1993,20 +2147,17 @@ bin_cmd_generator_ext(const char *text, int state)
 	if (!bin_commands)
 		return (char *)NULL;
 
-	static int i;
-	static size_t len;
+	static size_t i, end;
 	char *name;
 
 	if (!state) {
-		i = 0;
-		len = strlen(text);
+		end = get_bin_cmds_range(text, text ? strlen(text) : 0, &i);
+		end += i;
 	}
 
-	while ((name = bin_commands[i++]) != NULL) {
-		if (is_internal_c(name) == 1)
-			continue;
-		if (!text || !*text
-		|| (*text == *name && strncmp(name, text, len) == 0))
+	while (i < end) {
+		name = bin_commands[bin_commands_idx[i++]];
+		if (is_internal_c(name) == 0)
 			return strdup(name);
 	}
 
@@ -2020,21 +2171,15 @@ bin_cmd_generator(const char *text, int state)
 	if (!bin_commands)
 		return (char *)NULL;
 
-	static int i;
-	static size_t len;
-	char *name;
+	static size_t i, end;
 
 	if (!state) {
-		i = 0;
-		len = strlen(text);
+		end = get_bin_cmds_range(text, text ? strlen(text) : 0, &i);
+		end += i;
 	}
 
-	while ((name = bin_commands[i++]) != NULL) {
-		if (!text || !*text)
-			return strdup(name);
-		if (*text == *name && strncmp(name, text, len) == 0)
-			return strdup(name);
-	}
+	if (i < end)
+		return strdup(bin_commands[bin_commands_idx[i++]]);
 
 	return (char *)NULL;
 }
@@ -46,6 +46,7 @@
 #include "aux.h"
 #include "checks.h"
 #include "colors.h"
+#include "frame.h"
 #include "listing.h"
 #include "misc.h"
 #include "navigation.h"
@@ -56,18 +57,559 @@
 #include "file_operations.h"
 #include "init.h"
 
+/* Indices of the selection box: open addressing (linear probing) hash
+ * tables, at most half full, whose slots hold indices into the
+ * sel_elements array plus one (zero means empty). Full paths are indexed
+ * in NAMES, and device and inode numbers (sel_devino) in DEVINO.
+ * Entries are added by index_sel_file(), and both tables are cleared by
+ * reset_sel_index() whenever the selection box is loaded again (see
+ * get_sel_files()) or files are deselected. Matches are always verified
+ * against the sel_elements and sel_devino arrays. */
+struct sel_index_t {
+	size_t *names;
+	size_t *devino;
+	size_t names_mask;
+	size_t devino_mask;
+	size_t names_n;  /* Entries in the NAMES table */
+	size_t devino_n; /* Entries in the DEVINO table */
+};
+
+static struct sel_index_t sel_index = {0};
+
+/* FNV-1a */
+static inline size_t
+sel_name_hash(const char *name)
+{
+	size_t hash = (size_t)2166136261U;
+	while (*name) {
+		hash = (hash ^ (unsigned char)*name) * (size_t)16777619U;
+		name++;
+	}
+
+	return hash;
+}
+
+static inline size_t
+sel_devino_hash(const dev_t dev, const ino_t ino)
+{
+	const uint64_t h = ((uint64_t)ino ^ ((uint64_t)dev << 32 | (uint64_t)dev))
+		* 0x9E3779B97F4A7C15ULL;
+	return (size_t)(h ^ (h >> 32));
+}
+
+static void
+insert_sel_slot(size_t *table, const size_t mask, const size_t hash,
+	const size_t i)
+{
+	size_t slot = hash & mask;
+	while (table[slot] != 0)
+		slot = (slot + 1) & mask;
+
+	table[slot] = i + 1;
+}
+
+/* Make room in the table *TABLE (whose mask is *MASK) for N entries,
+ * rehashing the entries already there */
+static void
+grow_sel_table(size_t **table, size_t *mask, const size_t n, const int names)
+{
+	if (*table && n * 2 <= *mask + 1)
+		return;
+
+	size_t size = *table ? (*mask + 1) * 2 : 64;
+	while (size < n * 2)
+		size <<= 1;
+
+	size_t *old = *table;
+	const size_t old_size = old ? *mask + 1 : 0;
+
+	*table = (size_t *)xcalloc(size, sizeof(size_t));
+	*mask = size - 1;
+
+	size_t i;
+	for (i = 0; i < old_size; i++) {
+		if (old[i] == 0)
+			continue;
+		const size_t j = old[i] - 1;
+		insert_sel_slot(*table, *mask, names == 1
+			? sel_name_hash(sel_elements[j].name)
+			: sel_devino_hash(sel_devino[j].dev, sel_devino[j].ino), j);
+	}
+
+	free(old);
+}
+
+/* Add sel_devino[I] to the device and inode numbers index */
+static void
+index_sel_devino(const size_t i)
+{
+	grow_sel_table(&sel_index.devino, &sel_index.devino_mask,
+		sel_index.devino_n + 1, 0);
+	insert_sel_slot(sel_index.devino, sel_index.devino_mask,
+		sel_devino_hash(sel_devino[i].dev, sel_devino[i].ino), i);
+	sel_index.devino_n++;
+}
+
+/* Add the entry at index I of the sel_elements array to the selection
+ * box indices. If DEVINO is set to 1, sel_devino[I] is indexed as well. */
+void
+index_sel_file(const size_t i, const int devino)
+{
+	grow_sel_table(&sel_index.names, &sel_index.names_mask,
+		sel_index.names_n + 1, 1);
+	insert_sel_slot(sel_index.names, sel_index.names_mask,
+		sel_name_hash(sel_elements[i].name), i);
+	sel_index.names_n++;
+
+	if (devino == 1)
+		index_sel_devino(i);
+}
+
+/* Empty the selection box indices (keeping their tables) */
+void
+reset_sel_index(void)
+{
+	if (sel_index.names)
+		memset(sel_index.names, 0, (sel_index.names_mask + 1) * sizeof(size_t));
+	if (sel_index.devino)
+		memset(sel_index.devino, 0,
+			(sel_index.devino_mask + 1) * sizeof(size_t));
+
+	sel_index.names_n = sel_index.devino_n = 0;
+}
+
+void
+free_sel_index(void)
+{
+	free(sel_index.names);
+	free(sel_index.devino);
+	sel_index = (struct sel_index_t){0};
+}
+
+/* Return the index of the selected file NAME (a full path) in the
+ * sel_elements array, or -1 if not selected */
+ssize_t
+find_sel_file(const char *name)
+{
+	if (sel_index.names_n == 0 || !name)
+		return (-1);
+
+	size_t slot = sel_name_hash(name) & sel_index.names_mask;
+	while (sel_index.names[slot] != 0) {
+		const size_t i = sel_index.names[slot] - 1;
+		if (i < sel_n && sel_elements[i].name
+		&& *sel_elements[i].name == *name
+		&& strcmp(sel_elements[i].name, name) == 0)
+			return (ssize_t)i;
+		slot = (slot + 1) & sel_index.names_mask;
+	}
+
+	return (-1);
+}
+
+/* Return 1 if the file NAME (a base name) in the device DEV with inode INO
+ * is selected, or 0 otherwise. Hard links (regular files with more than
+ * one link, i.e. LINKS > 1 and DIR set to 0) are told apart by name. */
+int
+is_sel_file(const dev_t dev, const ino_t ino, const nlink_t links,
+	const int dir, const char *name)
+{
+	if (sel_index.devino_n == 0)
+		return 0;
+
+	size_t slot = sel_devino_hash(dev, ino) & sel_index.devino_mask;
+	while (sel_index.devino[slot] != 0) {
+		const size_t i = sel_index.devino[slot] - 1;
+		slot = (slot + 1) & sel_index.devino_mask;
+
+		if (i >= sel_n || !sel_elements[i].name
+		|| sel_devino[i].dev != dev || sel_devino[i].ino != ino)
+			continue;
+
+		/* Only check hardlinks in case of regular files */
+		if (dir == 0 && links > 1) {
+			const char *p = strrchr(sel_elements[i].name, '/');
+			if (!p || !*(++p))
+				continue;
+			if (*p == *name && strcmp(p, name) == 0)
+				return 1;
+		} else {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* The selections file works as a journal: selected files are appended to
+ * it, one path per line, and deselected files are recorded by appending
+ * their paths prefixed by SEL_RM_RECORD. Programs reading the file as a
+ * plain list of paths (plugins, or anything reading CLIFM_SELFILE) know
+ * nothing about these records, so the file is compacted by save_sel()
+ * whenever removal records are pending before running external commands
+ * (see flush_sel_journal()) and at exit (see close_sel_journal()), and also
+ * once dead records outnumber live ones.
+ * Compacting means writing a new file and renaming it over the old one:
+ * other instances sharing the selections box notice the inode change and
+ * load the whole file again. Otherwise, they just read the records
+ * appended since their last read (see sync_sel_files()). */
+#define SEL_RM_RECORD     "#-"
+#define SEL_RM_RECORD_LEN 2
+/* Do not compact the journal before it has this many records */
+#define SEL_JOURNAL_MIN   64
+
+struct sel_journal_t {
+	off_t offset;    /* Bytes of the selections file already read */
+	ino_t ino;
+	dev_t dev;
+	size_t records;  /* Records (additions and removals) up to OFFSET */
+	size_t removals; /* Removal records up to OFFSET */
+};
+
+static struct sel_journal_t sel_journal = {0};
+/* Set when selected files might have been removed or renamed by an
+ * external command */
+static int sel_recheck = 0;
+
+static inline int
+sel_journal_is_bloated(void)
+{
+	return ((sel_n == 0 && sel_journal.records > 0)
+	|| (sel_journal.records > SEL_JOURNAL_MIN
+	&& sel_journal.records > sel_n * 2));
+}
+
+/* Remove the entries marked as deselected (whose name is NULL) from the
+ * selection box, keeping the order of the remaining ones, and index the
+ * selection box again */
+static void
+compact_sel_elements(void)
+{
+	/* Only the first sel_index.devino_n entries of sel_devino are loaded
+	 * (see append_sel_files()) */
+	const size_t devino_n = sel_index.devino_n;
+	size_t j, n = 0, d = 0;
+	for (j = 0; j < sel_n; j++) {
+		if (!sel_elements[j].name)
+			continue;
+		if (j < devino_n)
+			sel_devino[d++] = sel_devino[j];
+		sel_elements[n++] = sel_elements[j];
+	}
+
+	sel_n = n;
+	sel_elements[n].name = (char *)NULL;
+	sel_elements[n].size = (off_t)UNSET;
+
+	reset_sel_index();
+	for (j = 0; j < n; j++)
+		index_sel_file(j, j < d);
+}
+
+/* Empty the selection box and forget the journal */
+static void
+clear_sel_elements(void)
+{
+	int i = (int)sel_n;
+	while (--i >= 0) {
+		free(sel_elements[i].name);
+		sel_elements[i].name = (char *)NULL;
+	}
+
+	sel_n = 0;
+	reset_sel_index();
+	sel_journal = (struct sel_journal_t){0};
+}
+
+/* Apply the records read from FP to the selection box, advancing the
+ * journal offset. Lines not ending with a new line char are taken as
+ * still being written by another instance, and left for the next read,
+ * unless FULL is set to 1 (the whole file is being loaded).
+ * Returns the amount of lines to be dropped when compacting the file:
+ * non-existent and already selected files, and an unterminated last line. */
+static size_t
+read_sel_journal(FILE *fp, const int full)
+{
+	size_t dropped = 0, removed = 0;
+	struct stat a;
+	/* Since this file contains only paths, PATH_MAX should be enough. */
+	char line[PATH_MAX + SEL_RM_RECORD_LEN];
+
+	while (fgets(line, (int)sizeof(line), fp) != NULL) {
+		size_t len = strlen(line);
+		if (len == 0)
+			continue;
+
+		if (line[len - 1] != '\n') {
+			if (full == 0)
+				break;
+			dropped++;
+		}
+
+		sel_journal.offset += (off_t)len;
+
+		if (line[len - 1] == '\n') {
+			len--;
+			line[len] = '\0';
+		}
+
+		/* Remove the ending slash: fstatat() won't take a symlink to dir as
+		 * a symlink (but as a dir), if the file name ends with a slash. */
+		if (len > 1 && line[len - 1] == '/') {
+			len--;
+			line[len] = '\0';
+		}
+
+		if (len == 0)
+			continue;
+
+		if (*line == '#') {
+			if (strncmp(line, SEL_RM_RECORD, SEL_RM_RECORD_LEN) != 0
+			|| line[SEL_RM_RECORD_LEN] != '/')
+				continue; /* A comment */
+
+			sel_journal.records++;
+			sel_journal.removals++;
+
+			const ssize_t i = find_sel_file(line + SEL_RM_RECORD_LEN);
+			if (i != -1) {
+				free(sel_elements[i].name);
+				sel_elements[i].name = (char *)NULL;
+				removed++;
+			}
+			continue;
+		}
+
+		sel_journal.records++;
+
+		/* Files already selected were, say, added twice by instances
+		 * sharing the selections box. */
+		if (fstatat(XAT_FDCWD, line, &a, AT_SYMLINK_NOFOLLOW) == -1
+		|| find_sel_file(line) != -1) {
+			dropped++;
+			continue;
+		}
+
+		sel_elements = (struct sel_t *)xrealloc(sel_elements,
+				(sel_n + 2) * sizeof(struct sel_t));
+		sel_elements[sel_n].name = savestring(line, len);
+		sel_elements[sel_n].size = (off_t)UNSET;
+		/* Store device and inode number to identify later selected files
+		 * and mark them in the files list. */
+		sel_devino = (struct devino_t *)xrealloc(sel_devino,
+				(sel_n + 1) * sizeof(struct devino_t));
+		sel_devino[sel_n].ino = a.st_ino;
+		sel_devino[sel_n].dev = a.st_dev;
+		index_sel_file(sel_n, sel_index.devino_n == sel_n);
+		sel_n++;
+		sel_elements[sel_n].name = (char *)NULL;
+		sel_elements[sel_n].size = (off_t)UNSET;
+	}
+
+	if (removed > 0)
+		compact_sel_elements();
+
+	return dropped;
+}
+
+/* Get current entries in the Selection Box, if any, reading the whole
+ * selections file. */
+int
+get_sel_files(void)
+{
+	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
+		return EXIT_FAILURE;
+
+	/* First, clear the sel array, in case it was already used. */
+	clear_sel_elements();
+
+	int fd;
+	FILE *fp = open_fread(sel_file, &fd);
+	if (!fp)
+		return EXIT_FAILURE;
+
+	struct stat a;
+	if (fstat(fd, &a) == -1) {
+		fclose(fp);
+		return EXIT_FAILURE;
+	}
+
+	sel_journal.ino = a.st_ino;
+	sel_journal.dev = a.st_dev;
+
+	const size_t dropped = read_sel_journal(fp, 1);
+	fclose(fp);
+
+	/* If some line was dropped (mostly because some selected files were
+	 * removed), recreate the selections file to reflect current state. */
+	if (dropped > 0 || sel_journal_is_bloated() == 1)
+		save_sel();
+
+	return EXIT_SUCCESS;
+}
+
+/* Update the Selection Box with the records appended to the selections
+ * file (by this or another instance) since it was last read. The whole
+ * file is loaded if it was replaced or truncated in the meanwhile. */
+int
+sync_sel_files(void)
+{
+	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
+		return EXIT_FAILURE;
+
+	struct stat a;
+	if (stat(sel_file, &a) == -1) {
+		if (errno != ENOENT)
+			return EXIT_FAILURE;
+		/* Removed: everything was deselected */
+		if (sel_n > 0 || sel_journal.records > 0)
+			clear_sel_elements();
+		return EXIT_SUCCESS;
+	}
+
+	if (a.st_ino != sel_journal.ino || a.st_dev != sel_journal.dev
+	|| a.st_size < sel_journal.offset || (sel_recheck == 1 && sel_n > 0)) {
+		sel_recheck = 0;
+		return get_sel_files();
+	}
+
+	if (a.st_size == sel_journal.offset)
+		return EXIT_SUCCESS;
+
+	int fd;
+	FILE *fp = open_fread(sel_file, &fd);
+	if (!fp)
+		return EXIT_FAILURE;
+
+	/* Make sure we are still reading the same file, and that the journal
+	 * offset falls right after a complete line. */
+	if (fstat(fd, &a) == -1 || a.st_ino != sel_journal.ino
+	|| a.st_dev != sel_journal.dev || sel_journal.offset == 0
+	|| fseeko(fp, sel_journal.offset - 1, SEEK_SET) == -1
+	|| fgetc(fp) != '\n') {
+		fclose(fp);
+		return get_sel_files();
+	}
+
+	read_sel_journal(fp, 0);
+	fclose(fp);
+
+	if (sel_journal_is_bloated() == 1)
+		save_sel();
+
+	return EXIT_SUCCESS;
+}
+
+/* Append the LEN bytes in BUF, holding RECORDS records (REMOVALS of them
+ * being removal records), to the selections file. The journal offset is
+ * advanced past them only if no other instance appended records since the
+ * file was last read: otherwise, they will be read back (and applied again,
+ * which is harmless) by sync_sel_files(). */
+static int
+write_sel_records(const char *buf, const size_t len, const size_t records,
+	const size_t removals)
+{
+	const int fd = open(sel_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+		S_IRUSR | S_IWUSR);
+	if (fd == -1) {
+		xerror("sel: %s: %s\n", sel_file, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	struct stat a;
+	const int in_sync = (fstat(fd, &a) != -1
+		&& a.st_size == sel_journal.offset && (a.st_size == 0
+		|| (a.st_ino == sel_journal.ino && a.st_dev == sel_journal.dev)));
+
+	const ssize_t ret = write(fd, buf, len);
+	if (ret != (ssize_t)len) {
+		xerror("sel: %s: %s\n", sel_file, ret == -1 ? strerror(errno)
+			: _("Short write"));
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	if (in_sync == 1 && fstat(fd, &a) != -1
+	&& a.st_size == sel_journal.offset + (off_t)len) {
+		sel_journal.offset = a.st_size;
+		sel_journal.ino = a.st_ino;
+		sel_journal.dev = a.st_dev;
+		sel_journal.records += records;
+		sel_journal.removals += removals;
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
+
+/* Append the last N entries of the Selection Box (just selected by
+ * select_file()) to the selections file, and store their device and inode
+ * numbers to mark them in the files list. */
+int
+append_sel_files(const size_t n)
+{
+	if (n == 0 || n > sel_n)
+		return EXIT_SUCCESS;
+
+	const size_t start = sel_n - n;
+	/* Keep sel_devino loaded for a prefix of the Selection Box */
+	const int devino = (sel_index.devino_n == start);
+	if (devino == 1) {
+		sel_devino = (struct devino_t *)xrealloc(sel_devino,
+			(sel_n + 1) * sizeof(struct devino_t));
+	}
+
+	size_t i, len = 0;
+	for (i = start; i < sel_n; i++) {
+		len += strlen(sel_elements[i].name) + 1;
+		if (devino == 0)
+			continue;
+
+		struct stat a;
+		if (fstatat(XAT_FDCWD, sel_elements[i].name, &a,
+		AT_SYMLINK_NOFOLLOW) == -1)
+			a.st_dev = 0, a.st_ino = 0;
+		sel_devino[i].ino = a.st_ino;
+		sel_devino[i].dev = a.st_dev;
+		index_sel_devino(i);
+	}
+
+	if (selfile_ok == 0 || config_ok == 0 || !sel_file
+	|| xargs.stealth_mode == 1)
+		return EXIT_SUCCESS;
+
+	char *buf = (char *)xnmalloc(len + 1, sizeof(char));
+	char *p = buf;
+	for (i = start; i < sel_n; i++) {
+		const size_t l = strlen(sel_elements[i].name);
+		memcpy(p, sel_elements[i].name, l);
+		p[l] = '\n';
+		p += l + 1;
+	}
+
+	const int ret = write_sel_records(buf, len, n, 0);
+	free(buf);
+	return ret;
+}
+
 /* Save selected elements into a tmp file. Returns 1 if success and 0
  * if error. This function allows the user to work with multiple
  * instances of the program: he/she can select some files in the
  * first instance and then execute a second one to operate on those
- * files as he/she wishes. */
+ * files as he/she wishes.
+ * The whole selections file is rewritten (compacting the journal): the
+ * new contents are written into a temporary file, which is then renamed
+ * over the selections file. */
 int
 save_sel(void)
 {
 	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
 		return EXIT_FAILURE;
 
+	sel_journal = (struct sel_journal_t){0};
+
 	if (sel_n == 0) {
+		reset_sel_index();
 		if (unlink(sel_file) == -1) {
 			xerror("sel: %s: %s\n", sel_file, strerror(errno));
 			return EXIT_FAILURE;
@@ -75,10 +617,19 @@ save_sel(void)
 		return EXIT_SUCCESS;
 	}
 
-	int fd = 0;
-	FILE *fp = open_fwrite(sel_file, &fd);
+	const size_t tmp_len = strlen(sel_file) + 8;
+	char *tmp_file = (char *)xnmalloc(tmp_len, sizeof(char));
+	snprintf(tmp_file, tmp_len, "%s.XXXXXX", sel_file);
+
+	const int fd = mkstemp(tmp_file);
+	FILE *fp = fd == -1 ? (FILE *)NULL : fdopen(fd, "w");
 	if (!fp) {
-		xerror("sel: %s: %s\n", sel_file, strerror(errno));
+		xerror("sel: %s: %s\n", tmp_file, strerror(errno));
+		if (fd != -1) {
+			close(fd);
+			unlink(tmp_file);
+		}
+		free(tmp_file);
 		return EXIT_FAILURE;
 	}
 
@@ -88,36 +639,82 @@ save_sel(void)
 		fputc('\n', fp);
 	}
 
+	struct stat a;
+	if (fflush(fp) != 0 || fstat(fd, &a) == -1) {
+		xerror("sel: %s: %s\n", tmp_file, strerror(errno));
+		fclose(fp);
+		unlink(tmp_file);
+		free(tmp_file);
+		return EXIT_FAILURE;
+	}
+
 	fclose(fp);
+
+	if (rename(tmp_file, sel_file) == -1) {
+		xerror("sel: %s: %s\n", sel_file, strerror(errno));
+		unlink(tmp_file);
+		free(tmp_file);
+		return EXIT_FAILURE;
+	}
+
+	free(tmp_file);
+
+	sel_journal.offset = a.st_size;
+	sel_journal.ino = a.st_ino;
+	sel_journal.dev = a.st_dev;
+	sel_journal.records = sel_n;
+
 	return EXIT_SUCCESS;
 }
 
+/* Compact the selections file if it holds removal records, which programs
+ * reading it as a plain list of paths would not understand. Called before
+ * running external commands: since they might remove selected files, the
+ * whole file is loaded again (dropping non-existent files) the next time
+ * the Selection Box is synced. */
+void
+flush_sel_journal(void)
+{
+	sel_recheck = 1;
+	if (sel_journal.removals > 0)
+		save_sel();
+}
+
+/* Compact the selections file at exit if it holds removal records, so that
+ * it is left as a plain list of paths. Records appended by other instances
+ * are read first: they must be kept. */
+void
+close_sel_journal(void)
+{
+	if (selfile_ok == 0 || config_ok == 0 || !sel_file)
+		return;
+
+	sync_sel_files();
+	if (sel_journal.removals > 0)
+		save_sel();
+}
+
 int
 select_file(char *file)
 {
 	if (!file || !*file)
 		return 0;
 
-	int exists = 0, new_sel = 0, j;
+	int new_sel = 0;
 	size_t flen = strlen(file);
 	if (flen > 1 && file[flen - 1] == '/')
 		file[flen - 1] = '\0';
 
-	/* Check if FILE is already in the selection box */
-	j = (int)sel_n;
-	while (--j >= 0) {
-		if (*file == *sel_elements[j].name
-		&& strcmp(sel_elements[j].name, file) == 0) {
-			exists = 1;
-			break;
-		}
-	}
+	if (sel_n == 0)
+		reset_sel_index();
 
-	if (exists == 0) {
+	/* Check if FILE is already in the selection box */
+	if (find_sel_file(file) == -1) {
 		sel_elements = (struct sel_t *)xrealloc(sel_elements,
 			(sel_n + 2) * sizeof(struct sel_t));
 		sel_elements[sel_n].name = savestring(file, strlen(file));
 		sel_elements[sel_n].size = (off_t)UNSET;
+		index_sel_file(sel_n, 0);
 		sel_n++;
 		sel_elements[sel_n].name = (char *)NULL;
 		sel_elements[sel_n].size = (off_t)UNSET;
@@ -655,11 +1252,10 @@ print_selected_files(void)
 }
 
 static int
-print_sel_results(const int new_sel, const char *sel_path,
-	const char *pattern, const int error)
+print_sel_results(const int new_sel, const size_t appended,
+	const char *sel_path, const char *pattern, const int error)
 {
-	if (new_sel > 0 && xargs.stealth_mode != 1 && sel_file
-	&& save_sel() != EXIT_SUCCESS) {
+	if (appended > 0 && append_sel_files(appended) != EXIT_SUCCESS) {
 		err('e', PRINT_PROMPT, _("sel: Error writing selected files "
 			"into the selections file\n"));
 		return EXIT_FAILURE;
@@ -676,8 +1272,6 @@ print_sel_results(const int new_sel, const char *sel_path,
 		return EXIT_FAILURE;
 	}
 
-	get_sel_files();
-
 	if (conf.autols == 1 && error == 0)
 		reload_dirlist();
 
@@ -805,6 +1399,7 @@ sel_function(char **args)
 
 	mode_t filetype = 0;
 	int i, ifiletype = 0, isel_path = 0, new_sel = 0, err = 0, f = 0;
+	const size_t seln_bk = sel_n;
 
 	char *dir = (char *)NULL, *pattern = (char *)NULL;
 	char *sel_path = parse_sel_params(&args, &ifiletype, &filetype, &isel_path);
@@ -834,7 +1429,7 @@ sel_function(char **args)
 		fputs(_("Missing parameter. Try 's --help'\n"), stderr);
 	free(dir);
 
-	return print_sel_results(new_sel, sel_path, pattern, err);
+	return print_sel_results(new_sel, sel_n - seln_bk, sel_path, pattern, err);
 }
 
 void
@@ -948,6 +1543,11 @@ edit_selfile(void)
 		return EXIT_SUCCESS;
 
 	int ret = get_sel_files();
+	/* The file might have been modified in place: replace it, so that
+	 * other instances load it again. */
+	if (ret == EXIT_SUCCESS)
+		save_sel();
+
 	if (conf.autols == 1)
 		reload_dirlist();
 
@@ -959,31 +1559,26 @@ ERROR:
 	return EXIT_FAILURE;
 }
 
+/* Remove the DESEL_N files in DESEL_PATH from the selection box, and
+ * return the amount of deselected files (ERROR is set to 1 if some file
+ * was not selected). Deselected entries are marked first, and then removed
+ * all at once, keeping the order of the remaining entries. A removal
+ * record is appended to the selections file for each of them. */
 static int
 deselect_entries(char **desel_path, const size_t desel_n, int *error,
 	const int desel_screen)
 {
-	int dn = (int)desel_n;
+	int dn = 0;
 	int i = (int)desel_n;
+	char *buf = (char *)NULL;
+	size_t len = 0;
 
 	while (--i >= 0) {
-		int j, k, desel_index = -1;
-
 		if (!desel_path[i])
 			continue;
 
-		/* Search the sel array for the path of the entry to be deselected and
-		 * store its index. */
-		k = (int)sel_n;
-		while (--k >= 0) {
-			if (strcmp(sel_elements[k].name, desel_path[i]) == 0) {
-				desel_index = k;
-				break;
-			}
-		}
-
+		const ssize_t desel_index = find_sel_file(desel_path[i]);
 		if (desel_index == -1) {
-			dn--;
 			*error = 1;
 			if (desel_screen == 0) {
 				xerror(_("%s: %s: No such selected file\n"),
@@ -992,31 +1587,33 @@ deselect_entries(char **desel_path, const size_t desel_n, int *error,
 			continue;
 		}
 
-		/* Once the index was found, rearrange the sel array removing the
-		 * deselected element (actually, moving each string after it to
-		 * the previous position). */
-		for (j = desel_index; j < (int)(sel_n - 1); j++) {
-			size_t len = strlen(sel_elements[j + 1].name);
-			sel_elements[j].name =
-				(char *)xrealloc(sel_elements[j].name, (len + 1) * sizeof(char));
-
-			xstrsncpy(sel_elements[j].name, sel_elements[j + 1].name, len + 1);
-			sel_elements[j].size = sel_elements[j + 1].size;
-		}
+		char *name = sel_elements[desel_index].name;
+		const size_t l = strlen(name);
+		buf = (char *)xrealloc(buf, len + l + SEL_RM_RECORD_LEN + 2);
+		memcpy(buf + len, SEL_RM_RECORD, SEL_RM_RECORD_LEN);
+		memcpy(buf + len + SEL_RM_RECORD_LEN, name, l);
+		len += l + SEL_RM_RECORD_LEN;
+		buf[len++] = '\n';
+
+		free(name);
+		sel_elements[desel_index].name = (char *)NULL;
+		dn++;
 	}
 
-	/* Free the last DN entries from the old sel array. They won't
-	 * be used anymore, since they contain the same value as the last
-	 * non-deselected element due to the above array rearrangement. */
-	for (i = 1; i <= dn; i++) {
-		int sel_index = (int)sel_n - i;
+	if (dn == 0)
+		return 0;
 
-		if (sel_index >= 0 && sel_elements[sel_index].name) {
-			free(sel_elements[sel_index].name);
-			sel_elements[sel_index].size = (off_t)UNSET;
-		}
+	compact_sel_elements();
+
+	if (selfile_ok == 1 && config_ok == 1 && sel_file) {
+		if (sel_n == 0)
+			save_sel();
+		else if (write_sel_records(buf, len, (size_t)dn, (size_t)dn)
+		== EXIT_SUCCESS && sel_journal_is_bloated() == 1)
+			save_sel();
 	}
 
+	free(buf);
 	return dn;
 }
 
@@ -1043,18 +1640,12 @@ desel_entries(char **desel_elements, const size_t desel_n, const int desel_scree
 	}
 
 	int err = 0;
+	/* Updates the number of selected files as well */
 	int dn = deselect_entries(desel_path, desel_n, &err, desel_screen);
 
-	/* Update the number of selected files according to the number of
-	 * deselected files. */
-	sel_n = (sel_n - (size_t)dn);
-
-	if ((int)sel_n < 0)
-		sel_n = 0;
-
 	if (sel_n > 0) {
 		sel_elements = (struct sel_t *)xrealloc(sel_elements,
-			sel_n * sizeof(struct sel_t));
+			(sel_n + 1) * sizeof(struct sel_t));
 	}
 
 	/* Deallocate local arrays. */
@@ -1073,10 +1664,8 @@ desel_entries(char **desel_elements, const size_t desel_n, const int desel_scree
 	}
 	free(desel_elements);
 
-	if (err == 1) {
-		save_sel();
+	if (err == 1)
 		return EXIT_FAILURE;
-	}
 
 	return EXIT_SUCCESS;
 }
@@ -1093,6 +1682,7 @@ deselect_all(void)
 	}
 
 	sel_n = 0;
+	reset_sel_index();
 
 	return save_sel();
 }
@@ -1213,10 +1803,7 @@ end_deselect(const int err, char ***args)
 		args_n = 0;
 	}
 
-	if (!err && save_sel() != 0)
-		exit_status = EXIT_FAILURE;
-
-	get_sel_files();
+	sync_sel_files();
 
 	/* There is still some selected file and we are in the desel
 	 * screen: reload this screen */
@@ -32,12 +32,23 @@
 
 __BEGIN_DECLS
 
+int  append_sel_files(const size_t);
 int  deselect(char **);
+void close_sel_journal(void);
+void flush_sel_journal(void);
+int  get_sel_files(void);
 int  sel_function(char **);
 int  select_file(char *);
+int  sync_sel_files(void);
 void show_sel_files(void);
 int  save_sel(void);
 int  deselect_all(void);
+ssize_t find_sel_file(const char *);
+void free_sel_index(void);
+void index_sel_file(const size_t, const int);
+int  is_sel_file(const dev_t, const ino_t, const nlink_t, const int,
+	const char *);
+void reset_sel_index(void);
 
 __END_DECLS
 
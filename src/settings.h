@@ -433,6 +433,7 @@ ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_CWD_IN_TITLE 0
 #define DEF_DESKTOP_NOTIFICATIONS 0
 #define DEF_DIRHIST_MAP 0
+#define DEF_DIR_SIZE_CACHE 0
 #define DEF_DISK_USAGE 0
 #define DEF_DIV_LINE "-"
 #define DEF_ELN_USE_WORKSPACE_COLOR 0
@@ -441,6 +442,14 @@ ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_QUOTING_STYLE QUOTING_STYLE_BACKSLASH
 #define DEF_EXT_CMD_OK 1
 #define DEF_FILES_COUNTER 1
+/* Milliseconds to wait for the files counter in each directory before
+ * listing files. The count of slower directories is completed in the
+ * background. 0 = always wait */
+#define DEF_FILES_COUNTER_TIMEOUT 250
+/* Milliseconds to wait for stat data before listing files using the
+ * information provided by the directory itself (see lazystat.c).
+ * 0 = always wait */
+#define DEF_LAZY_STAT_TIMEOUT 0
 #define DEF_FOLLOW_SYMLINKS 1
 #define DEF_FULL_DIR_SIZE 0
 #define DEF_FUZZY_MATCH 0
@@ -455,6 +464,13 @@ ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_LIGHT_MODE 0
 #define DEF_LIST_DIRS_FIRST 1
 #define DEF_LISTING_MODE VERTLIST
+/* Files lists of recently visited directories kept in memory (see
+ * store_cached_list()). 0 = disabled */
+#define DEF_LISTING_CACHE 0
+/* Max memory (MiB) taken by cached files lists. 0 = unlimited */
+#define DEF_LISTING_CACHE_SIZE 64
+/* Threads used to gather files information. 0 = auto (online CPUs) */
+#define DEF_LISTING_THREADS 0
 #define DEF_LOG_MSGS 0
 #define DEF_LOG_CMDS 0
 #define DEF_LONG_VIEW 0
@@ -466,13 +482,18 @@ ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_MAX_LOG 1000
 #define DEF_MAX_PATH 40
 #define DEF_MAX_PRINTSEL 0
+/* Refreshes of the files list triggered by file system events are
+ * coalesced: see flush_fs_events() */
+#define DEF_MAX_REFRESH_LATENCY 1000
 #define DEF_MIN_JUMP_RANK 10
 #define DEF_MIN_NAME_TRIM 20
+#define DEF_MIN_REFRESH_INTERVAL 100
 #define DEF_MOUNT_CMD MNT_UDEVIL
 #define DEF_MV_CMD MV_MV
 #define DEF_NOELN 0
 #define DEF_ONLY_DIRS 0
 #define DEF_PAGER 0
+#define DEF_PAGER_WINDOW 0
 #define DEF_PRINTSEL 0
 #define DEF_PRINT_REMOVED_FILES 1
 #define DEF_PRIVATE_WS_SETTINGS 0
@@ -507,6 +528,7 @@ ws4=32:ws5=36:ws6=38;5;214:ws7=35:ws8=2;37:xf=1;31:xs=32:"
 #define DEF_SUG_FILETYPE_COLOR 0
 #define DEF_SUG_STRATEGY "ehfj-ac"
 #define DEF_SUGGESTIONS 1
+#define DEF_SYNC_UPDATES 0
 #define DEF_TIME_STYLE_RECENT "%b %e %H:%M" /* Timestamps in long view mode */
 #define DEF_TIME_STYLE_OLDER  "%b %e  %Y"
 #define DEF_TIME_STYLE_LONG   "%a %b %d %T %Y %z" /* Used by history and trash */
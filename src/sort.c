@@ -28,8 +28,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <strings.h> /* str(n)casecmp() */
+#include <stdint.h> /* uint64_t */
+#if defined(SORT_SPEED_TEST)
+# include <time.h>
+#endif /* SORT_SPEED_TEST */
 
 #include "checks.h"
+#include "frame.h"
 #include "aux.h" /* xatoi */
 #include "listing.h"
 #include "messages.h"
@@ -154,6 +159,75 @@ namecmp(char *s1, char *s2)
 	return strcmp(s1, s2);
 }
 
+/* Write into BUF (SIZE bytes) a key for NAME such that comparing the keys
+ * of two names with memcmp(3) (see keycmp()) gives the same result as
+ * running namecmp() on the names themselves. The key is made of the
+ * fields namecmp() compares, in the same order:
+ *   - The first byte of the name, or '0' for all names starting with a digit
+ *     (for namecmp() all digits sort the same against any other byte),
+ *     followed, for the latter, by the leading number in big endian order
+ *     and the actual first digit.
+ *   - The name, transformed via strxfrm(3) (if case insensitive), so that
+ *     comparing it with memcmp(3) amounts to strcoll(3).
+ * Prefixes skipped by namecmp() are skipped here as well.
+ *
+ * Like strxfrm(3), the length of the key is returned: if not less than
+ * SIZE, BUF contents are undefined and the caller should try again with
+ * a larger buffer. If NAME starts with a non-ASCII char (namecmp() handles
+ * these differently), zero is returned, meaning that no key can be built
+ * for this name, and namecmp() must be used instead. */
+size_t
+name_sort_key(char *name, char *buf, const size_t size)
+{
+	skip_name_prefixes(&name);
+	if ((unsigned char)*name >= 0x80)
+		return 0;
+
+	char hdr[10];
+	size_t n = 0;
+
+	if (IS_DIGIT(*name)) {
+		const unsigned long long num =
+			(unsigned long long)strtoll(name, NULL, 10);
+		hdr[n++] = '0';
+		int i;
+		for (i = 56; i >= 0; i -= 8)
+			hdr[n++] = (char)((num >> i) & 0xff);
+		hdr[n++] = *name;
+	} else {
+		hdr[n++] = conf.case_sens_list == 1 ? *name : (char)TOUPPER(*name);
+	}
+
+	size_t len;
+	if (conf.case_sens_list == 1) {
+		len = strlen(name);
+		if (n + len < size)
+			memcpy(buf + n, name, len + 1);
+	} else {
+		len = strxfrm(size > n ? buf + n : (char *)NULL, name,
+			size > n ? size - n : 0);
+	}
+
+	if (n + len < size)
+		memcpy(buf, hdr, n);
+
+	return n + len;
+}
+
+/* Compare the names of two entries via their sort keys */
+static inline int
+keycmp(const struct fileinfo *pa, const struct fileinfo *pb)
+{
+	const size_t alen = pa->sort_key_len, blen = pb->sort_key_len;
+	const int ret = memcmp(pa->sort_key, pb->sort_key,
+		alen < blen ? alen : blen);
+
+	if (ret != 0)
+		return ret;
+
+	return (alen > blen) - (alen < blen);
+}
+
 static inline int
 sort_by_size(struct fileinfo *pa, struct fileinfo *pb)
 {
@@ -291,10 +365,10 @@ entrycmp(const void *a, const void *b)
 
 	switch (st) {
 	case STSIZE: ret = sort_by_size(pa, pb); break;
-	case SATIME: /* fallthrough */
-	case SBTIME: /* fallthrough */
-	case SCTIME: /* fallthrough */
-	case SMTIME: ret = sort_by_time(pa->time, pb->time); break;
+	case SATIME: ret = sort_by_time(pa->atime, pb->atime); break;
+	case SBTIME: ret = sort_by_time(pa->btime, pb->btime); break;
+	case SCTIME: ret = sort_by_time(pa->ctime, pb->ctime); break;
+	case SMTIME: ret = sort_by_time(pa->mtime, pb->mtime); break;
 	case SVER: ret = xstrverscmp(pa->name, pb->name); break;
 	case SEXT: ret = sort_by_extension(pa->name, pb->name); break;
 	case SINO: ret = sort_by_inode(pa->inode, pb->inode); break;
@@ -303,12 +377,352 @@ entrycmp(const void *a, const void *b)
 	default: break;
 	}
 
+	if (!ret) {
+		ret = (pa->sort_key && pb->sort_key) ? keycmp(pa, pb)
+			: namecmp(pa->name, pb->name);
+	}
+	if (conf.sort_reverse)
+		ret = (ret - (ret * 2));
+
+	/* Keep directory order for otherwise equal entries, no matter the
+	 * order in which they are found in the list (which may have been
+	 * sorted before by some other method, see resort_dirlist()) */
 	if (!ret)
-		ret = namecmp(pa->name, pb->name);
-	if (!conf.sort_reverse)
+		ret = pa->dir_index > pb->dir_index ? 1 : -1;
+
+	return ret;
+}
+
+/* The list being sorted by sort_by_keys() */
+static struct fileinfo *sort_list = (struct fileinfo *)NULL;
+
+/* An entry of the list being sorted, along with the keys it is sorted by,
+ * so that sorting does not need to access the (rather large) fileinfo
+ * structs */
+struct sort_rec_t {
+	uint64_t num;    /* Numeric key (see num_sort_key()) */
+	const char *key; /* Name sort key (NULL if none, see name_sort_key()) */
+	size_t len;
+	filesn_t index;  /* Index in SORT_LIST */
+};
+
+/* Compare two records by name. Entries with equal names are kept in
+ * directory order, just as they are by entrycmp(). Since sort_partition()
+ * reverses the list afterwards when reverse sorting, use the opposite
+ * order in this case. */
+static int
+sort_rec_cmp(const void *a, const void *b)
+{
+	const struct sort_rec_t *ra = (const struct sort_rec_t *)a;
+	const struct sort_rec_t *rb = (const struct sort_rec_t *)b;
+	int ret;
+
+	if (ra->key && rb->key) {
+		ret = memcmp(ra->key, rb->key, ra->len < rb->len ? ra->len : rb->len);
+		if (ret == 0 && ra->len != rb->len)
+			ret = ra->len > rb->len ? 1 : -1;
+	} else {
+		ret = namecmp(sort_list[ra->index].name, sort_list[rb->index].name);
+	}
+
+	if (ret != 0)
 		return ret;
 
-	return (ret - (ret * 2));
+	ret = sort_list[ra->index].dir_index > sort_list[rb->index].dir_index
+		? 1 : -1;
+	return conf.sort_reverse == 1 ? -ret : ret;
+}
+
+/* Below this many records, buckets are sorted by comparison */
+#define RADIX_MIN_RECS 32
+
+/* Sort by name key the N records in RECS, whose keys are all equal up to
+ * DEPTH, via MSD radix sort. TMP is scratch space for N records. */
+static void
+radix_sort_recs(struct sort_rec_t *recs, struct sort_rec_t *tmp,
+	const size_t n, size_t depth)
+{
+	size_t cnt[257], pos[257];
+	size_t i;
+
+	while (n >= RADIX_MIN_RECS) {
+		/* Bucket 0 holds keys ending at DEPTH, 1-256 the next byte + 1 */
+		memset(cnt, 0, sizeof(cnt));
+		for (i = 0; i < n; i++) {
+			cnt[recs[i].len > depth
+				? (unsigned char)recs[i].key[depth] + 1 : 0]++;
+		}
+
+		const size_t first = recs[0].len > depth
+			? (unsigned char)recs[0].key[depth] + 1 : 0;
+		if (cnt[first] < n)
+			break;
+
+		/* All keys share this byte: just move on to the next one */
+		if (first == 0) {
+			qsort(recs, n, sizeof(struct sort_rec_t), sort_rec_cmp);
+			return;
+		}
+		depth++;
+	}
+
+	if (n < RADIX_MIN_RECS) {
+		qsort(recs, n, sizeof(struct sort_rec_t), sort_rec_cmp);
+		return;
+	}
+
+	size_t b, start = 0;
+	for (b = 0; b < 257; b++) {
+		pos[b] = start;
+		start += cnt[b];
+	}
+
+	for (i = 0; i < n; i++) {
+		b = recs[i].len > depth ? (unsigned char)recs[i].key[depth] + 1 : 0;
+		tmp[pos[b]++] = recs[i];
+	}
+	memcpy(recs, tmp, n * sizeof(struct sort_rec_t));
+
+	if (cnt[0] > 1) /* Equal keys */
+		qsort(recs, cnt[0], sizeof(struct sort_rec_t), sort_rec_cmp);
+
+	start = cnt[0];
+	for (b = 1; b < 257; b++) {
+		if (cnt[b] > 1)
+			radix_sort_recs(recs + start, tmp, cnt[b], depth + 1);
+		start += cnt[b];
+	}
+}
+
+/* Sort by name the N records in RECS. TMP is scratch space for N
+ * records. */
+static void
+sort_names(struct sort_rec_t *recs, struct sort_rec_t *tmp, const size_t n)
+{
+	size_t i;
+	for (i = 0; i < n && recs[i].key; i++);
+
+	if (n < RADIX_MIN_RECS || i < n) /* Some entry has no key */
+		qsort(recs, n, sizeof(struct sort_rec_t), sort_rec_cmp);
+	else
+		radix_sort_recs(recs, tmp, n, 0);
+}
+
+/* Map the value the sort method ST sorts F by to an unsigned integer
+ * keeping the same order */
+static inline uint64_t
+num_sort_key(const struct fileinfo *f, const int st)
+{
+	const uint64_t sign = (uint64_t)1 << 63;
+
+	switch (st) {
+	case SNONE: return (uint64_t)f->dir_index;
+	case STSIZE: return (uint64_t)(int64_t)f->size ^ sign;
+	case SINO: return (uint64_t)f->inode;
+	case SOWN: return (uint64_t)f->uid;
+	case SGRP: return (uint64_t)f->gid;
+	case SATIME: return (uint64_t)(int64_t)f->atime ^ sign;
+	case SBTIME: return (uint64_t)(int64_t)f->btime ^ sign;
+	case SCTIME: return (uint64_t)(int64_t)f->ctime ^ sign;
+	default: return (uint64_t)(int64_t)f->mtime ^ sign;
+	}
+}
+
+/* Sort the N records in RECS by numeric key via LSD radix sort (one byte
+ * per pass, skipping bytes shared by all keys). Being stable, records with
+ * equal keys keep their order. TMP is scratch space for N records. */
+static void
+radix_sort_nums(struct sort_rec_t *recs, struct sort_rec_t *tmp,
+	const size_t n)
+{
+	size_t cnt[8][256];
+	size_t i;
+	int b;
+
+	memset(cnt, 0, sizeof(cnt));
+	for (i = 0; i < n; i++) {
+		const uint64_t k = recs[i].num;
+		for (b = 0; b < 8; b++)
+			cnt[b][(k >> (b * 8)) & 0xff]++;
+	}
+
+	struct sort_rec_t *src = recs, *dst = tmp;
+	for (b = 0; b < 8; b++) {
+		const int shift = b * 8;
+		if (cnt[b][(src[0].num >> shift) & 0xff] == n)
+			continue;
+
+		size_t pos[256], start = 0, c;
+		for (c = 0; c < 256; c++) {
+			pos[c] = start;
+			start += cnt[b][c];
+		}
+
+		for (i = 0; i < n; i++)
+			dst[pos[(src[i].num >> shift) & 0xff]++] = src[i];
+
+		struct sort_rec_t *t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != recs)
+		memcpy(recs, src, n * sizeof(struct sort_rec_t));
+}
+
+/* Sort the N records in RECS by numeric key, breaking ties by name. TMP
+ * is scratch space for N records. */
+static void
+sort_numbers(struct sort_rec_t *recs, struct sort_rec_t *tmp, const size_t n)
+{
+	radix_sort_nums(recs, tmp, n);
+
+	size_t i, j;
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && recs[j].num == recs[i].num; j++);
+		if (j - i > 1)
+			sort_names(recs + i, tmp, j - i);
+	}
+}
+
+/* Sort the N records in RECS according to the sort method ST and the sort
+ * order. TMP is scratch space for N records. */
+static void
+sort_partition(struct sort_rec_t *recs, struct sort_rec_t *tmp,
+	const size_t n, const int st)
+{
+	if (n < 2)
+		return;
+
+	if (st == SNAME)
+		sort_names(recs, tmp, n);
+	else
+		sort_numbers(recs, tmp, n);
+
+	if (conf.sort_reverse == 0 || st == SNONE)
+		return;
+
+	size_t i, j;
+	for (i = 0, j = n - 1; i < j; i++, j--) {
+		const struct sort_rec_t t = recs[i];
+		recs[i] = recs[j];
+		recs[j] = t;
+	}
+}
+
+#ifdef SORT_SPEED_TEST
+static double
+sort_elapsed(const struct timespec *start, const struct timespec *end)
+{
+	return (double)(end->tv_sec - start->tv_sec)
+		+ (double)(end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+#endif /* SORT_SPEED_TEST */
+
+/* Sort the N entries in LIST using radix sorts on precomputed keys: names
+ * (see name_sort_key()) when sorting by name, or the corresponding value
+ * when sorting by size, time, inode, owner, or group (breaking ties by
+ * name). The resulting order is the same as the one produced by sorting
+ * LIST with entrycmp(), which is however much slower: it compares (and
+ * collates) names over and over again, and dereferences the (rather large)
+ * fileinfo structs on every comparison.
+ * Here LIST is read just once, to build an array of (keys, index) records,
+ * which is sorted instead. The resulting permutation is then applied to
+ * LIST, moving each entry once.
+ * If not sorting (SNONE), the list is put back in directory order.
+ * Returns -1 if the current sort method is not supported (version and
+ * extension), in which case the caller should use entrycmp() instead. */
+int
+sort_by_keys(struct fileinfo *list, const filesn_t n)
+{
+	int st = conf.sort;
+	if (conf.light_mode == 1 && (st == SOWN || st == SGRP))
+		st = SNAME;
+
+	switch (st) {
+	case SNONE: /* fallthrough */
+	case SNAME: /* fallthrough */
+	case STSIZE: /* fallthrough */
+	case SATIME: /* fallthrough */
+	case SBTIME: /* fallthrough */
+	case SCTIME: /* fallthrough */
+	case SMTIME: /* fallthrough */
+	case SINO: /* fallthrough */
+	case SOWN: /* fallthrough */
+	case SGRP: break;
+	default: return (-1);
+	}
+
+	if (n < 2)
+		return 0;
+
+#ifdef SORT_SPEED_TEST
+	struct timespec t_start, t_keys, t_sorted, t_end;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+#endif /* SORT_SPEED_TEST */
+
+	/* The second half is scratch space for the radix sorts */
+	struct sort_rec_t *recs = xnmalloc((size_t)n * 2, sizeof(struct sort_rec_t));
+	struct sort_rec_t *tmp = recs + n;
+
+	/* Directories go first (if listed first), regardless of the sort
+	 * order. The initial order of records does not matter: ties are
+	 * always broken by name, and then by directory order. */
+	const int dirs_first = (conf.list_dirs_first == 1 && st != SNONE);
+	size_t dirs = 0, last = (size_t)n;
+	filesn_t i;
+
+	for (i = 0; i < n; i++) {
+		struct sort_rec_t *r = (dirs_first == 1 && list[i].dir != 0)
+			? &recs[dirs++] : &recs[--last];
+		r->num = st == SNAME ? 0 : num_sort_key(&list[i], st);
+		r->key = list[i].sort_key;
+		r->len = list[i].sort_key_len;
+		r->index = i;
+	}
+
+#ifdef SORT_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &t_keys);
+#endif /* SORT_SPEED_TEST */
+
+	sort_list = list;
+	sort_partition(recs, tmp, dirs, st);
+	sort_partition(recs + dirs, tmp, (size_t)n - dirs, st);
+	sort_list = (struct fileinfo *)NULL;
+
+#ifdef SORT_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &t_sorted);
+#endif /* SORT_SPEED_TEST */
+
+	/* Move entries to their sorted positions, one permutation cycle at
+	 * a time (recs[i].index is the current position of the entry going
+	 * to position i) */
+	for (i = 0; i < n; i++) {
+		if (recs[i].index == i)
+			continue;
+
+		const struct fileinfo t = list[i];
+		filesn_t j = i, k;
+		while ((k = recs[j].index) != i) {
+			list[j] = list[k];
+			recs[j].index = j;
+			j = k;
+		}
+		list[j] = t;
+		recs[j].index = j;
+	}
+
+	free(recs);
+
+#ifdef SORT_SPEED_TEST
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	fprintf(stderr, "sort_by_keys time: %f (%jd entries: keys %f, "
+		"sort %f, move %f)\n", sort_elapsed(&t_start, &t_end), (intmax_t)n,
+		sort_elapsed(&t_start, &t_keys), sort_elapsed(&t_keys, &t_sorted),
+		sort_elapsed(&t_sorted, &t_end));
+#endif /* SORT_SPEED_TEST */
+
+	return 0;
 }
 
 /* Same as alphasort, but is uses strcmp instead of sctroll, which is
@@ -357,50 +771,50 @@ static inline void
 print_owner_group_sort(const int mode)
 {
 	if (conf.light_mode == 1) {
-		printf(_("%s (not available: using 'name') %s\n"),
+		frame_printf(_("%s (not available: using 'name') %s\n"),
 			(mode == SOWN) ? "owner" : "group",
 			(conf.sort_reverse == 1) ? "[rev]" : "");
 		return;
 	}
 
-	printf(_("%s %s\n"), (mode == SOWN) ? "owner" : "group",
+	frame_printf(_("%s %s\n"), (mode == SOWN) ? "owner" : "group",
 		(conf.sort_reverse == 1) ? "[rev]" : "");
 }
 
 void
 print_sort_method(void)
 {
-	fputs(BOLD, stdout);
+	frame_puts(BOLD);
 	switch (conf.sort) {
-	case SNONE:	puts(_("none")); break;
+	case SNONE:	frame_puts(_("none")); frame_putchar('\n'); break;
 	case SNAME:
-		printf(_("name %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("name %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 	case STSIZE:
-		printf(_("size %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("size %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 	case SATIME:
-		printf(_("atime %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
+		frame_printf(_("atime %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
 	case SBTIME:
 #if defined(HAVE_ST_BIRTHTIME) || defined(__BSD_VISIBLE) || defined(LINUX_STATX)
-		printf(_("btime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("btime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 #else
-		printf(_("btime (not available: using 'ctime') %s\n"),
+		frame_printf(_("btime (not available: using 'ctime') %s\n"),
 		    (conf.sort_reverse) ? "[rev]" : ""); break;
 #endif /* HAVE_ST_BIRTHTIME || __BSD_VISIBLE || LINUX_STATX */
 	case SCTIME:
-		printf(_("ctime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("ctime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 	case SMTIME:
-		printf(_("mtime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("mtime %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 	case SVER:
-		printf(_("version %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
+		frame_printf(_("version %s\n"), (conf.sort_reverse) ? "[rev]" : ""); break;
 	case SEXT:
-		printf(_("extension %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
+		frame_printf(_("extension %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
 	case SINO:
-		printf(_("inode %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
+		frame_printf(_("inode %s\n"), (conf.sort_reverse) ? "[rev]" : "");	break;
 	case SOWN: print_owner_group_sort(SOWN); break;
 	case SGRP: print_owner_group_sort(SGRP); break;
-	default: fputs("unknown sorting order\n", stdout); break;
+	default: frame_puts("unknown sorting order\n"); break;
 	}
-	fputs(NC, stdout);
+	frame_puts(NC);
 }
 
 static inline void
@@ -421,8 +835,11 @@ re_sort_files_list(void)
 	/* sort_switch just tells list_dir() to print a line with the current
 	 * sorting order at the end of the files list */
 	sort_switch = 1;
-	free_dirlist();
-	int ret = list_dir();
+	int ret = EXIT_SUCCESS;
+	if (resort_dirlist() == -1) {
+		free_dirlist();
+		ret = list_dir();
+	}
 	sort_switch = 0;
 
 	return ret;
@@ -35,6 +35,8 @@ int  compare_strings(char **, char **);
 int  xalphasort(const struct dirent **, const struct dirent **);
 int  sort_function(char **);
 int  entrycmp(const void *, const void *);
+size_t name_sort_key(char *, char *, const size_t);
+int  sort_by_keys(struct fileinfo *, const filesn_t);
 int  skip_nonexec(const struct dirent *);
 int  skip_files(const struct dirent *);
 void print_sort_method(void);
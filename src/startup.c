@@ -0,0 +1,290 @@
+/* startup.c -- deferred initialization and startup profiling */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+/* Some subsystems are not needed to print the first files list and the
+ * first prompt: the list of programs in PATH (and the third-party programs
+ * check depending on it), the jump database, bookmarks, tags, profile
+ * names, and the list of ext mount points. main() defers them via
+ * defer_startup_task(), and they are initialized afterwards:
+ *
+ * 1. One at a time, while waiting for the user's input (see wait_input()
+ * in readline.c).
+ * 2. All at once, as soon as they might be needed: before handling the
+ * first key press (my_rl_getc()) and before running a command
+ * (exec_cmd()).
+ * 3. One of them, on first use, via run_startup_task() (for instance,
+ * get_ext_fs_type() in fsinfo.c needs the list of ext mount points).
+ *
+ * Tasks run in the main thread: the data they load is used all over the
+ * place without any locking (and get_path_programs() changes the current
+ * directory).
+ *
+ * When running with --startup-profile, the time taken by each startup
+ * phase (see startup_phase() in main()) and each deferred task is
+ * printed to stderr at exit. */
+
+#include "helpers.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "checks.h" /* check_third_party_cmds(), check_completion_mode() */
+#include "init.h"
+#include "jump.h" /* add_to_jumpdb() */
+#ifndef _NO_PROFILES
+# include "profiles.h" /* get_profile_names() */
+#endif /* !_NO_PROFILES */
+#include "startup.h"
+
+/* Task states */
+#define TASK_NONE      0 /* Not deferred */
+#define TASK_PENDING   1
+#define TASK_RUNNING   2
+#define TASK_IDLE      3 /* Run while waiting for input */
+#define TASK_ON_DEMAND 4 /* Run because it was needed */
+
+struct startup_task_t {
+	const char *name;
+	void (*func)(void);
+	int state;
+	double start; /* Milliseconds since startup */
+	double took;
+};
+
+struct startup_phase_t {
+	const char *name;
+	double end; /* Milliseconds since startup */
+};
+
+static struct timespec startup_clock;
+static struct startup_phase_t phases[STARTUP_MAX_PHASES];
+static size_t phases_n = 0;
+static size_t tasks_pending = 0;
+static int prompt_ready = 0;
+
+static void
+load_path_programs(void)
+{
+	/* Get the list of available programs in PATH to be used by the
+	 * custom TAB-completion function (tab_complete(), in tabcomp.c). */
+	if (!(flags & PATH_PROGRAMS_ALREADY_LOADED))
+		get_path_programs();
+
+	/* Check third-party programs availability: finders (fzf, fnf, smenu),
+	 * udevil, and udisks2. */
+	check_third_party_cmds();
+#ifndef _NO_FZF
+	check_completion_mode();
+#endif /* _NO_FZF */
+}
+
+static void
+load_jumpdb_task(void)
+{
+	load_jumpdb();
+	if (!jump_db || xargs.path == 1)
+		add_to_jumpdb(workspaces[cur_ws].path);
+}
+
+static void
+load_bookmarks_task(void)
+{
+	load_bookmarks();
+}
+
+static void
+load_profile_names(void)
+{
+#ifndef _NO_PROFILES
+	get_profile_names();
+#endif /* !_NO_PROFILES */
+}
+
+static void
+load_ext_mountpoints(void)
+{
+#ifdef LINUX_FSINFO
+	get_ext_mountpoints();
+#endif /* LINUX_FSINFO */
+}
+
+/* Indexed by enum startup_task */
+static struct startup_task_t tasks[STARTUP_TASKS_N] = {
+	{"path programs", load_path_programs, TASK_NONE, 0, 0},
+	{"jump database", load_jumpdb_task, TASK_NONE, 0, 0},
+	{"bookmarks", load_bookmarks_task, TASK_NONE, 0, 0},
+	{"tags", load_tags, TASK_NONE, 0, 0},
+	{"profile names", load_profile_names, TASK_NONE, 0, 0},
+	{"ext mount points", load_ext_mountpoints, TASK_NONE, 0, 0}
+};
+
+/* Return the amount of milliseconds elapsed since init_startup_profile() */
+static double
+startup_elapsed(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)(now.tv_sec - startup_clock.tv_sec) * 1000.0
+		+ (double)(now.tv_nsec - startup_clock.tv_nsec) / 1000000.0;
+}
+
+/* Start the clock used by startup_phase() and the deferred tasks */
+void
+init_startup_profile(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &startup_clock);
+}
+
+/* Mark the end of the startup phase NAME (it began where the previous
+ * one ended). */
+void
+startup_phase(const char *name)
+{
+	if (prompt_ready == 1 || phases_n >= STARTUP_MAX_PHASES)
+		return;
+
+	phases[phases_n].name = name;
+	phases[phases_n].end = startup_elapsed();
+	phases_n++;
+}
+
+/* Called every time we wait for a key press: only the first call, made
+ * once the first prompt is printed, is recorded. */
+void
+startup_prompt_ready(void)
+{
+	if (prompt_ready == 1)
+		return;
+
+	startup_phase("first prompt");
+	prompt_ready = 1;
+}
+
+/* Postpone TASK until either we are idle or it is needed. If already
+ * pending, do nothing. */
+void
+defer_startup_task(const enum startup_task task)
+{
+	if (tasks[task].state == TASK_PENDING || tasks[task].state == TASK_RUNNING)
+		return;
+
+	tasks[task].state = TASK_PENDING;
+	tasks_pending++;
+}
+
+int
+startup_tasks_pending(void)
+{
+	return (tasks_pending > 0);
+}
+
+static void
+exec_startup_task(const enum startup_task task, const int state)
+{
+	tasks[task].state = TASK_RUNNING;
+	tasks_pending--;
+
+	tasks[task].start = startup_elapsed();
+	tasks[task].func();
+	tasks[task].took = startup_elapsed() - tasks[task].start;
+
+	tasks[task].state = state;
+}
+
+/* Run TASK now, if still pending. Call this before using the data loaded
+ * by a deferred task outside of exec_cmd() and readline. */
+void
+run_startup_task(const enum startup_task task)
+{
+	if (tasks[task].state == TASK_PENDING)
+		exec_startup_task(task, TASK_ON_DEMAND);
+}
+
+/* Run the first pending task, if any. Returns 1 if a task was run, or
+ * zero otherwise. */
+int
+run_next_startup_task(void)
+{
+	if (tasks_pending == 0)
+		return 0;
+
+	int i;
+	for (i = 0; i < STARTUP_TASKS_N; i++) {
+		if (tasks[i].state == TASK_PENDING) {
+			exec_startup_task((enum startup_task)i, TASK_IDLE);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Run all pending tasks */
+void
+run_startup_tasks(void)
+{
+	if (tasks_pending == 0)
+		return;
+
+	int i;
+	for (i = 0; i < STARTUP_TASKS_N; i++)
+		run_startup_task((enum startup_task)i);
+}
+
+/* Print the duration of each startup phase and deferred task to stderr
+ * (--startup-profile) */
+void
+print_startup_profile(void)
+{
+	fprintf(stderr, "%s: Startup profile (milliseconds)\n\n", PROGRAM_NAME);
+	fprintf(stderr, "%-24s %10s %10s\n", "Phase", "Took", "Ended at");
+
+	size_t i;
+	double prev = 0;
+	for (i = 0; i < phases_n; i++) {
+		fprintf(stderr, "%-24s %10.3f %10.3f\n", phases[i].name,
+			phases[i].end - prev, phases[i].end);
+		prev = phases[i].end;
+	}
+
+	fprintf(stderr, "\n%-24s %10s %10s  %s\n", "Deferred task", "Took",
+		"Started at", "Run");
+
+	int n;
+	for (n = 0; n < STARTUP_TASKS_N; n++) {
+		switch (tasks[n].state) {
+		case TASK_NONE: break;
+		case TASK_PENDING:
+			fprintf(stderr, "%-24s %10s %10s  %s\n", tasks[n].name,
+				"-", "-", "never");
+			break;
+		default:
+			fprintf(stderr, "%-24s %10.3f %10.3f  %s\n", tasks[n].name,
+				tasks[n].took, tasks[n].start,
+				tasks[n].state == TASK_IDLE ? "while idle" : "on demand");
+			break;
+		}
+	}
+}
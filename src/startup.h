@@ -0,0 +1,57 @@
+/* startup.h */
+
+/*
+ * This file is part of CliFM
+ *
+ * Copyright (C) 2016-2023, L. Abramovich <leo.clifm@outlook.com>
+ * All rights reserved.
+
+ * CliFM is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * CliFM is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+*/
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+/* Initialization tasks that can be run after the first prompt. Pending
+ * tasks are run while idle in this order. */
+enum startup_task {
+	STARTUP_PATH_PROGRAMS = 0,
+	STARTUP_JUMPDB,
+	STARTUP_BOOKMARKS,
+	STARTUP_TAGS,
+	STARTUP_PROFILES,
+	STARTUP_EXT_MOUNTPOINTS,
+	STARTUP_TASKS_N
+};
+
+/* Max amount of startup phases recorded for --startup-profile */
+#define STARTUP_MAX_PHASES 16
+
+__BEGIN_DECLS
+
+void defer_startup_task(const enum startup_task);
+void init_startup_profile(void);
+void print_startup_profile(void);
+int  run_next_startup_task(void);
+void run_startup_task(const enum startup_task);
+void run_startup_tasks(void);
+void startup_phase(const char *);
+void startup_prompt_ready(void);
+int  startup_tasks_pending(void);
+
+__END_DECLS
+
+#endif /* STARTUP_H */
@@ -46,6 +46,7 @@ typedef char *rl_cpvfunc_t;
 #include "checks.h"
 #include "colors.h"
 #include "fuzzy_match.h"
+#include "init.h" /* get_bin_cmds_range() */
 #include "jump.h"
 #include "messages.h"
 #include "navigation.h" /* fastback() */
@@ -1211,31 +1212,31 @@ check_cmds(char *str, size_t len, const int print)
 		len--;
 	}
 
-	size_t i;
-	for (i = 0; bin_commands[i]; i++) {
-		if (!bin_commands[i] || *cmd != *bin_commands[i])
-			continue;
-
-		if (!print) {
-			if (strcmp(cmd, bin_commands[i]) == 0)
-				return FULL_MATCH;
-			continue;
-		}
+	size_t start = 0;
 
-		/* Let's check the 2nd char as well before calling strcmp() */
-		if (len > 1 && *(bin_commands[i] + 1)
-		&& *(cmd + 1) != *(bin_commands[i] + 1))
-			continue;
-
-		if (strncmp(cmd, bin_commands[i], len) != 0)
-			continue;
+	if (!print) {
+		/* The shortest match sorts first */
+		const size_t clen = strlen(cmd);
+		if (get_bin_cmds_range(cmd, clen, &start) > 0
+		&& !bin_commands[bin_commands_idx[start]][clen])
+			return FULL_MATCH;
+		return print_internal_cmd_suggestion(cmd, len, print);
+	}
 
-		int ret = print_cmd_suggestion(i, len);
-		if (ret == NO_MATCH)
-			continue;
-		return ret;
+	/* Suggest the first match in bin_commands order (internal commands,
+	 * aliases, and actions come before commands in PATH), skipping external
+	 * commands if they are not allowed. */
+	const size_t n = get_bin_cmds_range(cmd, len, &start);
+	size_t i, best = path_progsn;
+	for (i = start; i < start + n; i++) {
+		const size_t j = bin_commands_idx[i];
+		if (j < best && (conf.ext_cmd_ok == 1 || is_internal_c(bin_commands[j])))
+			best = j;
 	}
 
+	if (best < path_progsn)
+		return print_cmd_suggestion(best, len);
+
 	return print_internal_cmd_suggestion(cmd, len, print);
 }
 
@@ -61,6 +61,7 @@ typedef char *rl_cpvfunc_t;
 #include "misc.h"
 #include "checks.h"
 #include "colors.h"
+#include "frame.h"
 #include "navigation.h"
 #include "readline.h"
 #include "selection.h"
@@ -1904,6 +1905,9 @@ tab_complete(const int what_to_do)
 		return EXIT_SUCCESS;
 	}
 
+	/* Listing completions may scroll the screen (see frame.c) */
+	frame_invalidate();
+
 	rl_compentry_func_t *our_func = rl_completion_entry_function;
 
 	/* Only the completion entry function can change these. */